@@ -0,0 +1,196 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Throughput benchmarks for the string functions.
+ *
+ * Each function is run against a byte-at-a-time reference loop over
+ * inputs from 1 KB to 1 MB. Build and run with `make benchmark && ./benchmark'.
+*/
+
+#include "config.h"
+
+#include "nc.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** The number of bytes to process for each measurement */
+#define BENCH_VOLUME	(256 * 1024 * 1024)
+
+/** Functions that are measured */
+enum {
+	BENCH_COUNT,
+	BENCH_TRANSLATE,
+	BENCH_TO_UPPER,
+	BENCH_CASE_COMPARE,
+	BENCH_MAX
+};
+
+static const char *BENCH_NAME[] = {
+	"str_count",
+	"str_translate",
+	"str_to_upper",
+	"str_case_compare",
+};
+
+
+/* Byte-at-a-time reference implementations */
+
+static int
+ref_count(size_t *dest, const string_t *s, int c)
+{
+	size_t i;
+
+	*dest = 0;
+	for (i = 0; i < s->len; i++) {
+		if (s->value[i] == c)
+			(*dest)++;
+	}
+}
+
+
+static int
+ref_translate(string_t *s, int old, int new)
+{
+	char  *cp = (char *) s->value;
+	size_t i;
+
+	for (i = 0; i < s->len; i++) {
+		if (cp[i] == old)
+			cp[i] = (char) new;
+	}
+}
+
+
+static int
+ref_to_upper(string_t *s)
+{
+	char  *cp = (char *) s->value;
+	size_t i;
+
+	for (i = 0; i < s->len; i++)
+		cp[i] = (char) toupper((unsigned char) cp[i]);
+}
+
+
+static int
+ref_case_compare(const string_t *s1, const string_t *s2)
+{
+	size_t i;
+
+	if (s1->len != s2->len)
+		return -1;
+	for (i = 0; i < s1->len; i++) {
+		if (tolower((unsigned char) s1->value[i]) != tolower((unsigned char) s2->value[i]))
+			return -1;
+	}
+}
+
+
+/**
+ * Run one function repeatedly and measure its throughput.
+ *
+ * @param mbps the throughput, in megabytes per second
+ * @param test one of the BENCH_* constants
+ * @param reference if true, run the reference implementation
+ * @param s1 the input
+ * @param s2 a case-insensitive copy of the input
+ */
+static int
+bench_run(double *mbps, int test, bool reference, string_t *s1, string_t *s2)
+{
+	struct timespec start, end;
+	size_t n, iterations, sum = 0;
+	double elapsed;
+
+	iterations = BENCH_VOLUME / s1->len;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (n = 0; n < iterations; n++) {
+		switch (test) {
+		case BENCH_COUNT:
+			if (reference)
+				(void) ref_count(&sum, s1, '\n');
+			else
+				(void) str_count(&sum, s1, '\n');
+			break;
+
+		case BENCH_TRANSLATE:
+			/* Alternate so that every pass has work to do */
+			if (reference)
+				(void) ref_translate(s1, n & 1 ? '.' : '\n', n & 1 ? '\n' : '.');
+			else
+				(void) str_translate(s1, n & 1 ? '.' : '\n', n & 1 ? '\n' : '.');
+			break;
+
+		case BENCH_TO_UPPER:
+			if (reference)
+				(void) ref_to_upper(s2);
+			else
+				(void) str_to_upper(s2);
+			break;
+
+		case BENCH_CASE_COMPARE:
+			if (reference)
+				sum += ref_case_compare(s1, s2);
+			else
+				sum += str_case_compare(s1, s2);
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (double) (end.tv_sec - start.tv_sec) +
+		(double) (end.tv_nsec - start.tv_nsec) / 1e9;
+	*mbps = (double) (iterations * s1->len) / elapsed / (1024 * 1024);
+
+	/* Keep the compiler from discarding the loop */
+	if (sum == (size_t) -1)
+		printf(" ");
+}
+
+
+int
+main(int argc, char **argv)
+{
+	string_t *s1, *s2;
+	size_t    size, i;
+	double    fast, slow;
+	int       test;
+
+	printf("%-18s %8s %12s %12s %8s\n", "function", "bytes", "MB/s", "loop MB/s", "speedup");
+	for (test = 0; test < BENCH_MAX; test++) {
+		for (size = 1024; size <= 1024 * 1024; size *= 4) {
+
+			/* Generate mixed-case text with a line break every 64 bytes */
+			str_truncate(s1);
+			for (i = 0; i < size; i++)
+				str_putc(s1, (i % 64 == 63) ? '\n' : "aBcDeFgHiJ kLmNoP@[`{"[i % 21]);
+			str_copy(s2, s1);
+			str_to_upper(s2);
+
+			bench_run(&fast, test, false, s1, s2);
+			bench_run(&slow, test, true, s1, s2);
+			printf("%-18s %8zu %12.1f %12.1f %7.1fx\n",
+					BENCH_NAME[test], size, fast, slow, fast / slow);
+		}
+	}
+}
@@ -0,0 +1,389 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Byte scanning kernels.
+ *
+ * This is a private header that is not installed. The kernels are plain C
+ * so that they are not rewritten by ncc, and they work on raw buffers so
+ * that string.c and socket.c can share them.
+ *
+ * Each kernel has three stages: an AVX2 loop that is selected at runtime
+ * if the CPU supports it, an SSE2 loop if the compiler targets SSE2, and
+ * a scalar loop that handles the tail and every other platform.
+ */
+
+#ifndef _BYTESCAN_H
+#define _BYTESCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nc_memory.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    !defined(NC_NO_AVX2) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define BYTESCAN_AVX2	1
+#include <immintrin.h>
+#define AVX2_TARGET	__attribute__ ((__target__ ("avx2")))
+#endif
+
+/** The maximum number of bytes that bytescan_find_any() can search for */
+#define BYTESCAN_SET_MAX	8
+
+/** Return true if the byte is between @a lo and @a lo + 25 (a-z or A-Z) */
+#define BYTESCAN_IN_ALPHA(c, lo)	((unsigned char) ((c) - (lo)) < 26)
+
+/* ---------------------------- AVX2 KERNELS ------------------------------ */
+
+#ifdef BYTESCAN_AVX2
+
+/** Cached result of the CPUID check; -1 means unknown */
+static int bytescan_avx2_state = -1;
+
+static inline bool UNUSED
+bytescan_have_avx2(void)
+{
+	if (bytescan_avx2_state < 0) {
+		__builtin_cpu_init();
+		bytescan_avx2_state = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	return bytescan_avx2_state;
+}
+
+/* Each AVX2 kernel handles whole 32-byte blocks and updates *pos. */
+
+static size_t AVX2_TARGET UNUSED
+bytescan_count_avx2(const char *p, size_t len, int c, size_t *pos)
+{
+	const __m256i needle = _mm256_set1_epi8((char) c);
+	const __m256i zero = _mm256_setzero_si256();
+	uint64_t sum[4];
+	size_t   i = *pos, n = 0, j;
+	__m256i  acc;
+
+	while (len - i >= 32) {
+		/* Each lane can count to 255 before it must be flushed */
+		acc = zero;
+		for (j = 0; j < 255 && len - i >= 32; j++, i += 32) {
+			acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(
+				_mm256_loadu_si256((const __m256i *) (p + i)), needle));
+		}
+		_mm256_storeu_si256((__m256i *) sum, _mm256_sad_epu8(acc, zero));
+		n += sum[0] + sum[1] + sum[2] + sum[3];
+	}
+	*pos = i;
+	return n;
+}
+
+static const char * AVX2_TARGET UNUSED
+bytescan_find_any_avx2(const char *p, size_t len, const char *set, size_t nset, size_t *pos)
+{
+	__m256i  needle[BYTESCAN_SET_MAX], block, hit;
+	uint32_t mask;
+	size_t   i = *pos, k;
+
+	for (k = 0; k < nset; k++)
+		needle[k] = _mm256_set1_epi8(set[k]);
+
+	for (; len - i >= 32; i += 32) {
+		block = _mm256_loadu_si256((const __m256i *) (p + i));
+		hit = _mm256_cmpeq_epi8(block, needle[0]);
+		for (k = 1; k < nset; k++)
+			hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(block, needle[k]));
+		mask = (uint32_t) _mm256_movemask_epi8(hit);
+		if (mask != 0)
+			return p + i + __builtin_ctz(mask);
+	}
+	*pos = i;
+	return NULL;
+}
+
+static UNUSED AVX2_TARGET void
+bytescan_fold_avx2(char *dst, const char *src, size_t len, int lo, size_t *pos)
+{
+	const __m256i bias = _mm256_set1_epi8((char) (0x80 - lo));
+	const __m256i limit = _mm256_set1_epi8((char) (-128 + 26));
+	const __m256i flip = _mm256_set1_epi8(0x20);
+	__m256i block, alpha;
+	size_t  i = *pos;
+
+	for (; len - i >= 32; i += 32) {
+		block = _mm256_loadu_si256((const __m256i *) (src + i));
+		alpha = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(block, bias));
+		block = _mm256_xor_si256(block, _mm256_and_si256(alpha, flip));
+		_mm256_storeu_si256((__m256i *) (dst + i), block);
+	}
+	*pos = i;
+}
+
+static UNUSED AVX2_TARGET void
+bytescan_translate_avx2(char *p, size_t len, int old, int new, size_t *pos)
+{
+	const __m256i from = _mm256_set1_epi8((char) old);
+	const __m256i to = _mm256_set1_epi8((char) new);
+	__m256i block;
+	size_t  i = *pos;
+
+	for (; len - i >= 32; i += 32) {
+		block = _mm256_loadu_si256((const __m256i *) (p + i));
+		block = _mm256_blendv_epi8(block, to, _mm256_cmpeq_epi8(block, from));
+		_mm256_storeu_si256((__m256i *) (p + i), block);
+	}
+	*pos = i;
+}
+
+static bool AVX2_TARGET UNUSED
+bytescan_case_equal_avx2(const char *a, const char *b, size_t len, size_t *pos)
+{
+	const __m256i bias = _mm256_set1_epi8((char) (0x80 - 'A'));
+	const __m256i limit = _mm256_set1_epi8((char) (-128 + 26));
+	const __m256i flip = _mm256_set1_epi8(0x20);
+	__m256i x, y;
+	size_t  i = *pos;
+
+	for (; len - i >= 32; i += 32) {
+		x = _mm256_loadu_si256((const __m256i *) (a + i));
+		y = _mm256_loadu_si256((const __m256i *) (b + i));
+		x = _mm256_or_si256(x, _mm256_and_si256(flip,
+			_mm256_cmpgt_epi8(limit, _mm256_add_epi8(x, bias))));
+		y = _mm256_or_si256(y, _mm256_and_si256(flip,
+			_mm256_cmpgt_epi8(limit, _mm256_add_epi8(y, bias))));
+		if ((uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xFFFFFFFFU)
+			return false;
+	}
+	*pos = i;
+	return true;
+}
+
+#endif /* BYTESCAN_AVX2 */
+
+/* ------------------------------- KERNELS -------------------------------- */
+
+/**
+ * Count the number of times that a byte appears in a buffer.
+ */
+static inline size_t UNUSED
+bytescan_count(const char *p, size_t len, int c)
+{
+	size_t i = 0, n = 0;
+
+#ifdef BYTESCAN_AVX2
+	if (len >= 64 && bytescan_have_avx2())
+		n += bytescan_count_avx2(p, len, c, &i);
+#endif
+#ifdef __SSE2__
+	{
+		const __m128i needle = _mm_set1_epi8((char) c);
+		const __m128i zero = _mm_setzero_si128();
+		__m128i acc;
+		size_t  j;
+
+		while (len - i >= 16) {
+			acc = zero;
+			for (j = 0; j < 255 && len - i >= 16; j++, i += 16) {
+				acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(
+					_mm_loadu_si128((const __m128i *) (p + i)), needle));
+			}
+			acc = _mm_sad_epu8(acc, zero);
+			n += (size_t) _mm_cvtsi128_si32(acc) + (size_t) _mm_extract_epi16(acc, 4);
+		}
+	}
+#endif
+	for (; i < len; i++)
+		n += (p[i] == (char) c);
+	return n;
+}
+
+
+/**
+ * Find the first byte in a buffer that is a member of a set.
+ *
+ * @param set the bytes to look for
+ * @param nset the number of bytes in @a set, at most BYTESCAN_SET_MAX
+ * @return a pointer to the first matching byte, or NULL if there is none
+ */
+static inline const char * UNUSED
+bytescan_find_any(const char *p, size_t len, const char *set, size_t nset)
+{
+	const char *hit = NULL;
+	size_t i = 0, k;
+
+	/* The C library already has a vectorized single byte search */
+	if (nset == 1)
+		return memchr(p, set[0], len);
+	if (nset == 0 || nset > BYTESCAN_SET_MAX)
+		goto scalar;
+
+#ifdef BYTESCAN_AVX2
+	if (len >= 32 && bytescan_have_avx2()) {
+		if ((hit = bytescan_find_any_avx2(p, len, set, nset, &i)) != NULL)
+			return hit;
+	}
+#endif
+#ifdef __SSE2__
+	{
+		__m128i needle[BYTESCAN_SET_MAX], block, match;
+		unsigned int mask;
+
+		for (k = 0; k < nset; k++)
+			needle[k] = _mm_set1_epi8(set[k]);
+
+		for (; len - i >= 16; i += 16) {
+			block = _mm_loadu_si128((const __m128i *) (p + i));
+			match = _mm_cmpeq_epi8(block, needle[0]);
+			for (k = 1; k < nset; k++)
+				match = _mm_or_si128(match, _mm_cmpeq_epi8(block, needle[k]));
+			mask = (unsigned int) _mm_movemask_epi8(match);
+			if (mask != 0)
+				return p + i + __builtin_ctz(mask);
+		}
+	}
+#endif
+scalar:
+	for (; i < len; i++) {
+		for (k = 0; k < nset; k++) {
+			if (p[i] == set[k])
+				return p + i;
+		}
+	}
+	return hit;
+}
+
+
+/**
+ * Flip the case of every ASCII letter in the range @a lo to @a lo + 25.
+ *
+ * Use 'a' to convert to uppercase, or 'A' to convert to lowercase.
+ * Bytes outside of the ASCII alphabet are copied unchanged, so the
+ * result does not depend on the current locale. @a dst may be equal
+ * to @a src.
+ */
+static inline UNUSED void
+bytescan_fold(char *dst, const char *src, size_t len, int lo)
+{
+	size_t i = 0;
+
+#ifdef BYTESCAN_AVX2
+	if (len >= 32 && bytescan_have_avx2())
+		bytescan_fold_avx2(dst, src, len, lo, &i);
+#endif
+#ifdef __SSE2__
+	{
+		const __m128i bias = _mm_set1_epi8((char) (0x80 - lo));
+		const __m128i limit = _mm_set1_epi8((char) (-128 + 26));
+		const __m128i flip = _mm_set1_epi8(0x20);
+		__m128i block, alpha;
+
+		for (; len - i >= 16; i += 16) {
+			block = _mm_loadu_si128((const __m128i *) (src + i));
+			alpha = _mm_cmplt_epi8(_mm_add_epi8(block, bias), limit);
+			block = _mm_xor_si128(block, _mm_and_si128(alpha, flip));
+			_mm_storeu_si128((__m128i *) (dst + i), block);
+		}
+	}
+#endif
+	for (; i < len; i++)
+		dst[i] = BYTESCAN_IN_ALPHA(src[i], lo) ? (char) (src[i] ^ 0x20) : src[i];
+}
+
+
+/**
+ * Replace every occurrence of one byte with another.
+ */
+static inline UNUSED void
+bytescan_translate(char *p, size_t len, int old, int new)
+{
+	size_t i = 0;
+
+#ifdef BYTESCAN_AVX2
+	if (len >= 32 && bytescan_have_avx2())
+		bytescan_translate_avx2(p, len, old, new, &i);
+#endif
+#ifdef __SSE2__
+	{
+		const __m128i from = _mm_set1_epi8((char) old);
+		const __m128i to = _mm_set1_epi8((char) new);
+		__m128i block, match;
+
+		for (; len - i >= 16; i += 16) {
+			block = _mm_loadu_si128((const __m128i *) (p + i));
+			match = _mm_cmpeq_epi8(block, from);
+			block = _mm_or_si128(_mm_andnot_si128(match, block), _mm_and_si128(match, to));
+			_mm_storeu_si128((__m128i *) (p + i), block);
+		}
+	}
+#endif
+	for (; i < len; i++) {
+		if (p[i] == (char) old)
+			p[i] = (char) new;
+	}
+}
+
+
+/**
+ * Compare two buffers of equal length, ignoring the case of ASCII letters.
+ *
+ * @return true if the buffers are equal
+ */
+static inline bool UNUSED
+bytescan_case_equal(const char *a, const char *b, size_t len)
+{
+	size_t i = 0;
+
+#ifdef BYTESCAN_AVX2
+	if (len >= 32 && bytescan_have_avx2()) {
+		if (!bytescan_case_equal_avx2(a, b, len, &i))
+			return false;
+	}
+#endif
+#ifdef __SSE2__
+	{
+		const __m128i bias = _mm_set1_epi8((char) (0x80 - 'A'));
+		const __m128i limit = _mm_set1_epi8((char) (-128 + 26));
+		const __m128i flip = _mm_set1_epi8(0x20);
+		__m128i x, y;
+
+		for (; len - i >= 16; i += 16) {
+			x = _mm_loadu_si128((const __m128i *) (a + i));
+			y = _mm_loadu_si128((const __m128i *) (b + i));
+			x = _mm_or_si128(x, _mm_and_si128(flip,
+				_mm_cmplt_epi8(_mm_add_epi8(x, bias), limit)));
+			y = _mm_or_si128(y, _mm_and_si128(flip,
+				_mm_cmplt_epi8(_mm_add_epi8(y, bias), limit)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF)
+				return false;
+		}
+	}
+#endif
+	for (; i < len; i++) {
+		if (a[i] != b[i]) {
+			if ((a[i] | 0x20) != (b[i] | 0x20) || !BYTESCAN_IN_ALPHA(a[i] | 0x20, 'a'))
+				return false;
+		}
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,523 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Constant databases.
+ *
+ * The builder appends records to a temporary file and remembers the
+ * hash and offset of each one. cdb_make_finish() then writes the hash
+ * tables, fills in the header and renames the temporary file over the
+ * database, so readers never see a partly written file.
+ *
+ * A reader maps the whole file and returns views into the mapping.
+ * Since the mapping is read-only and shared, every process that opens
+ * the same database uses the same physical pages.
+*/
+
+#include "config.h"
+
+#include "nc_cdb.h"
+#include "nc_exception.h"
+#include "nc_hash.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_string.h"
+#include "nc_strview.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ------------------------------ GLOBAL VARIABLES ------------------------- */
+
+/** The first four bytes of a database */
+#define CDB_MAGIC		"NCDB"
+
+/** The version of the file format */
+#define CDB_VERSION		1
+
+/** The amount of output that the builder buffers before writing it */
+#define CDB_FLUSH_SIZE		(256 * 1024)
+
+/* Little-endian integers at unaligned addresses */
+#define cdb_put32(p,n)	({ uint32_t _n = htole32(n); memcpy((p), &_n, 4); 0; })
+#define cdb_put64(p,n)	({ uint64_t _n = htole64(n); memcpy((p), &_n, 8); 0; })
+#define cdb_get32(p)	({ uint32_t _n; memcpy(&_n, (p), 4); le32toh(_n); })
+#define cdb_get64(p)	({ uint64_t _n; memcpy(&_n, (p), 8); le64toh(_n); })
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Write the buffered output of a builder to its file.
+*/
+static int
+cdb_make_flush(cdb_make_t *cm)
+{
+	const char *p;
+	size_t      len;
+	ssize_t     n;
+
+	for (p = cm->buf->value, len = cm->buf->len; len > 0; p += n, len -= (size_t) n) {
+		if ((n = write(cm->fd, p, len)) < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			throw_errno("write(2)");
+		}
+	}
+	str_truncate(cm->buf);
+}
+
+
+/**
+ * Create a new database builder.
+ *
+ * @param dest the new builder
+*/
+int
+cdb_make_new(cdb_make_t **dest)
+{
+	cdb_make_t *cm = NULL;
+
+	mem_calloc(cm);
+	cm->fd = -1;
+	str_new(&cm->path);
+	str_new(&cm->tmp_path);
+	str_new(&cm->buf);
+	*dest = cm;
+
+catch:
+	(void) cdb_make_destroy(&cm);
+}
+
+
+/**
+ * Destroy a database builder.
+ *
+ * If the database was not finished, the temporary file is removed and
+ * any previous database at the same path is left unchanged.
+ *
+ * @param cm_ref the builder; this will be set to NULL
+*/
+int
+cdb_make_destroy(cdb_make_t **cm_ref)
+{
+	cdb_make_t *cm = *cm_ref;
+
+	if (cm == NULL)
+		return 0;
+
+	if (cm->fd >= 0) {
+		(void) close(cm->fd);
+		(void) unlink(cm->tmp_path->value);
+	}
+	free(cm->entry);
+	(void) str_destroy(&cm->path);
+	(void) str_destroy(&cm->tmp_path);
+	(void) str_destroy(&cm->buf);
+	free(cm);
+	*cm_ref = NULL;
+}
+
+
+/**
+ * Start building a database.
+ *
+ * @param cm the builder
+ * @param path the path of the database that will be created
+*/
+int
+cdb_make_start(cdb_make_t *cm, const string_t *path)
+{
+	char header[CDB_HEADER_SIZE];
+
+	if (cm->fd >= 0)
+		throw("a database is already being built");
+
+	str_copy(cm->path, path);
+	str_sprintf(cm->tmp_path, "%s.tmp.%ld", path->value, (long) getpid());
+	if ((cm->fd = open(cm->tmp_path->value, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		throw_errno("open(2)");
+
+	/* The seed is derived from the secret seed of hash_t, so it cannot be guessed */
+	hash_key(&cm->seed, cm->tmp_path->value, cm->tmp_path->len);
+
+	/* Reserve space for the header */
+	memset(header, 0, sizeof(header));
+	str_truncate(cm->buf);
+	str_append_bytes(cm->buf, header, sizeof(header));
+	cm->pos = CDB_HEADER_SIZE;
+	cm->count = 0;
+
+catch:
+	log_error("while creating `%s' ..", path->value);
+}
+
+
+/**
+ * Add a record to a database.
+ *
+ * Keys should be unique; if a key is added more than once, lookups
+ * return the value that was added first.
+ *
+ * @param cm the builder
+ * @param key the key
+ * @param key_len the length of @a key
+ * @param value the value
+ * @param value_len the length of @a value
+*/
+int
+cdb_make_add(cdb_make_t *cm, const void *key, size_t key_len, const void *value, size_t value_len)
+{
+	struct cdb_entry *p;
+	char              rec[CDB_RECORD_SIZE];
+	size_t            size;
+
+	if (cm->fd < 0)
+		throw("cdb_make_start() has not been called");
+	if (key_len > UINT32_MAX || value_len > UINT32_MAX)
+		throw("record too large");
+
+	/* Grow the list of entries */
+	if (cm->count == cm->size) {
+		size = (cm->size < 64) ? 64 : cm->size * 2;
+		if ((p = realloc(cm->entry, size * sizeof(*p))) == NULL)
+			throw_errno("realloc(3)");
+		cm->entry = p;
+		cm->size = size;
+	}
+
+	cdb_put32(rec, (uint32_t) key_len);
+	cdb_put32(rec + 4, (uint32_t) value_len);
+	str_append_bytes(cm->buf, rec, sizeof(rec));
+	str_append_bytes(cm->buf, key, key_len);
+	str_append_bytes(cm->buf, value, value_len);
+
+	cm->entry[cm->count].hash = hash_bytes(key, key_len, cm->seed);
+	cm->entry[cm->count].offset = cm->pos;
+	cm->count++;
+	cm->pos += CDB_RECORD_SIZE + key_len + value_len;
+
+	if (cm->buf->len >= CDB_FLUSH_SIZE)
+		cdb_make_flush(cm);
+}
+
+
+/**
+ * Write the hash tables and install the database.
+ *
+ * @param cm the builder
+*/
+int
+cdb_make_finish(cdb_make_t *cm)
+{
+	struct cdb_entry *sorted = NULL, *e;
+	char              header[CDB_HEADER_SIZE];
+	char             *slot = NULL, *sp;
+	size_t            start[CDB_TABLES + 1], fill[CDB_TABLES];
+	size_t            i, b, n, nslots, max = 0;
+	ssize_t           written;
+
+	if (cm->fd < 0)
+		throw("cdb_make_start() has not been called");
+
+	/* Group the entries by table, preserving the order they were added in */
+	memset(start, 0, sizeof(start));
+	for (i = 0; i < cm->count; i++)
+		start[(cm->entry[i].hash & (CDB_TABLES - 1)) + 1]++;
+	for (b = 0; b < CDB_TABLES; b++) {
+		if (start[b + 1] > max)
+			max = start[b + 1];
+		start[b + 1] += start[b];
+	}
+	if (cm->count > 0 && (sorted = malloc(cm->count * sizeof(*sorted))) == NULL)
+		throw_errno("malloc(3)");
+	memcpy(fill, start, sizeof(fill));
+	for (i = 0; i < cm->count; i++) {
+		b = cm->entry[i].hash & (CDB_TABLES - 1);
+		sorted[fill[b]++] = cm->entry[i];
+	}
+
+	/* Each table has twice as many slots as entries */
+	if (max > 0 && (slot = malloc(max * 2 * CDB_SLOT_SIZE)) == NULL)
+		throw_errno("malloc(3)");
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, CDB_MAGIC, 4);
+	cdb_put32(header + 4, CDB_VERSION);
+	cdb_put64(header + 8, cm->seed);
+
+	for (b = 0; b < CDB_TABLES; b++) {
+		n = start[b + 1] - start[b];
+		nslots = n * 2;
+		cdb_put64(header + 16 + b * 16, cm->pos);
+		cdb_put64(header + 16 + b * 16 + 8, nslots);
+		if (n == 0)
+			continue;
+
+		memset(slot, 0, nslots * CDB_SLOT_SIZE);
+		for (e = &sorted[start[b]]; e < &sorted[start[b + 1]]; e++) {
+			i = (e->hash / CDB_TABLES) % nslots;
+			while (cdb_get64(slot + i * CDB_SLOT_SIZE + 8) != 0)
+				i = (i + 1) % nslots;
+			sp = slot + i * CDB_SLOT_SIZE;
+			cdb_put64(sp, e->hash);
+			cdb_put64(sp + 8, e->offset);
+		}
+		if (str_append_bytes(cm->buf, slot, nslots * CDB_SLOT_SIZE) < 0)
+			throw_silent();
+		cm->pos += nslots * CDB_SLOT_SIZE;
+		if (cm->buf->len >= CDB_FLUSH_SIZE && cdb_make_flush(cm) < 0)
+			throw_silent();
+	}
+	if (cdb_make_flush(cm) < 0)
+		throw_silent();
+
+	/* Fill in the header, then atomically replace the database */
+	if ((written = pwrite(cm->fd, header, sizeof(header), 0)) < 0)
+		throw_errno("pwrite(2)");
+	if (written != sizeof(header)) {
+		log_error("%s", "short pwrite(2) detected");
+		throw_silent();
+	}
+	if (fsync(cm->fd) < 0)
+		throw_errno("fsync(2)");
+	if (close(cm->fd) < 0) {
+		cm->fd = -1;
+		(void) unlink(cm->tmp_path->value);
+		throw_errno("close(2)");
+	}
+	cm->fd = -1;
+	if (rename(cm->tmp_path->value, cm->path->value) < 0) {
+		(void) unlink(cm->tmp_path->value);
+		throw_errno("rename(2)");
+	}
+
+finally:
+	free(sorted);
+	free(slot);
+}
+
+
+/**
+ * Build a database that contains every entry of a hash table.
+ *
+ * @param path the path of the database
+ * @param hash the hash table
+*/
+int
+cdb_make_from_hash(const string_t *path, const hash_t *hash)
+{
+	cdb_make_t     *cm;
+	const string_t *key, *value;
+	size_t          pos = 0;
+
+	cdb_make_start(cm, path);
+	while (hash_iterate(&key, &value, &pos, hash) == 0)
+		cdb_make_add(cm, key->value, key->len, value->value, value->len);
+	cdb_make_finish(cm);
+}
+
+
+/**
+ * Create a new database handle.
+ *
+ * @param dest the new handle
+*/
+int
+cdb_new(cdb_t **dest)
+{
+
+	mem_calloc(*dest);
+}
+
+
+/**
+ * Destroy a database handle, closing the database if it is open.
+ *
+ * @param db the handle; this will be set to NULL
+*/
+int
+cdb_destroy(cdb_t **db)
+{
+
+	if (*db == NULL)
+		return 0;
+
+	(void) cdb_close(*db);
+	free(*db);
+	*db = NULL;
+}
+
+
+/**
+ * Open a database by mapping it into memory.
+ *
+ * The header is checked, but the file is not read.
+ *
+ * @param db the handle
+ * @param path the path to the database
+*/
+int
+cdb_open(cdb_t *db, const string_t *path)
+{
+	struct stat st;
+	const char *map = MAP_FAILED;
+	uint64_t    off, nslots;
+	size_t      len = 0, b;
+	int         fd = -1;
+
+	cdb_close(db);
+
+	if ((fd = open(path->value, O_RDONLY)) < 0)
+		throw_errno("open(2)");
+	if (fstat(fd, &st) < 0)
+		throw_errno("fstat(2)");
+	if ((uint64_t) st.st_size < CDB_HEADER_SIZE) {
+		log_error("%s", "file is too short");
+		throw_silent();
+	}
+	len = (size_t) st.st_size;
+	if ((map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		throw_errno("mmap(2)");
+
+	if (memcmp(map, CDB_MAGIC, 4) != 0) {
+		log_error("%s", "invalid magic number");
+		throw_silent();
+	}
+	if (cdb_get32(map + 4) != CDB_VERSION) {
+		log_error("unsupported version: %u", cdb_get32(map + 4));
+		throw_silent();
+	}
+	for (b = 0; b < CDB_TABLES; b++) {
+		off = cdb_get64(map + 16 + b * 16);
+		nslots = cdb_get64(map + 16 + b * 16 + 8);
+		if (off > len || nslots > (len - off) / CDB_SLOT_SIZE) {
+			log_error("table %zu is out of bounds", b);
+			throw_silent();
+		}
+	}
+
+	db->map = map;
+	db->len = len;
+	db->seed = cdb_get64(map + 8);
+	map = MAP_FAILED;
+
+catch:
+	log_error("while opening `%s' ..", path->value);
+
+finally:
+	if (map != MAP_FAILED)
+		(void) munmap((void *) map, len);
+	if (fd >= 0)
+		(void) close(fd);
+}
+
+
+/**
+ * Close a database.
+ *
+ * Views that were returned by cdb_find() become invalid.
+ *
+ * @param db the handle
+*/
+int
+cdb_close(cdb_t *db)
+{
+
+	if (db->map != NULL && munmap((void *) db->map, db->len) < 0)
+		throw_errno("munmap(2)");
+	db->map = NULL;
+	db->len = 0;
+}
+
+
+/**
+ * Look up a key.
+ *
+ * @param dest a view of the value, within the mapping
+ * @param db the database
+ * @param key the key
+ * @param len the length of @a key
+ * @return 0 if the key was found, or -1 if it was not
+*/
+int
+cdb_find(strview_t *dest, const cdb_t *db, const void *key, size_t len)
+{
+	const char *sp, *rec;
+	uint64_t    h, off, nslots, i, n, roff, klen, vlen;
+
+	if (db->map == NULL)
+		throw("database is not open");
+
+	h = hash_bytes(key, len, db->seed);
+	sp = db->map + 16 + (h & (CDB_TABLES - 1)) * 16;
+	off = cdb_get64(sp);
+	nslots = cdb_get64(sp + 8);
+	if (nslots == 0)
+		return -1;
+
+	for (n = 0, i = (h / CDB_TABLES) % nslots; n < nslots; n++) {
+		sp = db->map + off + i * CDB_SLOT_SIZE;
+		if ((roff = cdb_get64(sp + 8)) == 0)
+			break;
+		if (cdb_get64(sp) == h) {
+			if (roff > db->len - CDB_RECORD_SIZE)
+				throw("record is out of bounds");
+			rec = db->map + roff;
+			klen = cdb_get32(rec);
+			vlen = cdb_get32(rec + 4);
+			if (klen + vlen > db->len - roff - CDB_RECORD_SIZE)
+				throw("record is out of bounds");
+			if (klen == len && memcmp(rec + CDB_RECORD_SIZE, key, len) == 0) {
+				dest->ptr = rec + CDB_RECORD_SIZE + klen;
+				dest->len = (size_t) vlen;
+				return 0;
+			}
+		}
+		if (++i == nslots)
+			i = 0;
+	}
+	return -1;
+}
+
+
+/**
+ * Get a copy of the value of a key.
+ *
+ * @param dest string that will hold the value
+ * @param db the database
+ * @param key the key
+ * @return 0 if the key was found, or -1 if it was not
+*/
+int
+cdb_get(string_t *dest, const cdb_t *db, char_t *key)
+{
+	strview_t v;
+
+	if (cdb_find(&v, db, key, strlen(key)) < 0)
+		return -1;
+	str_from_view(dest, v);
+}
@@ -0,0 +1,462 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Concurrent hash tables.
+ *
+ * Each bucket is a singly linked list of immutable entries. Readers
+ * walk the lists without locking, inside an epoch critical section.
+ * A writer locks the stripe that the key belongs to, and publishes a
+ * change by storing a single pointer: a new entry is linked in with
+ * its successor already set, and an entry that is replaced or deleted
+ * is unlinked and passed to epoch_retire(), so a reader that is still
+ * looking at it is not disturbed.
+ *
+ * The stripe of a key depends only on the low bits of its hash, and
+ * the table always has at least CHASH_STRIPES buckets, so a bucket
+ * belongs to the same stripe whatever the size of the table. To grow
+ * the table, a writer takes every stripe lock, copies the entries into
+ * a new array, and swaps the table pointer.
+*/
+
+#include "config.h"
+
+#include "nc_chash.h"
+#include "nc_epoch.h"
+#include "nc_exception.h"
+#include "nc_hash.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_string.h"
+#include "nc_thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------------ GLOBAL VARIABLES ------------------------- */
+
+/** The stripe lock that protects the entries with hash @a h */
+#define CHASH_STRIPE(h)		((h) & (CHASH_STRIPES - 1))
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Free a table and all of the entries in it.
+ *
+ * This is also used as an epoch_retire() callback.
+*/
+static void
+chash_table_free(void *ptr)
+  {
+	struct chash_table *t = ptr;
+	chash_node_t       *n, *next;
+	size_t              i;
+
+	if (t == NULL)
+		return;
+	for (i = 0; i < t->size; i++) {
+		for (n = t->bucket[i]; n != NULL; n = next) {
+			next = n->next;
+			free(n);
+		}
+	}
+	free(t);
+  }
+
+
+/**
+ * Allocate an empty table.
+ *
+ * @param dest the new table
+ * @param size the number of buckets; a power of two of at least CHASH_STRIPES
+*/
+static int
+chash_table_new(struct chash_table **dest, size_t size)
+{
+
+	if ((*dest = calloc(1, sizeof(**dest) + size * sizeof((*dest)->bucket[0]))) == NULL)
+		throw_errno("calloc(3)");
+	(*dest)->size = size;
+}
+
+
+/**
+ * Allocate an entry.
+ *
+ * @param dest the new entry
+ * @param hash the hash of the key
+ * @param key the key
+ * @param key_len the length of @a key
+ * @param value the value
+ * @param value_len the length of @a value
+*/
+static int
+chash_node_new(chash_node_t **dest, uint64_t hash, char_t *key, size_t key_len,
+		char_t *value, size_t value_len)
+{
+	chash_node_t *n;
+
+	if ((n = malloc(sizeof(*n) + key_len + value_len + 2)) == NULL)
+		throw_errno("malloc(3)");
+	n->next = NULL;
+	n->hash = hash;
+	n->key_len = key_len;
+	n->value_len = value_len;
+	memcpy(n->data, key, key_len);
+	n->data[key_len] = '\0';
+	memcpy(n->data + key_len + 1, value, value_len);
+	n->data[key_len + 1 + value_len] = '\0';
+	*dest = n;
+}
+
+
+/**
+ * Find the link that points to the entry for a key.
+ *
+ * The caller must hold the stripe lock of the key.
+ *
+ * @param dest the link to the entry, or the NULL link at the end of the
+ *        bucket if the key does not exist
+ * @param t the table
+ * @param hash the hash of the key
+ * @param key the key
+ * @param len the length of @a key
+ * @return 0 if the key exists, or -1 if it does not
+*/
+static int
+chash_find(chash_node_t ***dest, struct chash_table *t, uint64_t hash, char_t *key, size_t len)
+{
+	chash_node_t **link, *n;
+
+	link = &t->bucket[hash & (t->size - 1)];
+	for (; (n = *link) != NULL; link = &n->next) {
+		if (n->hash == hash && n->key_len == len && memcmp(n->data, key, len) == 0)
+			break;
+	}
+	*dest = link;
+	if (n == NULL)
+		return -1;
+}
+
+
+/**
+ * Publish a change to one entry.
+ *
+ * The caller must hold the stripe lock of the entry.
+ *
+ * @param map the table
+ * @param link the link that was found by chash_find()
+ * @param node the new entry, or NULL to delete the existing entry
+*/
+static int
+chash_commit(chash_t *map, chash_node_t **link, chash_node_t *node)
+{
+	chash_node_t *old = *link;
+
+	if (node != NULL) {
+		node->next = (old != NULL) ? old->next : NULL;
+		__atomic_store_n(link, node, __ATOMIC_RELEASE);
+		if (old == NULL)
+			(void) __atomic_add_fetch(&map->count, 1, __ATOMIC_RELAXED);
+	} else if (old != NULL) {
+		__atomic_store_n(link, old->next, __ATOMIC_RELEASE);
+		(void) __atomic_sub_fetch(&map->count, 1, __ATOMIC_RELAXED);
+	}
+	if (old != NULL)
+		epoch_retire(old, free);
+}
+
+
+/**
+ * Double the number of buckets if the table is more than fully loaded.
+ *
+ * The caller must not hold any stripe locks.
+ *
+ * @param map the table
+*/
+static int
+chash_grow(chash_t *map)
+{
+	struct chash_table *old, *t = NULL;
+	chash_node_t       *n, *copy;
+	size_t              i, j;
+
+	for (i = 0; i < CHASH_STRIPES; i++)
+		mutex_lock(map->lock[i]);
+
+	/* Another writer may have grown the table already */
+	old = map->table;
+	if (map->count <= old->size)
+		return 0;
+
+	/* Every error below must go through throw_silent() so the stripes are unlocked */
+	if (chash_table_new(&t, old->size * 2) < 0)
+		throw_silent();
+	for (i = 0; i < old->size; i++) {
+		for (n = old->bucket[i]; n != NULL; n = n->next) {
+			if (chash_node_new(&copy, n->hash, n->data, n->key_len, n->data + n->key_len + 1, n->value_len) < 0)
+				throw_silent();
+			j = n->hash & (t->size - 1);
+			copy->next = t->bucket[j];
+			t->bucket[j] = copy;
+		}
+	}
+	__atomic_store_n(&map->table, t, __ATOMIC_RELEASE);
+	t = NULL;
+	if (epoch_retire(old, chash_table_free) < 0)
+		throw_silent();
+
+catch:
+	chash_table_free(t);
+
+finally:
+	for (i = 0; i < CHASH_STRIPES; i++)
+		mutex_unlock(map->lock[i]);
+}
+
+
+/**
+ * Update the value of a key while holding its stripe lock.
+ *
+ * @param added if not NULL, set to true if the key was added
+ * @param map the table
+ * @param key the key
+ * @param func the function that computes the new value
+ * @param arg the argument to @a func
+*/
+static int
+chash_update(bool *added, chash_t *map, char_t *key, chash_compute_t func, void *arg)
+{
+	string_t      *value;
+	chash_node_t **link, *old, *node = NULL;
+	uint64_t       h;
+	size_t         len = strlen(key);
+	bool           exists;
+
+	hash_key(&h, key, len);
+
+	mutex_lock(map->lock[CHASH_STRIPE(h)]);
+
+	/* Every error below must go through throw_silent() so the stripe is unlocked */
+	exists = (chash_find(&link, map->table, h, key, len) == 0);
+	if ((old = *link) != NULL && str_ncpy(value, old->data + old->key_len + 1, old->value_len) < 0)
+		throw_silent();
+
+	if (func(value, &exists, arg) < 0)
+		throw_silent();
+
+	if (exists && chash_node_new(&node, h, key, len, value->value, value->len) < 0)
+		throw_silent();
+	if (chash_commit(map, link, node) < 0)
+		throw_silent();
+	mutex_unlock(map->lock[CHASH_STRIPE(h)]);
+
+	if (added != NULL)
+		*added = (old == NULL && node != NULL);
+
+	/* Keep the average bucket length at one entry or less */
+	if (map->count > __atomic_load_n(&map->table, __ATOMIC_ACQUIRE)->size)
+		(void) chash_grow(map);
+	return 0;
+
+catch:
+	mutex_unlock(map->lock[CHASH_STRIPE(h)]);
+}
+
+
+/* chash_update() callbacks */
+
+static int
+chash_store_value(string_t *value, bool *exists, void *arg)
+{
+
+	str_copy(value, (const string_t *) arg);
+	*exists = true;
+}
+
+
+static int
+chash_store_if_absent(string_t *value, bool *exists, void *arg)
+{
+
+	if (*exists)
+		return 0;
+	str_copy(value, (const string_t *) arg);
+	*exists = true;
+}
+
+
+static int
+chash_delete_value(string_t *value, bool *exists, void *arg)
+{
+
+	if (!*exists)
+		return -1;
+	*exists = false;
+}
+
+
+/**
+ * Create a new concurrent hash table.
+ *
+ * @param dest indirect pointer to a hash table
+*/
+int
+chash_new(chash_t **dest)
+{
+	chash_t *map = NULL;
+	size_t   i;
+
+	mem_calloc(map);
+	for (i = 0; i < CHASH_STRIPES; i++)
+		(void) mutex_init(&map->lock[i]);
+	if (chash_table_new(&map->table, CHASH_STRIPES) < 0)
+		throw_silent();
+	*dest = map;
+	map = NULL;
+
+finally:
+	(void) chash_destroy(&map);
+}
+
+
+/**
+ * Destroy a concurrent hash table.
+ *
+ * No other thread may be using the table.
+ *
+ * @param map_ref indirect pointer to a hash table; this will be set to NULL
+*/
+int
+chash_destroy(chash_t **map_ref)
+{
+	chash_t *map = *map_ref;
+	size_t   i;
+
+	if (map == NULL)
+		return 0;
+
+	chash_table_free(map->table);
+	for (i = 0; i < CHASH_STRIPES; i++)
+		(void) pthread_mutex_destroy(&map->lock[i]);
+	free(map);
+	*map_ref = NULL;
+}
+
+
+/**
+ * Get a copy of the value that is associated with a key.
+ *
+ * This never blocks, even while other threads are modifying the table.
+ *
+ * @param dest string that will hold the value
+ * @param map the table
+ * @param key the key
+ * @return 0 if the key exists, or -1 if it does not
+*/
+int
+chash_get(string_t *dest, chash_t *map, char_t *key)
+{
+	struct chash_table *t;
+	chash_node_t       *n;
+	uint64_t            h;
+	size_t              len = strlen(key);
+
+	hash_key(&h, key, len);
+
+	epoch_enter();
+	t = __atomic_load_n(&map->table, __ATOMIC_ACQUIRE);
+	n = __atomic_load_n(&t->bucket[h & (t->size - 1)], __ATOMIC_ACQUIRE);
+	for (; n != NULL; n = __atomic_load_n(&n->next, __ATOMIC_ACQUIRE)) {
+		if (n->hash == h && n->key_len == len && memcmp(n->data, key, len) == 0)
+			break;
+	}
+	if (n == NULL || str_ncpy(dest, n->data + n->key_len + 1, n->value_len) < 0)
+		throw_silent();
+
+finally:
+	epoch_exit();
+}
+
+
+/**
+ * Set the value of a key, replacing any previous value.
+ *
+ * @param map the table
+ * @param key the key
+ * @param value the value to be copied into the table
+*/
+int
+chash_set(chash_t *map, char_t *key, const string_t *value)
+{
+
+	chash_update(NULL, map, key, chash_store_value, (void *) value);
+}
+
+
+/**
+ * Add a key unless it already exists.
+ *
+ * @param added set to true if the key was added, or false if it already existed
+ * @param map the table
+ * @param key the key
+ * @param value the value to be copied into the table
+*/
+int
+chash_put_if_absent(bool *added, chash_t *map, char_t *key, const string_t *value)
+{
+
+	chash_update(added, map, key, chash_store_if_absent, (void *) value);
+}
+
+
+/**
+ * Atomically compute a new value for a key.
+ *
+ * @a func is called with the stripe lock of the key held, so it must
+ * be short and must not access the same table. Other keys in the same
+ * stripe are blocked until it returns, but readers are not.
+ *
+ * @param map the table
+ * @param key the key
+ * @param func the function that computes the new value
+ * @param arg the argument to @a func
+*/
+int
+chash_compute(chash_t *map, char_t *key, chash_compute_t func, void *arg)
+{
+
+	chash_update(NULL, map, key, func, arg);
+}
+
+
+/**
+ * Delete a key.
+ *
+ * @param map the table
+ * @param key the key
+ * @return 0 if the key was deleted, or -1 if it did not exist
+*/
+int
+chash_delete(chash_t *map, char_t *key)
+{
+
+	if (chash_update(NULL, map, key, chash_delete_value, NULL) < 0)
+		return -1;
+}
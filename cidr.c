@@ -0,0 +1,370 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Network prefix lookups.
+ *
+ * Every prefix is stored as a 128-bit IPv6 prefix, so one tree holds
+ * both address families. A node is only created where a prefix ends
+ * or where two prefixes diverge, and each node records its full prefix,
+ * so a lookup compares the key with a node and then follows the child
+ * that is selected by the first bit after the node's prefix.
+*/
+
+#include "config.h"
+
+#include "nc_cidr.h"
+#include "nc_exception.h"
+#include "nc_list.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_socket.h"
+#include "nc_string.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/** Get bit @a i of an address, counting from the most significant bit */
+#define CIDR_BIT(a, i)	(((a)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
+
+/**
+ * Clear the bits of an address that follow a prefix.
+*/
+static int
+cidr_mask(uint8_t *addr, unsigned int len)
+{
+	unsigned int i;
+
+	if (len >= 128)
+		return 0;
+	addr[len >> 3] &= (uint8_t) (0xff00 >> (len & 7));
+	for (i = (len >> 3) + 1; i < 16; i++)
+		addr[i] = 0;
+}
+
+
+/**
+ * Count the leading bits that two addresses have in common.
+ *
+ * @param dest the number of bits, which is at most @a max
+ * @param a the first address
+ * @param b the second address
+ * @param max the number of bits to compare
+*/
+static int
+cidr_common(unsigned int *dest, const uint8_t *a, const uint8_t *b, unsigned int max)
+{
+	unsigned int i, n = 0;
+	uint8_t      x;
+
+	for (i = 0; i < 16 && n < max; i++, n += 8) {
+		if ((x = a[i] ^ b[i]) != 0) {
+			n += (unsigned int) __builtin_clz(x) - 24;
+			break;
+		}
+	}
+	*dest = (n < max) ? n : max;
+}
+
+
+/**
+ * Parse a network prefix.
+ *
+ * IPv4 prefixes are converted to IPv4-mapped IPv6 prefixes.
+ *
+ * @param addr the 16-byte address, with the host bits cleared
+ * @param len the length of the prefix, in bits
+ * @param src an address, optionally followed by a slash and the prefix length
+*/
+static int
+cidr_parse(uint8_t *addr, unsigned int *len, char_t *src)
+{
+	char          buf[INET6_ADDRSTRLEN];
+	const char   *slash;
+	char         *end;
+	unsigned long n;
+	unsigned int  max;
+	size_t        alen;
+
+	slash = strchr(src, '/');
+	alen = (slash != NULL) ? (size_t) (slash - src) : strlen(src);
+	if (alen >= sizeof(buf))
+		throwf("invalid network prefix: `%s'", src);
+	memcpy(buf, src, alen);
+	buf[alen] = '\0';
+
+	memset(addr, 0, 16);
+	if (inet_pton(AF_INET, buf, addr + 12) == 1) {
+		addr[10] = addr[11] = 0xff;
+		max = 32;
+	} else if (inet_pton(AF_INET6, buf, addr) == 1) {
+		max = 128;
+	} else {
+		throwf("invalid network prefix: `%s'", src);
+	}
+
+	n = max;
+	if (slash != NULL) {
+		n = strtoul(slash + 1, &end, 10);
+		if (slash[1] == '\0' || *end != '\0' || n > max)
+			throwf("invalid prefix length: `%s'", src);
+	}
+	*len = (unsigned int) n + (128 - max);
+	(void) cidr_mask(addr, *len);
+}
+
+
+/**
+ * Convert a socket address to the form that is stored in the tree.
+ *
+ * @return -1 if the address is not an IPv4 or IPv6 address
+*/
+static int
+cidr_key(uint8_t *dest, const socket_addr_t *addr)
+{
+
+	switch (addr->a.sa_family) {
+	case AF_INET:
+		memset(dest, 0, 10);
+		dest[10] = dest[11] = 0xff;
+		memcpy(dest + 12, &addr->in.sin_addr, 4);
+		break;
+
+	case AF_INET6:
+		memcpy(dest, &addr->in6.sin6_addr, 16);
+		break;
+
+	default:
+		throw_silent();
+	}
+}
+
+
+/**
+ * Create a new node.
+*/
+static int
+cidr_node_new(cidr_node_t **dest, const uint8_t *addr, unsigned int len)
+{
+
+	mem_calloc(*dest);
+	memcpy((*dest)->addr, addr, 16);
+	(void) cidr_mask((*dest)->addr, len);
+	(*dest)->len = (uint8_t) len;
+}
+
+
+/**
+ * Destroy a node and all of its descendants.
+*/
+static int
+cidr_node_destroy(cidr_node_t *n)
+{
+
+	if (n == NULL)
+		return 0;
+	(void) cidr_node_destroy(n->child[0]);
+	(void) cidr_node_destroy(n->child[1]);
+	free(n);
+}
+
+
+/**
+ * Add a prefix to the tree, or change the value of an existing prefix.
+*/
+static int
+cidr_insert(cidr_t *c, const uint8_t *addr, unsigned int len, int value)
+{
+	cidr_node_t **link = &c->root, *n, *branch = NULL, *leaf = NULL;
+	unsigned int  common;
+
+	while ((n = *link) != NULL) {
+		cidr_common(&common, n->addr, addr, (n->len < len) ? n->len : len);
+
+		/* Descend into a node whose prefix contains the new prefix */
+		if (common == n->len) {
+			if (n->len == len) {
+				if (!n->terminal)
+					c->count++;
+				n->terminal = true;
+				n->value = value;
+				return 0;
+			}
+			link = &n->child[CIDR_BIT(addr, n->len)];
+			continue;
+		}
+
+		/* Otherwise, insert a node where the two prefixes diverge */
+		cidr_node_new(&branch, addr, common);
+		branch->child[CIDR_BIT(n->addr, common)] = n;
+		*link = branch;
+		if (common == len) {
+			branch->terminal = true;
+			branch->value = value;
+			c->count++;
+			return 0;
+		}
+		link = &branch->child[CIDR_BIT(addr, common)];
+		break;
+	}
+
+	cidr_node_new(&leaf, addr, len);
+	leaf->terminal = true;
+	leaf->value = value;
+	*link = leaf;
+	c->count++;
+}
+
+
+/**
+ * Find the longest prefix that contains an address.
+ *
+ * @return -1 if no prefix contains the address
+*/
+static int
+cidr_find(const cidr_node_t **dest, const cidr_t *c, const uint8_t *key)
+{
+	const cidr_node_t *n, *best = NULL;
+	unsigned int       common;
+
+	for (n = c->root; n != NULL; n = n->child[CIDR_BIT(key, n->len)]) {
+		(void) cidr_common(&common, n->addr, key, n->len);
+		if (common < n->len)
+			break;
+		if (n->terminal)
+			best = n;
+		if (n->len == 128)
+			break;
+	}
+	if (best == NULL)
+		throw_silent();
+	*dest = best;
+}
+
+
+/**
+ * Create a new, empty set of network prefixes.
+ *
+ * @param dest a new cidr_t object
+*/
+int
+cidr_new(cidr_t **dest)
+{
+
+	mem_calloc(*dest);
+}
+
+
+/**
+ * Destroy a set of network prefixes.
+ *
+ * @param c the object to be destroyed; this will be set to NULL.
+*/
+int
+cidr_destroy(cidr_t **c)
+{
+
+	if (*c == NULL)
+		return 0;
+
+	(void) cidr_node_destroy((*c)->root);
+	free(*c);
+	*c = NULL;
+}
+
+
+/**
+ * Add a network prefix.
+ *
+ * Adding a prefix that already exists replaces its value.
+ *
+ * @param c the set of prefixes
+ * @param prefix an IPv4 or IPv6 address, optionally followed by a
+ *               slash and the prefix length, such as "10.0.0.0/8"
+ * @param value the value that cidr_lookup() will return for addresses
+ *              that match this prefix
+*/
+int
+cidr_add(cidr_t *c, char_t *prefix, int value)
+{
+	uint8_t      addr[16];
+	unsigned int len = 0;
+
+	cidr_parse(addr, &len, prefix);
+	cidr_insert(c, addr, len, value);
+}
+
+
+/**
+ * Add every network prefix in a list.
+ *
+ * @param c the set of prefixes
+ * @param src a list of prefixes in the format accepted by cidr_add()
+ * @param value the value of each prefix
+*/
+int
+cidr_add_list(cidr_t *c, const list_t *src, int value)
+{
+	list_entry_t *cur;
+
+	for (cur = src->head; cur != NULL; cur = cur->next)
+		cidr_add(c, cur->value->value, value);
+}
+
+
+/**
+ * Find the longest prefix that matches an address.
+ *
+ * @param value the value of the matching prefix
+ * @param c the set of prefixes
+ * @param addr an IPv4 or IPv6 socket address
+ * @return -1 if no prefix matches, or the address is not an IP address
+*/
+int
+cidr_lookup(int *value, const cidr_t *c, const socket_addr_t *addr)
+{
+	const cidr_node_t *n;
+	uint8_t            key[16];
+
+	if (cidr_key(key, addr) < 0 || cidr_find(&n, c, key) < 0)
+		throw_silent();
+	*value = n->value;
+}
+
+
+/**
+ * Test if any prefix matches an address.
+ *
+ * @param result true if a prefix matches @a addr, false otherwise
+ * @param c the set of prefixes
+ * @param addr an IPv4 or IPv6 socket address
+*/
+int
+cidr_match(bool *result, const cidr_t *c, const socket_addr_t *addr)
+{
+	int value;
+
+	*result = (cidr_lookup(&value, c, addr) == 0);
+}
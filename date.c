@@ -0,0 +1,655 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * RFC 2822 and RFC 3339 date parsing and formatting.
+ *
+ * The conversions between UNIX time and calendar dates are done with
+ * integer arithmetic, so they do not need strptime(3), mktime(3) or the
+ * C library's time zone lock. The only call to localtime_r(3) is made
+ * when the local time zone offset is needed, and the result is cached
+ * per thread for the rest of that second, along with the most recently
+ * formatted date.
+*/
+
+#include "config.h"
+
+#include "nc_date.h"
+#include "nc_exception.h"
+#include "nc_log.h"
+#include "nc_string.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+/* ----------------------------- GLOBAL CONSTANTS -------------------------- */
+
+/* Date format flags */
+
+const int DATE_RFC2822		= 0x0001;
+const int DATE_RFC3339		= 0x0002;
+const int DATE_NO_WEEKDAY	= 0x0010;
+
+static const char *MONTH_NAME[12] = {
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static const char *WEEKDAY_NAME[7] = {
+	"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+
+static const int MONTH_DAYS[12] = {
+	31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+};
+
+/** Named time zones from RFC 2822, section 4.3 */
+static const struct {
+	const char *name;
+	int         offset;
+} ZONE_NAME[] = {
+	{ "UT",  0 },
+	{ "GMT", 0 },
+	{ "Z",   0 },
+	{ "EST", -5 * 3600 },
+	{ "EDT", -4 * 3600 },
+	{ "CST", -6 * 3600 },
+	{ "CDT", -5 * 3600 },
+	{ "MST", -7 * 3600 },
+	{ "MDT", -6 * 3600 },
+	{ "PST", -8 * 3600 },
+	{ "PDT", -7 * 3600 },
+	{ NULL,  0 }
+};
+
+/* ------------------------------ GLOBAL VARIABLES ------------------------- */
+
+#define THREAD_LOCAL	__thread
+
+/** Per-thread cache of the local time, which normally changes once per second */
+static THREAD_LOCAL struct {
+
+	/** The result of the last call to localtime_r(3) */
+	bool      tm_valid;
+	time_t    tm_sec;
+	struct tm tm;
+	int       offset;
+
+	/** The last result of date_format_local() */
+	bool      text_valid;
+	time_t    text_sec;
+	int       text_flags;
+	char      text[DATE_MAX];
+	size_t    text_len;
+
+	/** The last result of date_strftime() */
+	bool      ftime_valid;
+	time_t    ftime_sec;
+	char      ftime_format[FORMAT_MAX];
+	char      ftime[230];
+	size_t    ftime_len;
+
+} DATE_CACHE;
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Convert a calendar date into the number of days since 1970-01-01.
+ *
+ * This is valid for any date in the proleptic Gregorian calendar.
+*/
+static int
+date_days_from_civil(int64_t *dest, int64_t y, int m, int d)
+{
+	int64_t era, yoe, doy, doe;
+
+	y -= (m <= 2);
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	*dest = era * 146097 + doe - 719468;
+}
+
+
+/**
+ * Convert the number of days since 1970-01-01 into a calendar date.
+*/
+static int
+date_civil_from_days(int64_t *y, int *m, int *d, int64_t z)
+{
+	int64_t era, doe, yoe, doy, mp;
+
+	z += 719468;
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = z - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	*d = (int) (doy - (153 * mp + 2) / 5 + 1);
+	*m = (int) (mp < 10 ? mp + 3 : mp - 9);
+	*y = yoe + era * 400 + (*m <= 2);
+}
+
+
+/**
+ * Combine the fields of a date into UNIX time.
+ *
+ * @param dest the result
+ * @param offset the time zone offset, in seconds east of UTC
+*/
+static int
+date_make_time(time_t *dest, int year, int mon, int mday, int hour, int min, int sec, int offset)
+{
+	int64_t days;
+
+	/* Validate the fields */
+	if (mon < 1 || mon > 12 || mday < 1 || mday > MONTH_DAYS[mon - 1])
+		throw_silent();
+	if (mon == 2 && mday == 29 && !(year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)))
+		throw_silent();
+	if (hour > 23 || min > 59 || sec > 60)
+		throw_silent();
+
+	date_days_from_civil(&days, year, mon, mday);
+	*dest = (time_t) (days * 86400 + hour * 3600 + min * 60 + sec - offset);
+}
+
+
+/**
+ * Skip whitespace and RFC 2822 comments.
+*/
+static int
+date_skip_space(const char **cp, const char *end)
+{
+	int depth = 0;
+
+	for (; *cp < end; (*cp)++) {
+		if (**cp == '(')
+			depth++;
+		else if (**cp == ')' && depth > 0)
+			depth--;
+		else if (depth == 0 && !isspace((unsigned char) **cp))
+			break;
+	}
+}
+
+
+/**
+ * Parse an unsigned decimal number of between @a min and @a max digits.
+ *
+ * @param dest the result
+ * @param ndigits the number of digits that were parsed (optional)
+*/
+static int
+date_parse_digits(int *dest, int *ndigits, const char **cp, const char *end, int min, int max)
+{
+	int n, v = 0;
+
+	for (n = 0; *cp < end && n < max && isdigit((unsigned char) **cp); n++, (*cp)++)
+		v = v * 10 + (**cp - '0');
+	if (n < min)
+		throw_silent();
+
+	*dest = v;
+	if (ndigits != NULL)
+		*ndigits = n;
+}
+
+
+/**
+ * Parse a three-letter month name.
+ *
+ * @param dest the month number, from 1 to 12
+*/
+static int
+date_parse_month(int *dest, const char **cp, const char *end)
+{
+	int i;
+
+	if (end - *cp < 3)
+		throw_silent();
+	for (i = 0; i < 12; i++) {
+		if (strncasecmp(*cp, MONTH_NAME[i], 3) == 0) {
+			*dest = i + 1;
+			*cp += 3;
+			return 0;
+		}
+	}
+	throw_silent();
+}
+
+
+/**
+ * Parse a numeric "+hhmm" or "+hh:mm" time zone offset.
+ *
+ * @param dest the offset, in seconds east of UTC
+ * @param colon if true, the hours and minutes are separated by a colon
+*/
+static int
+date_parse_offset(int *dest, const char **cp, const char *end, bool colon)
+{
+	int sign, hours, mins;
+
+	if (*cp >= end || (**cp != '+' && **cp != '-'))
+		throw_silent();
+	sign = (**cp == '-') ? -1 : 1;
+	(*cp)++;
+
+	if (date_parse_digits(&hours, NULL, cp, end, 2, 2) < 0)
+		throw_silent();
+	if (colon) {
+		if (*cp >= end || **cp != ':')
+			throw_silent();
+		(*cp)++;
+	}
+	if (date_parse_digits(&mins, NULL, cp, end, 2, 2) < 0 || mins > 59)
+		throw_silent();
+
+	*dest = sign * (hours * 3600 + mins * 60);
+}
+
+
+/**
+ * Parse an RFC 2822 time zone.
+ *
+ * Military and unknown alphabetic zones are treated as "-0000",
+ * as recommended by RFC 2822, section 4.3.
+ *
+ * @param dest the offset, in seconds east of UTC
+*/
+static int
+date_parse_zone(int *dest, const char **cp, const char *end)
+{
+	const char *start;
+	size_t      n, i;
+
+	if (*cp < end && (**cp == '+' || **cp == '-')) {
+		if (date_parse_offset(dest, cp, end, false) < 0)
+			throw_silent();
+		return 0;
+	}
+
+	for (start = *cp; *cp < end && isalpha((unsigned char) **cp); (*cp)++)
+		;
+	n = (size_t) (*cp - start);
+	if (n == 0 || n > 5)
+		throw_silent();
+
+	*dest = 0;
+	for (i = 0; ZONE_NAME[i].name != NULL; i++) {
+		if (strlen(ZONE_NAME[i].name) == n && strncasecmp(start, ZONE_NAME[i].name, n) == 0) {
+			*dest = ZONE_NAME[i].offset;
+			break;
+		}
+	}
+}
+
+
+/**
+ * Parse an RFC 2822 date.
+ *
+ * For example: `Sat, 12 Aug 2006 22:49:40 -0400'. The day of the week
+ * and the seconds are optional, and the obsolete two-digit years and
+ * named time zones are accepted.
+ *
+ * @param dest the date, in UNIX time
+ * @param offset the time zone offset of the date, in seconds east of UTC (optional)
+ * @param src the text to be parsed
+ * @param len the length of @a src
+*/
+int
+date_parse_rfc2822(time_t *dest, int *offset, const char *src, size_t len)
+{
+	const char *cp = src, *end = src + len;
+	int         mday, mon, year, hour, min, sec = 0, zone, ndigits;
+
+	/* Optional day of the week */
+	(void) date_skip_space(&cp, end);
+	if (cp < end && isalpha((unsigned char) *cp)) {
+		while (cp < end && isalpha((unsigned char) *cp))
+			cp++;
+		(void) date_skip_space(&cp, end);
+		if (cp >= end || *cp != ',')
+			goto invalid;
+		cp++;
+		(void) date_skip_space(&cp, end);
+	}
+
+	/* Date */
+	if (date_parse_digits(&mday, NULL, &cp, end, 1, 2) < 0)
+		goto invalid;
+	(void) date_skip_space(&cp, end);
+	if (date_parse_month(&mon, &cp, end) < 0)
+		goto invalid;
+	(void) date_skip_space(&cp, end);
+	if (date_parse_digits(&year, &ndigits, &cp, end, 2, 4) < 0)
+		goto invalid;
+	if (ndigits == 2)
+		year += (year < 50) ? 2000 : 1900;
+	else if (ndigits == 3)
+		year += 1900;
+	(void) date_skip_space(&cp, end);
+
+	/* Time of day */
+	if (date_parse_digits(&hour, NULL, &cp, end, 1, 2) < 0)
+		goto invalid;
+	if (cp >= end || *cp++ != ':')
+		goto invalid;
+	if (date_parse_digits(&min, NULL, &cp, end, 2, 2) < 0)
+		goto invalid;
+	if (cp < end && *cp == ':') {
+		cp++;
+		if (date_parse_digits(&sec, NULL, &cp, end, 2, 2) < 0)
+			goto invalid;
+	}
+	(void) date_skip_space(&cp, end);
+
+	/* Time zone */
+	if (date_parse_zone(&zone, &cp, end) < 0)
+		goto invalid;
+	(void) date_skip_space(&cp, end);
+	if (cp != end)
+		goto invalid;
+
+	if (date_make_time(dest, year, mon, mday, hour, min, sec, zone) < 0)
+		goto invalid;
+	if (offset != NULL)
+		*offset = zone;
+	return 0;
+
+invalid:
+	throwf("invalid RFC 2822 date: `%.*s'", (int) len, src);
+}
+
+
+/**
+ * Parse an RFC 3339 date.
+ *
+ * For example: `2006-08-12T22:49:40.52-04:00'. Fractional seconds
+ * are ignored.
+ *
+ * @param dest the date, in UNIX time
+ * @param offset the time zone offset of the date, in seconds east of UTC (optional)
+ * @param src the text to be parsed
+ * @param len the length of @a src
+*/
+int
+date_parse_rfc3339(time_t *dest, int *offset, const char *src, size_t len)
+{
+	const char *cp = src, *end = src + len;
+	int         mday, mon, year, hour, min, sec, zone;
+
+	if (date_parse_digits(&year, NULL, &cp, end, 4, 4) < 0 || cp >= end || *cp++ != '-')
+		goto invalid;
+	if (date_parse_digits(&mon, NULL, &cp, end, 2, 2) < 0 || cp >= end || *cp++ != '-')
+		goto invalid;
+	if (date_parse_digits(&mday, NULL, &cp, end, 2, 2) < 0)
+		goto invalid;
+	if (cp >= end || (*cp != 'T' && *cp != 't' && *cp != ' '))
+		goto invalid;
+	cp++;
+	if (date_parse_digits(&hour, NULL, &cp, end, 2, 2) < 0 || cp >= end || *cp++ != ':')
+		goto invalid;
+	if (date_parse_digits(&min, NULL, &cp, end, 2, 2) < 0 || cp >= end || *cp++ != ':')
+		goto invalid;
+	if (date_parse_digits(&sec, NULL, &cp, end, 2, 2) < 0)
+		goto invalid;
+
+	/* Ignore fractional seconds */
+	if (cp < end && *cp == '.') {
+		for (cp++; cp < end && isdigit((unsigned char) *cp); cp++)
+			;
+	}
+
+	/* Time zone */
+	if (cp < end && (*cp == 'Z' || *cp == 'z')) {
+		zone = 0;
+		cp++;
+	} else if (date_parse_offset(&zone, &cp, end, true) < 0) {
+		goto invalid;
+	}
+	if (cp != end)
+		goto invalid;
+
+	if (date_make_time(dest, year, mon, mday, hour, min, sec, zone) < 0)
+		goto invalid;
+	if (offset != NULL)
+		*offset = zone;
+	return 0;
+
+invalid:
+	throwf("invalid RFC 3339 date: `%.*s'", (int) len, src);
+}
+
+
+/**
+ * Parse a date in either RFC 2822 or RFC 3339 format.
+ *
+ * @see date_parse_rfc2822()
+ * @see date_parse_rfc3339()
+*/
+int
+date_parse(time_t *dest, int *offset, const char *src, size_t len)
+{
+
+	if (len > 4 && isdigit((unsigned char) src[0]) && src[4] == '-') {
+		date_parse_rfc3339(dest, offset, src, len);
+	} else {
+		date_parse_rfc2822(dest, offset, src, len);
+	}
+}
+
+
+/**
+ * Write a zero-padded decimal number.
+*/
+static int
+date_put_digits(char **p, int64_t n, int width)
+{
+	char *cp;
+
+	for (cp = *p + width; cp > *p; n /= 10)
+		*--cp = (char) ('0' + n % 10);
+	*p += width;
+}
+
+
+/**
+ * Convert from UNIX time to a formatted date.
+ *
+ * The RFC 2822 format is `Sat, 12 Aug 2006 22:49:40 -0400', or
+ * `12 Aug 2006 22:49:40 -0400' if DATE_NO_WEEKDAY is set.
+ * The RFC 3339 format is `2006-08-12T22:49:40-04:00'.
+ *
+ * @param dest buffer to store the result
+ * @param t time, in seconds, since the Epoch (1/1/1970)
+ * @param offset time zone offset, in seconds east of UTC
+ * @param flags DATE_RFC2822 or DATE_RFC3339, optionally with DATE_NO_WEEKDAY
+*/
+int
+date_format(string_t *dest, time_t t, int offset, int flags)
+{
+	char     buf[DATE_MAX], *p = buf;
+	int64_t  local, days, secs, year;
+	int      mon, mday, zone;
+
+	local = (int64_t) t + offset;
+	days = local / 86400;
+	secs = local % 86400;
+	if (secs < 0) {
+		secs += 86400;
+		days--;
+	}
+	date_civil_from_days(&year, &mon, &mday, days);
+	if (year < 0 || year > 9999)
+		throw("year out of range");
+	zone = (offset < 0 ? -offset : offset) / 60;
+
+	if (flags & DATE_RFC3339) {
+		date_put_digits(&p, year, 4);
+		*p++ = '-';
+		date_put_digits(&p, mon, 2);
+		*p++ = '-';
+		date_put_digits(&p, mday, 2);
+		*p++ = 'T';
+	} else {
+		if (!(flags & DATE_NO_WEEKDAY)) {
+			memcpy(p, WEEKDAY_NAME[(((days % 7) + 7) % 7 + 4) % 7], 3);
+			p += 3;
+			*p++ = ',';
+			*p++ = ' ';
+		}
+		date_put_digits(&p, mday, 2);
+		*p++ = ' ';
+		memcpy(p, MONTH_NAME[mon - 1], 3);
+		p += 3;
+		*p++ = ' ';
+		date_put_digits(&p, year, 4);
+		*p++ = ' ';
+	}
+
+	date_put_digits(&p, secs / 3600, 2);
+	*p++ = ':';
+	date_put_digits(&p, secs / 60 % 60, 2);
+	*p++ = ':';
+	date_put_digits(&p, secs % 60, 2);
+
+	if ((flags & DATE_RFC3339) && offset == 0) {
+		*p++ = 'Z';
+	} else {
+		if (!(flags & DATE_RFC3339))
+			*p++ = ' ';
+		*p++ = (offset < 0) ? '-' : '+';
+		date_put_digits(&p, zone / 60, 2);
+		if (flags & DATE_RFC3339)
+			*p++ = ':';
+		date_put_digits(&p, zone % 60, 2);
+	}
+
+	str_ncpy(dest, buf, (size_t) (p - buf));
+}
+
+
+/**
+ * Convert from UNIX time to local time.
+ *
+ * This calls localtime_r(3) at most once per second in each thread.
+ *
+ * @param dest the broken-down local time (optional)
+ * @param offset the local time zone offset, in seconds east of UTC (optional)
+ * @param t time, in seconds, since the Epoch (1/1/1970)
+*/
+int
+date_localtime(struct tm *dest, int *offset, time_t t)
+{
+	int64_t days;
+
+	if (!DATE_CACHE.tm_valid || DATE_CACHE.tm_sec != t) {
+		if (localtime_r(&t, &DATE_CACHE.tm) == NULL)
+			throw_errno("localtime_r(3)");
+
+		/* Compute the offset from the difference between local time and UTC */
+		date_days_from_civil(&days, DATE_CACHE.tm.tm_year + 1900,
+				DATE_CACHE.tm.tm_mon + 1, DATE_CACHE.tm.tm_mday);
+		DATE_CACHE.offset = (int) (days * 86400 + DATE_CACHE.tm.tm_hour * 3600 +
+				DATE_CACHE.tm.tm_min * 60 + DATE_CACHE.tm.tm_sec - (int64_t) t);
+		DATE_CACHE.tm_sec = t;
+		DATE_CACHE.tm_valid = true;
+	}
+
+	if (dest != NULL)
+		*dest = DATE_CACHE.tm;
+	if (offset != NULL)
+		*offset = DATE_CACHE.offset;
+}
+
+
+/**
+ * Convert from UNIX time to a formatted date in the local time zone.
+ *
+ * The most recent result is cached per thread, so formatting the
+ * current time many times a second costs no more than a string copy.
+ *
+ * @param dest buffer to store the result
+ * @param t time, in seconds, since the Epoch (1/1/1970)
+ * @param flags the same as date_format()
+*/
+int
+date_format_local(string_t *dest, time_t t, int flags)
+{
+	int offset;
+
+	if (DATE_CACHE.text_valid && DATE_CACHE.text_sec == t && DATE_CACHE.text_flags == flags) {
+		str_ncpy(dest, DATE_CACHE.text, DATE_CACHE.text_len);
+		return 0;
+	}
+
+	date_localtime(NULL, &offset, t);
+	date_format(dest, t, offset, flags);
+
+	memcpy(DATE_CACHE.text, dest->value, dest->len);
+	DATE_CACHE.text_len = dest->len;
+	DATE_CACHE.text_sec = t;
+	DATE_CACHE.text_flags = flags;
+	DATE_CACHE.text_valid = true;
+}
+
+
+/**
+ * Convert from UNIX time to a local time string using strftime(3).
+ *
+ * Like date_format_local(), the most recent result is cached per thread.
+ *
+ * @param dest buffer to store the result
+ * @param t time, in seconds, since the Epoch (1/1/1970)
+ * @param format format string to pass to strftime(3)
+ * @see strftime(3)
+*/
+int
+date_strftime(string_t *dest, time_t t, const char *format)
+{
+	struct tm tm;
+	size_t    len;
+
+	if (DATE_CACHE.ftime_valid && DATE_CACHE.ftime_sec == t &&
+			strcmp(DATE_CACHE.ftime_format, format) == 0) {
+		str_ncpy(dest, DATE_CACHE.ftime, DATE_CACHE.ftime_len);
+		return 0;
+	}
+
+	date_localtime(&tm, NULL, t);
+	if ((len = strftime(DATE_CACHE.ftime, sizeof(DATE_CACHE.ftime), format, &tm)) == 0) {
+		DATE_CACHE.ftime_valid = false;
+		throw("date format error");
+	}
+	str_ncpy(dest, DATE_CACHE.ftime, len);
+
+	/* Only cache the result if the format string fits in the cache */
+	DATE_CACHE.ftime_valid = false;
+	if (strlen(format) < sizeof(DATE_CACHE.ftime_format)) {
+		strncpy(DATE_CACHE.ftime_format, format, sizeof(DATE_CACHE.ftime_format));
+		DATE_CACHE.ftime_len = len;
+		DATE_CACHE.ftime_sec = t;
+		DATE_CACHE.ftime_valid = true;
+	}
+}
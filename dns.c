@@ -35,6 +35,7 @@
 //#include "nc_options.h"
 #include "nc_socket.h"
 #include "nc_string.h"
+#include "nc_strview.h"
 #include "nc_thread.h"
 
 #include "nc_dns.h"
@@ -264,32 +265,32 @@ dns_log_error(const char *domain, const char *message)
 int
 dns_get_nameservers(list_t *dest)
 {
-	list_entry_t *cur = NULL;
-	string_t *line  = NULL;
 	string_t *buf, *path, *ns;
-	list_t   *lines;
-	bool      match;
+	strview_t rest, line, value;
 
 	list_truncate(dest);
 	
 	str_cpy(path, "/etc/resolv.conf");
 	file_read(buf, path);
-	str_split(lines, buf, '\n');
 
 	/* Examine each line */
-	for (cur = lines->head; cur; cur = cur->next) {
-		line = cur->value;
+	rest = strview_from_str(buf);
+	while (strview_tok(&line, &rest, '\n')) {
 
 		/* Skip lines that don't start with 'nameserver' */
-		str_match_regex(&match, line, "^nameserver");
-		if (!match)
+		if (!strview_starts_with(line, STRVIEW("nameserver")))
+			continue;
+
+		/* The keyword must be followed by whitespace */
+		value = strview_sub(line, sizeof("nameserver") - 1, line.len);
+		if (value.len == 0 || !isspace((unsigned char) value.ptr[0]))
 			continue;
 
 		/* Parse the nameserver value and add it to the list */
-		str_str_regex(line, "nameserver"
-					"[[:space:]]+"
-					"([A-Za-z0-9._-]+)"
-					"[[:space:]]*$", ns, NULL);
+		value = strview_trim(value);
+		if (value.len == 0)
+			throw("missing nameserver address");
+		str_from_view(ns, value);
 		list_push(dest, ns);
 	}
 }
@@ -431,16 +432,20 @@ dns_query_blocklist(bool *result, list_t *dnsbl, const socket_t *sock)
 	string_t      *domain   = NULL;
 	struct hostent *answer  = NULL;
 	string_t      *addr, *rev_addr, *query;
-	list_t        *quad;
+	strview_t      quad[4];
+	size_t         i, n;
 	int             rc;  
 
 	*result = false;
 
 	/* Generate the forward and reverse address strings */
 	str_from_inet(addr, sock->remote.in.sin_addr);
-	str_split(quad, addr, '.');
-	list_reverse(quad);
-	str_join(rev_addr, quad, '.');
+	str_split_views(quad, 4, &n, addr, '.');
+	for (i = n; i > 0; i--) {
+		str_append_bytes(rev_addr, quad[i - 1].ptr, quad[i - 1].len);
+		if (i > 1)
+			str_putc(rev_addr, '.');
+	}
 	log_debug2("addr=`%s' rev_addr=`%s'", addr->value, rev_addr->value);
 
 	/* For each DNSBL domain .. */
@@ -0,0 +1,367 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Epoch-based memory reclamation.
+ *
+ * There is a global epoch counter, and every thread that has entered
+ * a critical section has a record that announces the epoch it observed.
+ * The global epoch can only advance when every active thread has
+ * observed the current one. An object that was retired in epoch E is
+ * unreachable by the time the global epoch reaches E + 2, because every
+ * reader that could have seen it has left its critical section.
+ *
+ * Retired objects are kept in a per-thread list, so retiring does not
+ * take a lock. When a thread exits, its list is handed over to the
+ * other threads. Thread records are never freed, but they are reused by
+ * new threads.
+*/
+
+#include "config.h"
+
+#include "nc_epoch.h"
+#include "nc_exception.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_thread.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* ------------------------------ GLOBAL VARIABLES ------------------------- */
+
+#define THREAD_LOCAL	__thread
+
+/** The number of retired objects that a thread holds before trying to free them */
+#define EPOCH_LIMBO_MAX		64
+
+/** An object that is waiting to be freed */
+struct epoch_garbage {
+	struct epoch_garbage *next;
+	void                 *ptr;
+	callback_t            func;
+	uint64_t              epoch;
+};
+
+/** The state of one thread */
+struct epoch_record {
+
+	/** The next record in EPOCH_RECORDS */
+	struct epoch_record  *next;
+
+	/** The observed epoch shifted left by one, plus one; or zero if idle */
+	uint64_t              state;
+
+	/** The nesting level of critical sections */
+	unsigned int          depth;
+
+	/** True if the record belongs to a running thread */
+	bool                  in_use;
+
+	/** Objects retired by this thread, newest first */
+	struct epoch_garbage *limbo;
+	size_t                limbo_count;
+};
+
+/** The global epoch */
+static uint64_t EPOCH = 1;
+
+/** All thread records; new records are added at the head */
+static struct epoch_record *EPOCH_RECORDS;
+
+/** Objects that were retired by threads that have exited */
+static struct epoch_garbage *EPOCH_ORPHANS;
+
+/** Protects the registration of records and EPOCH_ORPHANS */
+static mutex_t EPOCH_MUTEX = MUTEX_INITIALIZER;
+
+static THREAD_LOCAL struct epoch_record *EPOCH_SELF;
+
+static pthread_key_t  EPOCH_KEY;
+static pthread_once_t EPOCH_ONCE = PTHREAD_ONCE_INIT;
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Free every object in a list of garbage.
+*/
+static void
+epoch_free_list(struct epoch_garbage *g)
+  {
+	struct epoch_garbage *next;
+
+	for (; g != NULL; g = next) {
+		next = g->next;
+		g->func(g->ptr);
+		free(g);
+	}
+  }
+
+
+/**
+ * Hand the retired objects of an exiting thread to the other threads.
+*/
+static void
+epoch_destructor(void *arg)
+  {
+	struct epoch_record  *rec = arg;
+	struct epoch_garbage *g;
+
+	__atomic_store_n(&rec->state, 0, __ATOMIC_RELEASE);
+	rec->depth = 0;
+
+	mutex_lock(EPOCH_MUTEX);
+	if ((g = rec->limbo) != NULL) {
+		while (g->next != NULL)
+			g = g->next;
+		g->next = EPOCH_ORPHANS;
+		EPOCH_ORPHANS = rec->limbo;
+	}
+	rec->limbo = NULL;
+	rec->limbo_count = 0;
+	rec->in_use = false;
+	mutex_unlock(EPOCH_MUTEX);
+  }
+
+
+static void
+epoch_key_create(void)
+  {
+	(void) pthread_key_create(&EPOCH_KEY, epoch_destructor);
+  }
+
+
+/**
+ * Get the record of the current thread, creating it if needed.
+ *
+ * @param dest the record
+*/
+static int
+epoch_self(struct epoch_record **dest)
+{
+	struct epoch_record *rec;
+
+	if ((*dest = EPOCH_SELF) != NULL)
+		return 0;
+
+	(void) pthread_once(&EPOCH_ONCE, epoch_key_create);
+
+	/* Reuse the record of a thread that has exited */
+	mutex_lock(EPOCH_MUTEX);
+	for (rec = EPOCH_RECORDS; rec != NULL; rec = rec->next) {
+		if (!rec->in_use)
+			break;
+	}
+	if (rec == NULL) {
+		if ((rec = calloc(1, sizeof(*rec))) == NULL) {
+			mutex_unlock(EPOCH_MUTEX);
+			throw_errno("calloc(3)");
+		}
+		rec->next = EPOCH_RECORDS;
+		__atomic_store_n(&EPOCH_RECORDS, rec, __ATOMIC_RELEASE);
+	}
+	rec->in_use = true;
+	mutex_unlock(EPOCH_MUTEX);
+
+	(void) pthread_setspecific(EPOCH_KEY, rec);
+	EPOCH_SELF = *dest = rec;
+}
+
+
+/**
+ * Advance the global epoch if every active thread has observed it.
+*/
+static int
+epoch_advance(void)
+{
+	struct epoch_record *rec;
+	uint64_t             epoch, state;
+
+	epoch = __atomic_load_n(&EPOCH, __ATOMIC_SEQ_CST);
+	rec = __atomic_load_n(&EPOCH_RECORDS, __ATOMIC_ACQUIRE);
+	for (; rec != NULL; rec = rec->next) {
+		state = __atomic_load_n(&rec->state, __ATOMIC_SEQ_CST);
+		if ((state & 1) && (state >> 1) != epoch)
+			return 0;
+	}
+	(void) __atomic_compare_exchange_n(&EPOCH, &epoch, epoch + 1, false,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+
+/**
+ * Free the retired objects that can no longer be reached.
+ *
+ * @param rec the record of the current thread
+*/
+static int
+epoch_collect(struct epoch_record *rec)
+{
+	struct epoch_garbage *g, **prev, *dead = NULL;
+	uint64_t              epoch;
+
+	epoch_advance();
+	epoch = __atomic_load_n(&EPOCH, __ATOMIC_SEQ_CST);
+
+	/* The list is sorted newest first, so everything after the first match is older */
+	rec->limbo_count = 0;
+	for (prev = &rec->limbo; (g = *prev) != NULL; prev = &g->next) {
+		if (g->epoch + 2 <= epoch) {
+			*prev = NULL;
+			dead = g;
+			break;
+		}
+		rec->limbo_count++;
+	}
+	epoch_free_list(dead);
+
+	/* The objects of exited threads are not sorted */
+	if (__atomic_load_n(&EPOCH_ORPHANS, __ATOMIC_RELAXED) != NULL) {
+		dead = NULL;
+		mutex_lock(EPOCH_MUTEX);
+		for (prev = &EPOCH_ORPHANS; (g = *prev) != NULL; ) {
+			if (g->epoch + 2 <= epoch) {
+				*prev = g->next;
+				g->next = dead;
+				dead = g;
+			} else {
+				prev = &g->next;
+			}
+		}
+		mutex_unlock(EPOCH_MUTEX);
+		epoch_free_list(dead);
+	}
+}
+
+
+/**
+ * Enter a critical section.
+ *
+ * Objects that are reachable from shared data when this is called will
+ * not be freed until the matching call to epoch_exit().
+*/
+int
+epoch_enter(void)
+{
+	struct epoch_record *rec;
+
+	epoch_self(&rec);
+	if (rec->depth++ == 0) {
+		__atomic_store_n(&rec->state,
+				(__atomic_load_n(&EPOCH, __ATOMIC_SEQ_CST) << 1) | 1,
+				__ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+}
+
+
+/**
+ * Leave a critical section.
+*/
+void
+epoch_exit(void)
+  {
+	struct epoch_record *rec = EPOCH_SELF;
+
+	/* epoch_enter() may have failed */
+	if (rec == NULL || rec->depth == 0)
+		return;
+	if (--rec->depth == 0)
+		__atomic_store_n(&rec->state, 0, __ATOMIC_RELEASE);
+  }
+
+
+/**
+ * Free an object once no reader can hold a pointer to it.
+ *
+ * The object must already be unreachable from shared data.
+ *
+ * @param ptr the object
+ * @param func the function that frees the object, e.g. free(3)
+*/
+int
+epoch_retire(void *ptr, callback_t func)
+{
+	struct epoch_record  *rec;
+	struct epoch_garbage *g;
+
+	epoch_self(&rec);
+
+	/* If there is no memory to remember the object, wait until it is unreachable */
+	if ((g = malloc(sizeof(*g))) == NULL) {
+		epoch_synchronize();
+		func(ptr);
+		return 0;
+	}
+	g->ptr = ptr;
+	g->func = func;
+	g->epoch = __atomic_load_n(&EPOCH, __ATOMIC_SEQ_CST);
+	g->next = rec->limbo;
+	rec->limbo = g;
+
+	if (++rec->limbo_count >= EPOCH_LIMBO_MAX)
+		epoch_collect(rec);
+}
+
+
+/**
+ * Free the objects retired by the current thread that are no longer reachable.
+ *
+ * Unlike epoch_synchronize(), this never waits for other threads, so it
+ * can be called by a thread that retires objects too rarely to fill its
+ * limbo list.
+*/
+int
+epoch_poll(void)
+{
+	struct epoch_record *rec;
+
+	epoch_self(&rec);
+	if (rec->depth == 0)
+		epoch_collect(rec);
+}
+
+
+/**
+ * Wait until every object that the current thread has retired is freed.
+ *
+ * This must not be called from within a critical section.
+*/
+int
+epoch_synchronize(void)
+{
+	struct epoch_record *rec;
+	uint64_t             target;
+
+	epoch_self(&rec);
+	if (rec->depth > 0)
+		throw("called within a critical section");
+
+	target = __atomic_load_n(&EPOCH, __ATOMIC_SEQ_CST) + 2;
+	for (;;) {
+		epoch_collect(rec);
+		if (__atomic_load_n(&EPOCH, __ATOMIC_SEQ_CST) >= target)
+			break;
+		(void) sched_yield();
+	}
+	epoch_collect(rec);
+}
@@ -0,0 +1,489 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * External merge sort of line-oriented files.
+ *
+ * The input is read into a strtab_t until it holds about @a budget
+ * bytes, which is then sorted in memory and written to a temporary
+ * file as a sorted run. The runs are merged EXTSORT_FANIN at a time
+ * with a binary heap until a single pass can produce the output. The
+ * amount of memory used depends only on the budget, not on the size
+ * of the input.
+ *
+ * Each line is a record; the newline is not part of the record, and a
+ * final line without a newline is treated as if it had one. Records are
+ * ordered exactly as list_sort() would order them, and the sort is
+ * stable.
+*/
+
+#include "config.h"
+
+#include "nc_exception.h"
+#include "nc_extsort.h"
+#include "nc_file.h"
+#include "nc_list.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_strbuf.h"
+#include "nc_string.h"
+#include "nc_strtab.h"
+#include "nc_strview.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** The smallest read buffer that is given to each run during a merge */
+#define EXTSORT_READ_MIN	(64 * 1024)
+
+/** A buffered reader that returns one line at a time */
+struct extsort_reader {
+	int        fd;
+	char      *buf;
+	size_t     size, pos, len;
+	bool       eof;
+
+	/** The current line, which is valid until the next read */
+	strview_t  line;
+
+	/** The numeric value of @a line, if SORT_NUMERIC was given */
+	uint32_t   key;
+};
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Read the next line.
+ *
+ * @param found set to false at the end of the file
+ * @param r the reader
+ * @param flags the sort flags
+*/
+static int
+extsort_reader_next(bool *found, struct extsort_reader *r, int flags)
+{
+	char   *nl, *buf;
+	ssize_t n;
+
+	for (;;) {
+		if ((nl = memchr(r->buf + r->pos, '\n', r->len - r->pos)) != NULL) {
+			r->line.ptr = r->buf + r->pos;
+			r->line.len = (size_t) (nl - r->line.ptr);
+			r->pos += r->line.len + 1;
+			break;
+		}
+		if (r->eof) {
+			if (r->pos == r->len) {
+				*found = false;
+				return 0;
+			}
+			r->line.ptr = r->buf + r->pos;
+			r->line.len = r->len - r->pos;
+			r->pos = r->len;
+			break;
+		}
+
+		/* Move the partial line to the front, and grow the buffer if it is full */
+		memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+		r->len -= r->pos;
+		r->pos = 0;
+		if (r->len == r->size) {
+			if ((buf = realloc(r->buf, r->size * 2)) == NULL)
+				throw_errno("realloc(3)");
+			r->buf = buf;
+			r->size *= 2;
+		}
+
+		if ((n = read(r->fd, r->buf + r->len, r->size - r->len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			throw_errno("read(2)");
+		}
+		if (n == 0)
+			r->eof = true;
+		r->len += (size_t) n;
+	}
+
+	if ((flags & SORT_NUMERIC) && strview_to_uint32(&r->key, r->line) < 0)
+		throw_silent();
+	*found = true;
+}
+
+
+/**
+ * Prepare a reader for a file descriptor.
+ *
+ * @param r the reader
+ * @param fd the file descriptor
+ * @param size the initial size of the buffer
+*/
+static int
+extsort_reader_init(struct extsort_reader *r, int fd, size_t size)
+{
+
+	memset(r, 0, sizeof(*r));
+	r->fd = fd;
+	r->size = size;
+	if ((r->buf = malloc(size)) == NULL)
+		throw_errno("malloc(3)");
+}
+
+
+/**
+ * Compare the current lines of two readers.
+ *
+ * Lines from the reader with the lower index win ties, which keeps
+ * the merge stable.
+ *
+ * @param rc less than, equal to, or greater than zero
+*/
+static int
+extsort_compare(int *rc, const struct extsort_reader *r, size_t a, size_t b, int flags)
+{
+	strview_t s1 = r[a].line, s2 = r[b].line;
+
+	if (flags & SORT_NUMERIC) {
+		*rc = (r[a].key > r[b].key) - (r[a].key < r[b].key);
+	} else {
+		*rc = memcmp(s1.ptr, s2.ptr, (s1.len < s2.len) ? s1.len : s2.len);
+		if (*rc == 0)
+			*rc = (s1.len > s2.len) - (s1.len < s2.len);
+	}
+	if (flags & SORT_DESCENDING)
+		*rc = -*rc;
+	if (*rc == 0)
+		*rc = (a > b) - (a < b);
+}
+
+
+/**
+ * Move an element of a heap of reader indexes down until it is in order.
+ *
+ * @param heap the heap
+ * @param n the number of elements in @a heap
+ * @param i the index of the element to move
+ * @param r the readers
+ * @param flags the sort flags
+*/
+static int
+extsort_sift_down(size_t *heap, size_t n, size_t i, const struct extsort_reader *r, int flags)
+{
+	size_t child, tmp;
+	int    rc;
+
+	while ((child = 2 * i + 1) < n) {
+		if (child + 1 < n) {
+			(void) extsort_compare(&rc, r, heap[child + 1], heap[child], flags);
+			if (rc < 0)
+				child++;
+		}
+		(void) extsort_compare(&rc, r, heap[child], heap[i], flags);
+		if (rc >= 0)
+			break;
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+
+/**
+ * Write a line to a buffer, and flush the buffer when it is full.
+*/
+static int
+extsort_put(strbuf_t *out, int fd, strview_t line)
+{
+
+	strbuf_append(out, line.ptr, line.len);
+	strbuf_append(out, "\n", 1);
+	if (out->len >= EXTSORT_IO_SIZE) {
+		strbuf_write(out, fd);
+		strbuf_truncate(out);
+	}
+}
+
+
+/**
+ * Create an anonymous temporary file.
+ *
+ * The file is unlinked as soon as it is created, so it is removed
+ * automatically when the descriptor is closed, even after a crash.
+ *
+ * @param fd the file descriptor
+ * @param tmpdir the directory to create the file in
+*/
+static int
+extsort_tmpfile(int *fd, const string_t *tmpdir)
+{
+	string_t *path;
+
+	str_sprintf(path, "%s/.extsort.XXXXXX", tmpdir->value);
+	if ((*fd = mkstemp((char *) path->value)) < 0) {
+		log_error("path=`%s'", path->value);
+		throw_errno("mkstemp(3)");
+	}
+	(void) unlink(path->value);
+}
+
+
+/**
+ * Sort the lines in a table and write them to a file.
+ *
+ * @param fd the file descriptor
+ * @param tab the lines
+ * @param flags the sort flags
+*/
+static int
+extsort_write_run(int fd, strtab_t *tab, int flags)
+{
+	strbuf_t  *out;
+	strview_t  line;
+	size_t     pos = 0;
+
+	if (strtab_sort(tab, flags | SORT_PARALLEL) < 0)
+		throw_silent();
+	while (strtab_next(&line, &pos, tab) == 0) {
+		if (extsort_put(out, fd, line) < 0)
+			throw_silent();
+	}
+	if (strbuf_write(out, fd) < 0)
+		throw_silent();
+}
+
+
+/**
+ * Merge sorted runs into a file.
+ *
+ * @param dest the file descriptor of the output
+ * @param run the file descriptors of the runs, in input order
+ * @param n the number of runs
+ * @param flags the sort flags
+ * @param budget the amount of memory to use for read buffers
+*/
+static int
+extsort_merge(int dest, const int *run, size_t n, int flags, size_t budget)
+{
+	struct extsort_reader *r = NULL;
+	strbuf_t              *out;
+	size_t                *heap = NULL;
+	size_t                 i, count = 0, size;
+	bool                   found;
+
+	size = budget / (n + 1);
+	if (size < EXTSORT_READ_MIN)
+		size = EXTSORT_READ_MIN;
+	if ((r = calloc(n, sizeof(*r))) == NULL || (heap = calloc(n, sizeof(*heap))) == NULL)
+		throw_errno("calloc(3)");
+
+	/* Read the first line of each run */
+	for (i = 0; i < n; i++) {
+		if (lseek(run[i], 0, SEEK_SET) < 0)
+			throw_errno("lseek(2)");
+		if (extsort_reader_init(&r[i], run[i], size) < 0)
+			throw_silent();
+		if (extsort_reader_next(&found, &r[i], flags) < 0)
+			throw_silent();
+		if (found)
+			heap[count++] = i;
+	}
+
+	/* Build the heap, then repeatedly take the smallest line */
+	for (i = count / 2; i > 0; i--)
+		(void) extsort_sift_down(heap, count, i - 1, r, flags);
+	while (count > 0) {
+		if (extsort_put(out, dest, r[heap[0]].line) < 0)
+			throw_silent();
+		if (extsort_reader_next(&found, &r[heap[0]], flags) < 0)
+			throw_silent();
+		if (!found)
+			heap[0] = heap[--count];
+		(void) extsort_sift_down(heap, count, 0, r, flags);
+	}
+	if (strbuf_write(out, dest) < 0)
+		throw_silent();
+
+finally:
+	for (i = 0; r != NULL && i < n; i++)
+		free(r[i].buf);
+	free(r);
+	free(heap);
+}
+
+
+/**
+ * Sort the lines of a file descriptor into another file descriptor.
+ *
+ * If the whole input fits within @a budget, it is sorted in memory
+ * and no temporary files are created. Otherwise, sorted runs are
+ * written to unlinked temporary files in @a tmpdir, which must have
+ * room for about twice the size of the input.
+ *
+ * @param dest the file descriptor of the output
+ * @param src the file descriptor of the input
+ * @param tmpdir the directory for temporary files
+ * @param flags any combination of SORT_DESCENDING and SORT_NUMERIC
+ * @param budget the approximate amount of memory to use, or zero for EXTSORT_BUDGET_DEFAULT
+*/
+int
+extsort_fd(int dest, int src, const string_t *tmpdir, int flags, size_t budget)
+{
+	struct extsort_reader in = { .buf = NULL };
+	strtab_t             *tab;
+	int                  *run = NULL, *next = NULL, *tmp;
+	size_t                nruns = 0, nnext = 0, i, n;
+	bool                  found = true;
+
+	if (budget == 0)
+		budget = EXTSORT_BUDGET_DEFAULT;
+	if (extsort_reader_init(&in, src, EXTSORT_IO_SIZE) < 0)
+		throw_silent();
+
+	/* Split the input into sorted runs */
+	while (found) {
+		if (extsort_reader_next(&found, &in, flags & ~SORT_NUMERIC) < 0)
+			throw_silent();
+		if (found && strtab_append(tab, in.line.ptr, in.line.len) < 0)
+			throw_silent();
+		if (found && tab->data_len + tab->count * sizeof(strtab_entry_t) < budget)
+			continue;
+
+		/* If everything fits in memory, skip the temporary files */
+		if (!found && nruns == 0) {
+			if (extsort_write_run(dest, tab, flags) < 0)
+				throw_silent();
+			return 0;
+		}
+		if (tab->count == 0)
+			continue;
+
+		if ((tmp = realloc(run, (nruns + 1) * sizeof(*run))) == NULL)
+			throw_errno("realloc(3)");
+		run = tmp;
+		if (extsort_tmpfile(&run[nruns], tmpdir) < 0)
+			throw_silent();
+		nruns++;
+		if (extsort_write_run(run[nruns - 1], tab, flags) < 0)
+			throw_silent();
+		strtab_truncate(tab);
+	}
+
+	/* Merge groups of runs until a single pass is enough */
+	while (nruns > EXTSORT_FANIN) {
+		nnext = (nruns + EXTSORT_FANIN - 1) / EXTSORT_FANIN;
+		if ((next = calloc(nnext, sizeof(*next))) == NULL)
+			throw_errno("calloc(3)");
+		for (i = 0; i < nnext; i++)
+			next[i] = -1;
+		for (i = 0; i < nnext; i++) {
+			n = (nruns - i * EXTSORT_FANIN < EXTSORT_FANIN) ? nruns - i * EXTSORT_FANIN : EXTSORT_FANIN;
+			if (extsort_tmpfile(&next[i], tmpdir) < 0)
+				throw_silent();
+			if (extsort_merge(next[i], run + i * EXTSORT_FANIN, n, flags, budget) < 0)
+				throw_silent();
+		}
+		for (i = 0; i < nruns; i++)
+			(void) close(run[i]);
+		free(run);
+		run = next;
+		nruns = nnext;
+		next = NULL;
+	}
+	if (extsort_merge(dest, run, nruns, flags, budget) < 0)
+		throw_silent();
+
+finally:
+	for (i = 0; i < nruns; i++)
+		(void) close(run[i]);
+	for (i = 0; next != NULL && i < nnext; i++) {
+		if (next[i] >= 0)
+			(void) close(next[i]);
+	}
+	free(run);
+	free(next);
+	free(in.buf);
+}
+
+
+/**
+ * Sort the lines of a file into another file.
+ *
+ * The output is written to a temporary file in the same directory as
+ * @a dest, which is renamed to @a dest once it is complete, so a
+ * failed sort never leaves a partial file behind. The runs are also
+ * stored in that directory, rather than in /tmp, which may be backed
+ * by memory.
+ *
+ * @param dest the path of the output
+ * @param src the path of the input; this may be the same as @a dest
+ * @param flags any combination of SORT_DESCENDING and SORT_NUMERIC
+ * @param budget the approximate amount of memory to use, or zero for EXTSORT_BUDGET_DEFAULT
+ * @see extsort_fd()
+*/
+int
+extsort_file(const string_t *dest, const string_t *src, int flags, size_t budget)
+{
+	string_t   *tmpdir, *template;
+	const char *cp;
+	int         ifd = -1, ofd = -1;
+
+	/* Use the directory that contains the output */
+	if ((cp = strrchr(dest->value, '/')) == NULL) {
+		str_cpy(tmpdir, ".");
+	} else if (cp == dest->value) {
+		str_cpy(tmpdir, "/");
+	} else {
+		str_ncpy(tmpdir, dest->value, (size_t) (cp - dest->value));
+	}
+	str_sprintf(template, "%s.tmpXXXXXX", dest->value);
+
+	if ((ifd = open(src->value, O_RDONLY)) < 0) {
+		log_error("while opening %s ...", src->value);
+		throw_errno("open(2)");
+	}
+	if ((ofd = mkstemp((char *) template->value)) < 0) {
+		log_error("path=`%s'", template->value);
+		throw_errno("mkstemp(3)");
+	}
+
+	if (extsort_fd(ofd, ifd, tmpdir, flags, budget) < 0)
+		throw_silent();
+	if (close(ofd) < 0) {
+		ofd = -1;
+		throw_errno("close(2)");
+	}
+	ofd = -1;
+	if (file_rename(template, dest) < 0)
+		throw_silent();
+	str_truncate(template);
+
+catch:
+	if (str_len(template) > 0)
+		(void) unlink(template->value);
+
+finally:
+	if (ifd >= 0)
+		(void) close(ifd);
+	if (ofd >= 0)
+		(void) close(ofd);
+}
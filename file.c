@@ -68,7 +68,7 @@ file_new(file_t **file)
 	if (*file != NULL)
 		throw("double new() detected");
 
-	mem_calloc(f);
+	mem_slab_calloc(f);
 	f->fd = -1;
 	str_new(&f->path);
 	*file = f;
@@ -951,22 +951,17 @@ file_copy(const string_t *src, const string_t *dest)
 	//log_warning("new: base=`%s' fn=`%s'", new_basename->value, new_fn->value);
 
 	/* Read the source file into a buffer */
-	/* KLUDGE: the string library can't handle binary files */
-	str_resize(buf, (size_t) file_size + 1);
-	if ((fd = open(src->value, O_RDONLY, 0)) < 0)
-		throw_errno("open(2)");
-	if (read(fd, (char *) buf->value, (size_t) file_size) < (ssize_t) file_size)
-		throw_errno("read(2)");
-	if (close(fd) < 0)
-		throw_errno("close(2)");
+	file_read(buf, src);
+	if (buf->len != file_size)
+		throwf("short read from `%s'", src->value);
 
 	/* Write the buffer to the new file */
 	str_sprintf(new_path, "%s/%s", new_basename->value, new_fn->value);
 	log_debug("copying `%s' to `%s'", src->value, new_path->value);
 	if ((fd = open(new_path->value, O_WRONLY | O_CREAT, mode)) < 0)
 		throw_errno("open(2)");
-	if (write(fd, buf->value, (size_t) file_size) < (ssize_t) file_size)
-		throw_errno("read(2)");
+	if (write(fd, buf->value, buf->len) < (ssize_t) buf->len)
+		throw_errno("write(2)");
 	if (close(fd) < 0)
 		throw_errno("close(2)");
 }
@@ -990,7 +985,7 @@ file_destroy(file_t **file)
 
 finally:
 	if (file != NULL)  
-		free(*file);
+		mem_slab_release(*file);
 }
 
 
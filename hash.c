@@ -20,68 +20,337 @@
  *
  * Hash tables.
  *
+ * Keys are hashed with SipHash-1-3 using a random seed that is chosen
+ * once per process, and stored in an open-addressing table that uses
+ * Robin Hood hashing: an entry that is far from its home slot may take
+ * the place of one that is closer to home, which keeps probe sequences
+ * short even when the table is nearly full. Deleting from the current
+ * table shifts the following entries back, so no tombstones are left.
+ *
+ * Growing the table is incremental. The old array is kept, and every
+ * hash_set() or hash_delete() moves HASH_MOVE_STEP of its slots into
+ * the new array. Lookups search the new array first, then the old one.
+ * Entries that are removed from the old array become tombstones, which
+ * keep their hash so that the remaining probe sequences stay intact.
 */
 
+#include "config.h"
+
 #include "nc_exception.h"
 #include "nc_hash.h"
 #include "nc_list.h"
 #include "nc_log.h"
 #include "nc_memory.h"
+#include "nc_serial.h"
 #include "nc_string.h"
+#include "nc_thread.h"
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+/* ------------------------------ GLOBAL VARIABLES ------------------------- */
+
+/** The smallest number of slots in a non-empty table */
+#define HASH_SIZE_MIN		8
+
+/** The number of slots in the old array that are moved by each update */
+#define HASH_MOVE_STEP		16
+
+/** True if a table of @a size slots can hold @a count entries (load factor 7/8) */
+#define HASH_FITS(count,size)	((count) <= (size) - (size) / 8)
+
+/** The distance of the entry in slot @a i from its home slot */
+#define HASH_DISTANCE(h,i,mask)	(((i) - ((h) & (mask))) & (mask))
+
+/** The per-process secret that all keys are hashed with */
+static uint64_t       HASH_SEED;
+static pthread_once_t HASH_SEED_ONCE = PTHREAD_ONCE_INIT;
+
 /* -------------------------------- FUNCTIONS -------------------------------- */
 
-/** @todo Use a public domain hashing function instead of this crap */
+/**
+ * Choose a random seed for the hash function.
+*/
+static void
+hash_seed_init(void)
+  {
+	uint64_t seed = 0;
+	int      fd;
+
+	if ((fd = open("/dev/urandom", O_RDONLY)) >= 0) {
+		if (read(fd, &seed, sizeof(seed)) != sizeof(seed))
+			seed = 0;
+		(void) close(fd);
+	}
+	if (seed == 0) {
+		seed = (uint64_t) time(NULL) ^ ((uint64_t) getpid() << 32) ^
+			(uint64_t) (uintptr_t) &seed;
+	}
+	HASH_SEED = seed;
+  }
+
+
+/**
+ * Hash a key.
+ *
+ * Zero marks a slot that has never been used, so it is never returned.
+ *
+ * @param dest the hash value
+ * @param key the key
+ * @param len the length of @a key
+*/
+static inline int
+hash_function(uint64_t *dest, char_t *key, size_t len)
+{
+
+	*dest = hash_bytes(key, len, HASH_SEED);
+	if (*dest == 0)
+		*dest = 1;
+}
+
+
+/**
+ * Hash a key with the same function and seed as hash_t.
+ *
+ * This lets other tables use the seeded hash without creating a hash_t.
+ *
+ * @param dest the hash value, which is never zero
+ * @param key the key
+ * @param len the length of @a key
+*/
+int
+hash_key(uint64_t *dest, char_t *key, size_t len)
+{
+
+	(void) pthread_once(&HASH_SEED_ONCE, hash_seed_init);
+	hash_function(dest, key, len);
+}
+
+
+/**
+ * Search one array of slots for a key.
+ *
+ * @param dest the slot that holds the key
+ * @param slot the array of slots
+ * @param size the number of slots; a power of two
+ * @param h the hash of the key
+ * @param key the key
+ * @param len the length of @a key
+ * @return -1 if the key was not found
+*/
 static inline int
-hash_function(uint8_t *result, char_t *key)
+hash_probe(hash_slot_t **dest, hash_slot_t *slot, size_t size, uint64_t h, char_t *key, size_t len)
 {
-	size_t i, len;
-	uint8_t x = 0;
+	size_t mask = size - 1, i, dist;
+	hash_slot_t *s;
+
+	if (size == 0)
+		return -1;
 
-	len = strlen(key);
-	for (i = 0; i < len; i++) {
-		 x = x ^ key[i];
+	for (i = h & mask, dist = 0; ; i = (i + 1) & mask, dist++) {
+		s = &slot[i];
+
+		/* An unused slot, or an entry that is closer to home, ends the search */
+		if (s->hash == 0 || HASH_DISTANCE(s->hash, i, mask) < dist)
+			return -1;
+
+		if (s->hash == h && s->key != NULL && s->key->len == len &&
+				memcmp(s->key->value, key, len) == 0) {
+			*dest = s;
+			return 0;
+		}
 	}
-	//log_debug("hashed `%s' to %d", src->value, result);
-	*result = x;
 }
 
+
+/**
+ * Find the slot that holds a key, in either the current or the old array.
+ *
+ * @param dest the slot that holds the key
+ * @param in_old set to true if the slot is in the old array
+ * @param hash hash table
+ * @param key the key
+ * @param len the length of @a key
+ * @param h the hash of the key
+ * @return -1 if the key was not found
+*/
+static int
+hash_find(hash_slot_t **dest, bool *in_old, const hash_t *hash, char_t *key, size_t len, uint64_t h)
+{
+
+	*in_old = false;
+	if (hash_probe(dest, hash->slot, hash->size, h, key, len) == 0)
+		return 0;
+
+	*in_old = true;
+	if (hash->old_count > 0 && hash_probe(dest, hash->old, hash->old_size, h, key, len) == 0)
+		return 0;
+
+	return -1;
+}
+
+
+/**
+ * Place an entry into an array of slots that does not already contain its key.
+ *
+ * @param slot the array of slots, which must have at least one unused slot
+ * @param size the number of slots; a power of two
+ * @param ent the entry to be placed
+*/
 static inline int
-hash_entry_search(list_t **dest, list_entry_t **ent, hash_t *hash, char_t *key)
+hash_place(hash_slot_t *slot, size_t size, hash_slot_t ent)
 {
-	list_entry_t *cur = NULL; 
-	uint8_t   slot;
-	bool      found = false;
+	size_t      mask = size - 1, i, dist, d;
+	hash_slot_t tmp;
+
+	for (i = ent.hash & mask, dist = 0; slot[i].hash != 0; i = (i + 1) & mask, dist++) {
+
+		/* Take the place of an entry that is closer to its home slot */
+		d = HASH_DISTANCE(slot[i].hash, i, mask);
+		if (d < dist) {
+			tmp = slot[i];
+			slot[i] = ent;
+			ent = tmp;
+			dist = d;
+		}
+	}
+	slot[i] = ent;
+}
 
-	/* Hash the key into a bucket number */
-	hash_function(&slot, key);
 
-	/* If the bucket doesn't exist, the search fails */
-	if (hash->bucket[slot] == NULL) 
-		throw_silent();
+/**
+ * Remove an entry from the current array by shifting the entries that follow it.
+ *
+ * @param hash hash table
+ * @param s the slot to be cleared
+*/
+static inline int
+hash_shift_delete(hash_t *hash, hash_slot_t *s)
+{
+	size_t mask = hash->size - 1, i, next;
 
-	/* Perform an O(N) search for the key */
-	for (cur = hash->bucket[slot]->head; cur; cur = cur->next) {
-		if (str_cmp(cur->value, key) == 0) {
-			*dest = hash->bucket[slot];
-			*ent = cur;
-			found = true;
+	i = (size_t) (s - hash->slot);
+	for (;;) {
+		next = (i + 1) & mask;
+		if (hash->slot[next].hash == 0 || HASH_DISTANCE(hash->slot[next].hash, next, mask) == 0)
 			break;
+		hash->slot[i] = hash->slot[next];
+		i = next;
+	}
+	memset(&hash->slot[i], 0, sizeof(hash->slot[i]));
+}
+
+
+/**
+ * Free the key and value of a slot.
+*/
+static inline int
+hash_slot_clear(hash_slot_t *s)
+{
+
+	str_destroy(&s->key);
+	str_destroy(&s->value);
+}
+
+
+/**
+ * Move some of the entries in the old array into the current array.
+ *
+ * The old array is freed once it is empty.
+ *
+ * @param hash hash table
+ * @param nslots the number of slots to examine
+*/
+static int
+hash_move(hash_t *hash, size_t nslots)
+{
+	hash_slot_t *s;
+
+	while (hash->old != NULL && nslots-- > 0 && hash->old_moved < hash->old_size) {
+		s = &hash->old[hash->old_moved++];
+		if (s->key != NULL) {
+			hash_place(hash->slot, hash->size, *s);
+
+			/* Leave a tombstone that keeps the hash for later probes */
+			s->key = NULL;
+			s->value = NULL;
+			hash->old_count--;
 		}
 	}
 
-	/* Fail unless the key was found */
-	if (!found) {
-		throw_silent();
+	if (hash->old != NULL && (hash->old_count == 0 || hash->old_moved == hash->old_size)) {
+		free(hash->old);
+		hash->old = NULL;
+		hash->old_size = 0;
+		hash->old_moved = 0;
+		hash->old_count = 0;
+	}
+}
+
+
+/**
+ * Replace the current array with a larger one.
+ *
+ * Unless @a now is true, the entries are moved later by hash_move().
+ *
+ * @param hash hash table
+ * @param size the new number of slots; a power of two
+ * @param now if true, move every entry before returning
+*/
+static int
+hash_resize(hash_t *hash, size_t size, bool now)
+{
+	hash_slot_t *slot = NULL;
+
+	/* Only one resize can be in progress at a time */
+	hash_move(hash, SIZE_MAX);
+
+	if (size > SIZE_MAX / sizeof(*slot))
+		throw("hash table too large");
+	if ((slot = calloc(size, sizeof(*slot))) == NULL)
+		throw_errno("calloc(3)");
+
+	if (hash->count > 0) {
+		hash->old = hash->slot;
+		hash->old_size = hash->size;
+		hash->old_count = hash->count;
+		hash->old_moved = 0;
+	} else {
+		free(hash->slot);
 	}
+	hash->slot = slot;
+	hash->size = size;
+
+	if (now)
+		hash_move(hash, SIZE_MAX);
+}
+
+
+/**
+ * Make room for at least @a count entries without further resizing.
+ *
+ * @param hash hash table
+ * @param count the number of entries that the table should be able to hold
+*/
+int
+hash_reserve(hash_t *hash, size_t count)
+{
+	size_t size = HASH_SIZE_MIN;
+
+	while (!HASH_FITS(count, size)) {
+		if (size > SIZE_MAX / 2)
+			throw("hash table too large");
+		size *= 2;
+	}
+	if (size > hash->size)
+		hash_resize(hash, size, true);
 }
 
 
@@ -94,22 +363,52 @@ hash_entry_search(list_t **dest, list_entry_t **ent, hash_t *hash, char_t *key)
 int
 hash_delete(hash_t *hash, char_t *key)
 {
-	list_t   *bucket = NULL;
-	list_entry_t *ent = NULL;
+	hash_slot_t *s;
+	uint64_t     h;
+	size_t       len = strlen(key);
+	bool         in_old;
 
-	/* Get a pointer to the bucket that has the element */
-	if (hash_entry_search(&bucket, &ent, hash, key) == 0) {
+	hash_move(hash, HASH_MOVE_STEP);
 
-		/* Delete the value */
-		list_entry_delete(bucket, ent->next);
-
-		/* Delete the key */
-		list_entry_delete(bucket, ent);
+	hash_function(&h, key, len);
+	if (hash_find(&s, &in_old, hash, key, len, h) < 0)
+		throw_silent();
 
-		hash->count--;
+	hash_slot_clear(s);
+	if (in_old) {
+		/* Leave a tombstone */
+		hash->old_count--;
 	} else {
-		throw_silent();
+		hash_shift_delete(hash, s);
 	}
+	hash->count--;
+}
+
+
+/**
+ * Retrieve a borrowed reference to an element in the hash.
+ *
+ * Unlike hash_get(), the value is not copied. The reference remains
+ * valid until the next call that modifies the hash.
+ *
+ * @param dest pointer to the value that is associated with @a key
+ * @param hash hash table
+ * @param key key to be retrieved
+ * @return -1 if the key does not exist; no error is logged
+*/
+int
+hash_lookup(const string_t **dest, const hash_t *hash, char_t *key)
+{
+	hash_slot_t *s;
+	uint64_t     h;
+	size_t       len = strlen(key);
+	bool         in_old;
+
+	hash_function(&h, key, len);
+	if (hash_find(&s, &in_old, hash, key, len, h) < 0)
+		throw_silent();
+
+	*dest = s->value;
 }
 
 
@@ -123,18 +422,12 @@ hash_delete(hash_t *hash, char_t *key)
 int
 hash_get(string_t *dest, hash_t *hash, char_t *key)
 {
-	list_t       *bucket = NULL;
-	list_entry_t *ent = NULL;
-
-	/* Get a pointer to the bucket that has the element */
-	if (hash_entry_search(&bucket, &ent, hash, key) == 0) {
+	const string_t *value;
 
-		/// @todo optimize: str_clone() instead of copy()
-		str_copy(dest, ent->next->value);
-
-	} else {
+	if (hash_lookup(&value, hash, key) < 0)
 		throw_silent();
-	}
+
+	str_copy(dest, value);
 }
 
 
@@ -148,39 +441,35 @@ hash_get(string_t *dest, hash_t *hash, char_t *key)
 int
 hash_set(hash_t *hash, char_t *key, const string_t *value)
 {
-	list_entry_t *cur = NULL; 
-	string_t    str = EMPTY_STRING;
-	uint8_t     slot;
-
-	/* Hash the key into a bucket number */
-	hash_function(&slot, key);
-
-	/* Create a new bucket, if needed */
-	if (hash->bucket[slot] == NULL) {
-		list_new(&hash->bucket[slot]);
-		/* SA-NOTE: list_destroy() called by hash destructor */
+	hash_slot_t  ent = { 0, NULL, NULL };
+	hash_slot_t *s;
+	size_t       len = strlen(key);
+	bool         in_old;
+
+	hash_move(hash, HASH_MOVE_STEP);
+
+	/* Update the value of an existing key */
+	hash_function(&ent.hash, key, len);
+	if (hash_find(&s, &in_old, hash, key, len, ent.hash) == 0) {
+		str_copy(s->value, value);
+		return 0;
 	}
 
-	/* Perform an O(N) search for the key */
-	for (cur = hash->bucket[slot]->head; cur; cur = cur->next) {
-		if (str_cmp(cur->value, key) == 0) {
-			/* Update the value */
-			str_copy(cur->next->value, value);
-			goto finally;
-		}
-	}
+	/* Grow the table, if needed */
+	if (!HASH_FITS(hash->count + 1, hash->size))
+		hash_resize(hash, (hash->size > 0) ? hash->size * 2 : HASH_SIZE_MIN, false);
 
-	/* If a match isn't found, try to insert a new value */
-	/* Add the new key+value pair to the list */
-	str_alias(&str, key);
-	list_push(hash->bucket[slot], &str);
-	if (list_push(hash->bucket[slot], value) < 0) {
-
-		/* To prevent corruption, remove the key from the list */
-		list_entry_delete(hash->bucket[slot], hash->bucket[slot]->tail);
-		throw("error inserting a new entry into the hash table");
-	}
+	/* Create a new key+value pair; throw_silent() frees it on error */
+	if (str_new(&ent.key) < 0 || str_ncpy(ent.key, key, len) < 0)
+		throw_silent();
+	if (str_new(&ent.value) < 0 || str_copy(ent.value, value) < 0)
+		throw_silent();
+	if (hash_place(hash->slot, hash->size, ent) < 0)
+		throw_silent();
 	hash->count++;
+
+catch:
+	(void) hash_slot_clear(&ent);
 }
 
 
@@ -193,6 +482,8 @@ int
 hash_new(hash_t **dest)
 {
 
+	(void) pthread_once(&HASH_SEED_ONCE, hash_seed_init);
+
 	/* Allocate memory */
 	mem_calloc(*dest);
 }
@@ -201,18 +492,31 @@ hash_new(hash_t **dest)
 /**
  * Delete all elements from a hash table.
  *
+ * The array of slots is kept so that it can be reused.
+ *
  * @param hash hash table
 */
 int
 hash_truncate(hash_t *hash)
 {
-	int   i;
+	size_t i;
+
+	for (i = 0; i < hash->size; i++) {
+		if (hash->slot[i].key != NULL)
+			hash_slot_clear(&hash->slot[i]);
+	}
+	if (hash->size > 0)
+		memset(hash->slot, 0, hash->size * sizeof(*hash->slot));
 
-	/* Delete all in-memory keypairs */
-	for (i = 0; i < 256; i++) {
-		if (hash->bucket[i] != NULL)
-			list_truncate(hash->bucket[i]);
+	for (i = 0; i < hash->old_size; i++) {
+		if (hash->old[i].key != NULL)
+			hash_slot_clear(&hash->old[i]);
 	}
+	free(hash->old);
+	hash->old = NULL;
+	hash->old_size = 0;
+	hash->old_moved = 0;
+	hash->old_count = 0;
 
 	hash->count = 0;
 }
@@ -222,24 +526,77 @@ int
 hash_destroy(hash_t **hash_ref)
 {
 	hash_t *hash = NULL;
-	int  i;
 
 	/* Don't destroy hashes twice */
 	hash = *hash_ref;
+	if (hash == NULL)
+		return 0;
 
 	/* Delete all elements */
-	for (i = 0; i < 256; i++) {
-		if (hash->bucket[i] != NULL) {
-			list_destroy(&hash->bucket[i]);
-		}
-	}
+	hash_truncate(hash);
 
 	/* Delete the hash */
+	free(hash->slot);
 	free(hash);
 	*hash_ref = NULL;
 }
 
 
+/**
+ * Get the next entry in a hash table.
+ *
+ * The entries in the current array are visited first, followed by
+ * those that remain in the old array.
+ *
+ * @param dest the next slot that holds an entry
+ * @param pos the position of the iterator; set this to zero to start
+ * @param hash hash table
+ * @return -1 if there are no more entries
+*/
+static inline int
+hash_next(hash_slot_t **dest, size_t *pos, const hash_t *hash)
+{
+	hash_slot_t *s;
+
+	while (*pos < hash->size + hash->old_size) {
+		if (*pos < hash->size)
+			s = &hash->slot[*pos];
+		else
+			s = &hash->old[*pos - hash->size];
+		(*pos)++;
+		if (s->key != NULL) {
+			*dest = s;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+
+/**
+ * Iterate over the entries of a hash table.
+ *
+ * The key and value are borrowed references, which remain valid until
+ * the hash is modified.
+ *
+ * @param key the key of the next entry
+ * @param value the value of the next entry
+ * @param pos the position of the iterator; set this to zero to start
+ * @param hash hash table
+ * @return -1 if there are no more entries
+*/
+int
+hash_iterate(const string_t **key, const string_t **value, size_t *pos, const hash_t *hash)
+{
+	hash_slot_t *s;
+
+	if (hash_next(&s, pos, hash) < 0)
+		return -1;
+	*key = s->key;
+	*value = s->value;
+}
+
+
 /**
  * Copy all elements from one hash table into another hash table.
  * Any pre-existing elements in the destination will be removed.
@@ -250,16 +607,13 @@ hash_destroy(hash_t **hash_ref)
 int
 hash_copy(hash_t *dest, hash_t *src)
 {
-	int i;
+	hash_slot_t *s;
+	size_t       pos = 0;
 
-	/* Copy each bucket */
-	memset (dest->bucket, 0, sizeof(dest->bucket));
-	for (i = 0; i < 256; i++) {
-		if (src->bucket[i] != NULL) {
-			list_copy(dest->bucket[i], src->bucket[i]);
-		}
-	}
-	dest->count = src->count;
+	hash_truncate(dest);
+	hash_reserve(dest, src->count);
+	while (hash_next(&s, &pos, src) == 0)
+		hash_set(dest, s->key->value, s->value);
 }
 
 
@@ -272,24 +626,14 @@ hash_copy(hash_t *dest, hash_t *src)
 int
 hash_get_keys(list_t *dest, const hash_t *hash)
 {
-	list_entry_t *ent = NULL;
-	size_t        i;
+	hash_slot_t *s;
+	size_t       pos = 0;
 
 	/* Remove any previous members of the destination */
 	list_truncate(dest);
 
-	/* Examine each bucket .. */
-	for (i = 0; i < 256; i++) {
-
-		/* Skip empty buckets */
-		if (!hash->bucket[i])
-			continue;
-
-		/* Add each value to the list */
-		for (ent = hash->bucket[i]->head; ent; ent = ent->next->next) {
-			list_push(dest, ent->value);
-		}
-	}
+	while (hash_next(&s, &pos, hash) == 0)
+		list_push(dest, s->key);
 }
 
 
@@ -302,24 +646,14 @@ hash_get_keys(list_t *dest, const hash_t *hash)
 int
 hash_get_values(list_t *dest, const hash_t *hash) 
 {
-	list_entry_t *ent = NULL;
-	size_t        i;
+	hash_slot_t *s;
+	size_t       pos = 0;
 
 	/* Remove any previous members of the destination */
 	list_truncate(dest);
 
-	/* Examine each bucket .. */
-	for (i = 0; i < 256; i++) {
-
-		/* Skip empty buckets */
-		if (!hash->bucket[i])
-			continue;
-
-		/* Add each value to the list */
-		for (ent = hash->bucket[i]->head; ent; ent = ent->next->next) {
-			list_push(dest, ent->next->value);
-		}
-	}
+	while (hash_next(&s, &pos, hash) == 0)
+		list_push(dest, s->value);
 }
 
 
@@ -333,20 +667,17 @@ hash_get_values(list_t *dest, const hash_t *hash)
 int
 hash_key_exists(bool *result, const hash_t *hash, char_t *key)
 {
-	string_t *dest;
+	const string_t *value;
 
-	/** @todo fix hash_get()s side effects for tied hashes so this cast is not needed */
-        if (hash_get(dest, (hash_t *) hash, key) < 0) {
-		*result = false;
-	} else {
-		*result = true;
-	}
+	*result = (hash_lookup(&value, hash, key) == 0);
 }
 
 
 /**
  * Test if a value exists in a hash table.
- * @todo Optimize; this can be a slow O(N) search.
+ *
+ * This is an O(N) search. To test many values against the same table,
+ * copy them into a set_t with set_from_hash_values() and use set_contains().
  *
  * @param result store the result of the search; true if found
  * @param hash hash table to be searched
@@ -355,10 +686,16 @@ hash_key_exists(bool *result, const hash_t *hash, char_t *key)
 int
 hash_value_exists(bool *result, const hash_t *hash, char_t *value)
 {
-	list_t  *values;
+	hash_slot_t *s;
+	size_t       pos = 0;
 
-	hash_get_values(values, hash);
-	list_find(result, values, value);
+	*result = false;
+	while (hash_next(&s, &pos, hash) == 0) {
+		if (str_cmp(s->value, value) == 0) {
+			*result = true;
+			break;
+		}
+	}
 }
 
 
@@ -397,42 +734,27 @@ int
 hash_serialize(string_t *str, const hash_t *hash)
 {
 	string_t     *buf, *val;
-	list_entry_t *ent = NULL;
-	string_t     *ptr;
-	size_t        i;
-
-	for (i = 0; i < 256; i++) {
-		if (hash->bucket[i] != NULL) {
-
-			ent = hash->bucket[i]->head;
-			while (ent) {
-				ptr = ent->value;
-				/* Add the key */
-				str_sprintf(buf, "%s: ", ptr->value);
-
-				ent = ent->next;
-				ptr = ent->value;
-
-				/* Special case: multiline data is backslash terminated */
-				if (strchr(ptr->value, '\n') != NULL) {
-					str_copy(val, ptr);
-					str_subst_regex(val, "\n", "\\\n");
-					str_append(buf, val);
-				} 
-				/* Normal case: no padding is necessary */
-				else {
-					str_append(buf, ptr);
-				}
-				str_putc(buf, '\n');
-				str_append(str, buf);
-				ent = ent->next;
-			}
+	hash_slot_t  *s;
+	size_t        pos = 0;
+
+	while (hash_next(&s, &pos, hash) == 0) {
+
+		/* Add the key */
+		str_sprintf(buf, "%s: ", s->key->value);
+
+		/* Special case: multiline data is backslash terminated */
+		if (strchr(s->value->value, '\n') != NULL) {
+			str_copy(val, s->value);
+			str_subst_regex(val, "\n", "\\\n");
+			str_append(buf, val);
+		} 
+		/* Normal case: no padding is necessary */
+		else {
+			str_append(buf, s->value);
 		}
+		str_putc(buf, '\n');
+		str_append(str, buf);
 	}
-
-	//hash_print(hash);
-	//log_warning("s=`%s'", str->value);
-	//abort();
 }
 
 
@@ -505,6 +827,117 @@ hash_deserialize(hash_t *hash, const string_t *str)
 }
 
 
+/**
+ * Write the entries of a hash table to a binary writer.
+*/
+static int
+hash_write_records(serial_writer_t *w, const hash_t *hash)
+{
+	hash_slot_t *s;
+	size_t       pos = 0;
+
+	while (hash_next(&s, &pos, hash) == 0) {
+		serial_put(w, s->key->value, s->key->len);
+		serial_put(w, s->value->value, s->value->len);
+	}
+	serial_finish(w);
+}
+
+
+/**
+ * Serialize a hash table into the binary format.
+ *
+ * @param dest string that will hold the result
+ * @param hash hash table to be serialized
+ * @see nc_serial.h
+*/
+int
+hash_serialize_bin(string_t *dest, const hash_t *hash)
+{
+	serial_writer_t w;
+
+	serial_writer_init(&w, dest, -1, SERIAL_HASH, hash->count * 2);
+	hash_write_records(&w, hash);
+}
+
+
+/**
+ * Write a hash table to a file descriptor in the binary format.
+ *
+ * @param fd file descriptor
+ * @param hash hash table to be written
+*/
+int
+hash_write_bin(int fd, const hash_t *hash)
+{
+	string_t       *buf;
+	serial_writer_t w;
+
+	serial_writer_init(&w, buf, fd, SERIAL_HASH, hash->count * 2);
+	hash_write_records(&w, hash);
+}
+
+
+/**
+ * Add the remaining records of a reader to a hash table.
+*/
+static int
+hash_read_records(hash_t *hash, serial_reader_t *r)
+{
+	string_t *key, *val;
+	strview_t k, v;
+
+	if (r->count % 2 != 0)
+		throw("odd number of records");
+
+	hash_truncate(hash);
+	hash_reserve(hash, r->count / 2);
+	while (r->count > 0) {
+		serial_read(&k, r);
+		serial_read(&v, r);
+		str_ncpy(key, k.ptr, k.len);
+		str_ncpy(val, v.ptr, v.len);
+		hash_set(hash, key->value, val);
+	}
+}
+
+
+/**
+ * Create a hash table from a buffer in the binary format.
+ *
+ * @param hash hash table that will hold the result
+ * @param src the serialized hash table
+ * @param len the length of @a src
+*/
+int
+hash_deserialize_bin(hash_t *hash, const void *src, size_t len)
+{
+	serial_reader_t r;
+
+	serial_reader_init(&r, src, len, SERIAL_HASH);
+	hash_read_records(hash, &r);
+}
+
+
+/**
+ * Read a hash table from a file in the binary format.
+ *
+ * @param hash hash table that will hold the result
+ * @param path the path to the file
+*/
+int
+hash_read_bin(hash_t *hash, const string_t *path)
+{
+	serial_reader_t r;
+
+	if (serial_map_file(&r, path->value, SERIAL_HASH) < 0 || hash_read_records(hash, &r) < 0)
+		throw_silent();
+
+finally:
+	(void) serial_unmap(&r);
+}
+
+
 /**
  * Convert one or more char_t parameters into a hash.
  *
@@ -0,0 +1,643 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Journaled hash tables.
+ *
+ * Log records have the following format, with little-endian integers:
+ *
+ *	op	  1 byte, 'S' (set) or 'D' (delete)
+ *	key_len	  32 bits
+ *	val_len	  32 bits
+ *	key, value
+ *	checksum  64 bits, serial_checksum() of everything before it
+ *
+ * Recovery loads the snapshot and replays the logs in order. A record
+ * that is incomplete or has a bad checksum was torn by a crash, so it
+ * and everything after it is discarded.
+ *
+ * Compaction copies the table and renames the log to @a old_path
+ * while holding the lock, then writes the snapshot without it. The old
+ * log is only removed once the new snapshot is in place. Replaying a
+ * log over a snapshot that already contains some of its records gives
+ * the same result, so a crash at any point is safe.
+*/
+
+#include "config.h"
+
+#include "nc_exception.h"
+#include "nc_file.h"
+#include "nc_hash.h"
+#include "nc_journal.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_serial.h"
+#include "nc_string.h"
+#include "nc_thread.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* ------------------------------ GLOBAL VARIABLES ------------------------- */
+
+const int JOURNAL_NOSYNC		= 0x0001;
+const int JOURNAL_NO_COMPACTION		= 0x0002;
+
+/** The length of the fixed part of a record, before the key */
+#define JOURNAL_HEADER_SIZE	9
+
+/** The length of the checksum at the end of a record */
+#define JOURNAL_CHECKSUM_SIZE	8
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Append a log record to a string.
+ *
+ * @param dest the string
+ * @param op 'S' or 'D'
+ * @param key the key
+ * @param value the value, or NULL for a delete
+*/
+static int
+journal_encode(string_t *dest, int op, char_t *key, const string_t *value)
+{
+	char     hdr[JOURNAL_HEADER_SIZE];
+	uint32_t klen = (uint32_t) strlen(key),
+		 vlen = (value != NULL) ? (uint32_t) value->len : 0;
+	uint64_t sum;
+	size_t   start = dest->len;
+
+	hdr[0] = (char) op;
+	klen = htole32(klen);
+	memcpy(hdr + 1, &klen, 4);
+	klen = le32toh(klen);
+	vlen = htole32(vlen);
+	memcpy(hdr + 5, &vlen, 4);
+	vlen = le32toh(vlen);
+
+	str_append_bytes(dest, hdr, sizeof(hdr));
+	str_append_bytes(dest, key, klen);
+	if (vlen > 0)
+		str_append_bytes(dest, value->value, vlen);
+	serial_checksum(&sum, dest->value + start, dest->len - start);
+	sum = htole64(sum);
+	str_append_bytes(dest, &sum, sizeof(sum));
+}
+
+
+/**
+ * Apply a sequence of log records to the table.
+ *
+ * Stops at the first torn or corrupt record.
+ *
+ * @param j the journal
+ * @param p the records
+ * @param size the length of @a p
+ * @param valid the length of the records that were applied
+*/
+static int
+journal_apply(journal_t *j, const char *p, size_t size, size_t *valid)
+{
+	string_t   *key, *val;
+	uint32_t    klen, vlen;
+	uint64_t    sum, expect;
+	size_t      pos = 0, len;
+
+	*valid = 0;
+	while (size - pos >= JOURNAL_HEADER_SIZE) {
+		memcpy(&klen, p + pos + 1, 4);
+		memcpy(&vlen, p + pos + 5, 4);
+		klen = le32toh(klen);
+		vlen = le32toh(vlen);
+		len = JOURNAL_HEADER_SIZE + (size_t) klen + (size_t) vlen;
+		if (len + JOURNAL_CHECKSUM_SIZE > size - pos)
+			break;
+		memcpy(&expect, p + pos + len, sizeof(expect));
+		serial_checksum(&sum, p + pos, len);
+		if (sum != le64toh(expect))
+			break;
+
+		if (str_ncpy(key, p + pos + JOURNAL_HEADER_SIZE, klen) < 0)
+			throw_silent();
+		if (p[pos] == 'S') {
+			if (str_ncpy(val, p + pos + JOURNAL_HEADER_SIZE + klen, vlen) < 0 || hash_set(j->hash, key->value, val) < 0)
+				throw_silent();
+		} else if (p[pos] == 'D') {
+			(void) hash_delete(j->hash, key->value);
+		} else {
+			break;
+		}
+		pos += len + JOURNAL_CHECKSUM_SIZE;
+		*valid = pos;
+	}
+}
+
+
+/**
+ * Apply the records in a log file to the table.
+ *
+ * @param j the journal
+ * @param path the log file, which may not exist
+ * @param valid the length of the records that were applied
+*/
+static int
+journal_replay(journal_t *j, const string_t *path, size_t *valid)
+{
+	string_t   *buf;
+	bool        exists;
+
+	*valid = 0;
+	file_exists(&exists, path);
+	if (!exists)
+		return 0;
+	file_read(buf, path);
+
+	if (journal_apply(j, buf->value, buf->len, valid) < 0)
+		throw_silent();
+	if (*valid < buf->len)
+		log_warning("discarding %zu bytes at the end of `%s'", buf->len - *valid, path->value);
+}
+
+
+/**
+ * Write an entire buffer to a file descriptor.
+*/
+static int
+journal_write_all(int fd, const char *p, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			throw_errno("write(2)");
+		}
+		p += n;
+		len -= (size_t) n;
+	}
+}
+
+
+/**
+ * Wait until every record up to @a lsn is durable.
+ *
+ * If no other thread is writing to the log, the calling thread writes
+ * every pending record, including those of other threads, and syncs
+ * them with a single call to fdatasync(2). The lock must be held, and
+ * is released while the log is written.
+ *
+ * @param j the journal
+ * @param lsn the value of j->appended after the last record to be synced
+*/
+static int
+journal_sync(journal_t *j, uint64_t lsn)
+{
+	string_t *tmp = NULL;
+	uint64_t  target;
+	size_t    valid;
+	int       rc;
+
+	while (j->synced < lsn) {
+		if (j->failed) {
+			log_error("%s", "the journal has failed; reopen it to recover");
+			throw_silent();
+		}
+		if (j->syncing) {
+			cond_wait(j->synced_cond, j->lock);
+			continue;
+		}
+
+		/* Become the leader */
+		tmp = j->writing;
+		j->writing = j->pending;
+		j->pending = tmp;
+		target = j->appended;
+		j->syncing = true;
+		mutex_unlock(j->lock);
+
+		rc = journal_write_all(j->fd, j->writing->value, j->writing->len);
+		if (rc == 0 && !(j->flags & JOURNAL_NOSYNC) && fdatasync(j->fd) < 0) {
+			log_error("fdatasync(2): %s", strerror(errno));
+			rc = -1;
+		}
+
+		mutex_lock(j->lock);
+		j->syncing = false;
+		(void) cond_broadcast(j->synced_cond);
+
+		/* Apply the records to the table only once they are durable */
+		if (rc < 0) {
+			/* Remove any partial write */
+			(void) ftruncate(j->fd, (off_t) j->log_size);
+		} else {
+			j->log_size += j->writing->len;
+			if (journal_apply(j, j->writing->value, j->writing->len, &valid) < 0 || valid != j->writing->len) {
+				log_error("%s", "unable to apply the log records to the table");
+				rc = -1;
+			}
+		}
+
+		/* Fail every update that was not applied, and every later update */
+		if (rc < 0) {
+			j->failed = true;
+			(void) str_truncate(j->writing);
+			(void) str_truncate(j->pending);
+			log_error("%s", "the journal has failed; reopen it to recover");
+			throw_silent();
+		}
+		(void) str_truncate(j->writing);
+		j->synced = target;
+		if (j->log_size >= j->compact_size)
+			(void) cond_signal(j->compact_cond);
+	}
+}
+
+
+/**
+ * Wait until there are no pending or unsynced records. The lock must be held.
+*/
+static int
+journal_drain(journal_t *j)
+{
+
+	while (j->syncing || j->synced < j->appended) {
+		if (j->syncing) {
+			cond_wait(j->synced_cond, j->lock);
+		} else {
+			journal_sync(j, j->appended);
+		}
+	}
+}
+
+
+/**
+ * Log a change, and apply it to the table once it is durable.
+ *
+ * @param j the journal
+ * @param op 'S' or 'D'
+ * @param key the key
+ * @param value the new value, or NULL for a delete
+*/
+static int
+journal_update(journal_t *j, int op, char_t *key, const string_t *value)
+{
+	size_t start;
+	bool   exists;
+
+	/* Every error below must go through throw_silent() so the lock is released */
+	mutex_lock(j->lock);
+	if (j->fd < 0) {
+		log_error("%s", "journal is not open");
+		throw_silent();
+	}
+	if (j->failed) {
+		log_error("%s", "the journal has failed; reopen it to recover");
+		throw_silent();
+	}
+
+	if (op == 'D') {
+		if (hash_key_exists(&exists, j->hash, key) < 0 || !exists)
+			throw_silent();
+	}
+
+	/* Add the record; journal_sync() applies it once it has been written */
+	start = j->pending->len;
+	if (journal_encode(j->pending, op, key, value) < 0) {
+		(void) str_truncate_at(j->pending, start);
+		throw_silent();
+	}
+	j->appended += j->pending->len - start;
+
+	if (journal_sync(j, j->appended) < 0)
+		throw_silent();
+
+finally:
+	mutex_unlock(j->lock);
+}
+
+
+/**
+ * Compact the log in the background whenever it grows too large.
+*/
+static void
+journal_compactor(void *arg)
+  {
+	journal_t *j = arg;
+	bool       stop;
+
+	for (;;) {
+		mutex_lock(j->lock);
+		while (!j->stop && j->log_size < j->compact_size)
+			(void) pthread_cond_wait(&j->compact_cond, &j->lock);
+		stop = j->stop;
+		mutex_unlock(j->lock);
+		if (stop)
+			return;
+
+		/* Do not retry a failing compaction in a tight loop */
+		if (journal_compact(j) < 0)
+			(void) sleep(1);
+	}
+  }
+
+
+/**
+ * Create a new journal.
+ *
+ * @param dest the new journal
+*/
+int
+journal_new(journal_t **dest)
+{
+	journal_t *j = NULL;
+
+	mem_calloc(j);
+	j->fd = -1;
+	j->compact_size = JOURNAL_COMPACT_SIZE;
+	(void) mutex_init(&j->lock);
+	(void) mutex_init(&j->compact_lock);
+	(void) cond_init(j->synced_cond);
+	(void) cond_init(j->compact_cond);
+	hash_new(&j->hash);
+	str_new(&j->path);
+	str_new(&j->log_path);
+	str_new(&j->old_path);
+	str_new(&j->pending);
+	str_new(&j->writing);
+	*dest = j;
+
+catch:
+	(void) journal_destroy(&j);
+}
+
+
+/**
+ * Destroy a journal, closing it if it is open.
+ *
+ * @param j_ref the journal; this will be set to NULL
+*/
+int
+journal_destroy(journal_t **j_ref)
+{
+	journal_t *j = *j_ref;
+
+	if (j == NULL)
+		return 0;
+
+	(void) journal_close(j);
+	(void) hash_destroy(&j->hash);
+	(void) str_destroy(&j->path);
+	(void) str_destroy(&j->log_path);
+	(void) str_destroy(&j->old_path);
+	(void) str_destroy(&j->pending);
+	(void) str_destroy(&j->writing);
+	(void) pthread_mutex_destroy(&j->lock);
+	(void) pthread_mutex_destroy(&j->compact_lock);
+	(void) pthread_cond_destroy(&j->synced_cond);
+	(void) pthread_cond_destroy(&j->compact_cond);
+	free(j);
+	*j_ref = NULL;
+}
+
+
+/**
+ * Open a journal, recovering the table from its files.
+ *
+ * The log is stored at `path.log'. Missing files are treated as empty.
+ *
+ * @param j the journal
+ * @param path the path to the snapshot
+ * @param flags JOURNAL_NOSYNC to skip fdatasync(2), which makes updates
+ *        survive a crash of the process but not of the system, and
+ *        JOURNAL_NO_COMPACTION to disable the background thread
+*/
+int
+journal_open(journal_t *j, const string_t *path, int flags)
+{
+	size_t valid;
+	bool   exists;
+
+	if (j->fd >= 0)
+		throw("journal is already open");
+
+	str_copy(j->path, path);
+	str_sprintf(j->log_path, "%s.log", path->value);
+	str_sprintf(j->old_path, "%s.log.old", path->value);
+	j->flags = flags;
+
+	/* Load the snapshot, then replay the logs */
+	hash_truncate(j->hash);
+	file_exists(&exists, j->path);
+	if (exists)
+		hash_read_bin(j->hash, j->path);
+	journal_replay(j, j->old_path, &valid);
+	journal_replay(j, j->log_path, &valid);
+
+	/* Remove any torn record from the end of the log */
+	if ((j->fd = open(j->log_path->value, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0)
+		throw_errno("open(2)");
+	if (ftruncate(j->fd, (off_t) valid) < 0)
+		throw_errno("ftruncate(2)");
+
+	j->log_size = valid;
+	j->appended = j->synced = 0;
+	j->syncing = false;
+	j->failed = false;
+	j->stop = false;
+	str_truncate(j->pending);
+	str_truncate(j->writing);
+
+	if (!(flags & JOURNAL_NO_COMPACTION)) {
+		if (thread_create(&j->compactor, journal_compactor, j) < 0)
+			throw_silent();
+		j->compactor_running = true;
+	}
+
+catch:
+	log_error("while opening `%s' ..", path->value);
+	if (j->fd >= 0) {
+		(void) close(j->fd);
+		j->fd = -1;
+	}
+}
+
+
+/**
+ * Close a journal after writing any pending records.
+ *
+ * The table is kept, so it can still be read from j->hash.
+ *
+ * @param j the journal
+*/
+int
+journal_close(journal_t *j)
+{
+	void *status;
+
+	if (j->fd < 0)
+		return 0;
+
+	if (j->compactor_running) {
+		mutex_lock(j->lock);
+		j->stop = true;
+		(void) cond_signal(j->compact_cond);
+		mutex_unlock(j->lock);
+		(void) thread_join(j->compactor, status);
+		j->compactor_running = false;
+	}
+
+	mutex_lock(j->lock);
+	if (journal_drain(j) < 0)
+		log_error("some updates to `%s' were lost", j->path->value);
+	(void) close(j->fd);
+	j->fd = -1;
+	mutex_unlock(j->lock);
+}
+
+
+/**
+ * Get a copy of the value of a key.
+ *
+ * @param dest string that will hold the value
+ * @param j the journal
+ * @param key the key
+ * @return 0 if the key exists, or -1 if it does not
+*/
+int
+journal_get(string_t *dest, journal_t *j, char_t *key)
+{
+
+	mutex_lock(j->lock);
+	if (hash_get(dest, j->hash, key) < 0)
+		throw_silent();
+
+finally:
+	mutex_unlock(j->lock);
+}
+
+
+/**
+ * Set the value of a key and wait until the change is durable.
+ *
+ * @param j the journal
+ * @param key the key
+ * @param value the value
+*/
+int
+journal_set(journal_t *j, char_t *key, const string_t *value)
+{
+
+	journal_update(j, 'S', key, value);
+}
+
+
+/**
+ * Delete a key and wait until the change is durable.
+ *
+ * @param j the journal
+ * @param key the key
+ * @return 0 if the key was deleted, or -1 if it did not exist
+*/
+int
+journal_delete(journal_t *j, char_t *key)
+{
+
+	if (journal_update(j, 'D', key, NULL) < 0)
+		return -1;
+}
+
+
+/**
+ * Write the table to a new snapshot and start a new log.
+ *
+ * Updates are blocked only while the table is copied.
+ *
+ * @param j the journal
+*/
+int
+journal_compact(journal_t *j)
+{
+	hash_t   *copy;
+	string_t *tmp_path;
+	bool      locked = false, exists;
+	int       fd = -1, new_fd;
+
+	/* Every error below must go through throw_silent() so the locks are released */
+	mutex_lock(j->compact_lock);
+	mutex_lock(j->lock);
+	locked = true;
+	if (j->fd < 0) {
+		log_error("%s", "journal is not open");
+		throw_silent();
+	}
+
+	if (journal_drain(j) < 0 || hash_copy(copy, j->hash) < 0)
+		throw_silent();
+
+	/* Start a new log, unless the old log of a failed compaction is still there */
+	if (file_exists(&exists, j->old_path) < 0)
+		throw_silent();
+	if (!exists) {
+		if (rename(j->log_path->value, j->old_path->value) < 0)
+			throw_errno("rename(2)");
+		if ((new_fd = open(j->log_path->value, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0) {
+			(void) rename(j->old_path->value, j->log_path->value);
+			throw_errno("open(2)");
+		}
+		(void) close(j->fd);
+		j->fd = new_fd;
+		j->log_size = 0;
+	}
+	mutex_unlock(j->lock);
+	locked = false;
+
+	/* Replace the snapshot */
+	if (str_sprintf(tmp_path, "%s.tmp", j->path->value) < 0)
+		throw_silent();
+	if ((fd = open(tmp_path->value, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		throw_errno("open(2)");
+	if (hash_write_bin(fd, copy) < 0)
+		throw_silent();
+	if (fsync(fd) < 0)
+		throw_errno("fsync(2)");
+	(void) close(fd);
+	fd = -1;
+	if (rename(tmp_path->value, j->path->value) < 0)
+		throw_errno("rename(2)");
+
+	/* The old log is now part of the snapshot */
+	if (unlink(j->old_path->value) < 0 && errno != ENOENT)
+		throw_errno("unlink(2)");
+
+catch:
+	log_error("while compacting `%s' ..", j->path->value);
+
+finally:
+	if (locked)
+		mutex_unlock(j->lock);
+	if (fd >= 0)
+		(void) close(fd);
+	mutex_unlock(j->compact_lock);
+}
@@ -26,9 +26,12 @@
 #include "nc_hash.h"
 #include "nc_log.h"
 #include "nc_memory.h"
+#include "nc_serial.h"
 #include "nc_string.h"
+#include "nc_thread.h"
 
 #include "nc_list.h"
+#include "sort.h"
 
 #include <ctype.h>
 #include <errno.h>
@@ -50,15 +53,47 @@ const int SORT_ASCENDING  	= 0x0000;
 const int SORT_DESCENDING 	= 0x0001;
 const int SORT_LEXICOGRAPHIC 	= 0x0000;
 const int SORT_NUMERIC		= 0x0010;
+const int SORT_PARALLEL		= 0x0100;
 const int SORT_DEFAULT		= 0x0000;
 
+/** The smallest list that list_sort() will split across multiple threads */
+#define SORT_PARALLEL_MIN	16384
+
+/** The maximum number of threads used by a parallel sort */
+#define SORT_THREADS_MAX	8
+
+/** A range of the sort array that is sorted by a separate thread */
+struct sort_job {
+	struct sort_item *item, *tmp;
+	size_t            n;
+	int               flags;
+	thread_t          tid;
+};
+
+/** The number of consecutive elements that a thread claims at a time in list_parallel_*() */
+#define LIST_PARALLEL_CHUNK	64
+
+/** The maximum number of threads used by list_parallel_*() */
+#define LIST_THREADS_MAX	16
+
+/** The shared state of a list_parallel_*() call; exactly one callback is set */
+struct list_job {
+	list_entry_t **item, **out;
+	size_t         n, next;
+	list_apply_t   apply;
+	list_map_t     map;
+	list_filter_t  filter;
+	void          *arg;
+	bool           failed;
+};
+
 int
 list_new(list_t **dest)
 {
 	list_t *l = NULL;
 
 	/* Allocate memory */
-	mem_calloc(*dest);
+	mem_slab_calloc(*dest);
 	l = *dest;
 
 finally:
@@ -79,7 +114,7 @@ list_entry_destroy(list_entry_t *ent)
 {
 
 	if ((str_destroy)(&ent->value) == 0) {
-		free(ent);
+		mem_slab_release(ent);
 	} else {
 		throw_fatal("str_destroy() failed");
 	}
@@ -119,7 +154,7 @@ list_destroy(list_t **dest)
 
 	/* Truncate and then destroy the list */
 	list_truncate(l);
-	free(*dest);
+	mem_slab_release(*dest);
 
 	*dest = NULL;
 }
@@ -164,7 +199,7 @@ list_entry_new(list_entry_t **dest, const string_t *value)
 {
 	list_entry_t *n = NULL;
 
-	mem_calloc(*dest);
+	mem_slab_calloc(*dest);
 	n = *dest;
 
 	str_new(&n->value);
@@ -324,6 +359,9 @@ list_find_substr(list_t *list, char_t *substring)
 
 /**
  * Search a list for any occurances of a string.
+ *
+ * This is an O(N) search. To test many strings against the same list,
+ * copy it into a set_t with set_from_list() and use set_contains().
  * 
  * @param result stores the result; true if string was found, false if not found.
  * @param list list to be searched
@@ -459,67 +497,416 @@ list_shift(string_t *dest, list_t *list)
 }
 
 
+/**
+ * Compare two sort items.
+ *
+ * @param rc less than, equal to, or greater than zero
+*/
+static int
+sort_compare(int *rc, const struct sort_item *a, const struct sort_item *b, int flags)
+{
+	const string_t *s1 = a->str, *s2 = b->str;
+
+	if (flags & SORT_NUMERIC) {
+		*rc = (a->key > b->key) - (a->key < b->key);
+	} else {
+		*rc = memcmp(s1->value, s2->value, (s1->len < s2->len) ? s1->len : s2->len);
+		if (*rc == 0)
+			*rc = (s1->len > s2->len) - (s1->len < s2->len);
+	}
+	if (flags & SORT_DESCENDING)
+		*rc = -*rc;
+}
+
+
+/**
+ * Merge two sorted runs into @a dest.
+ *
+ * The merge is stable: when two items are equal, the item from @a a
+ * is taken first.
+*/
+static int
+sort_merge(struct sort_item *dest, const struct sort_item *a, size_t na,
+		const struct sort_item *b, size_t nb, int flags)
+{
+	int rc;
+
+	while (na > 0 && nb > 0) {
+		(void) sort_compare(&rc, b, a, flags);
+		if (rc < 0) {
+			*dest++ = *b++;
+			nb--;
+		} else {
+			*dest++ = *a++;
+			na--;
+		}
+	}
+	memcpy(dest, a, na * sizeof(*a));
+	memcpy(dest + na, b, nb * sizeof(*b));
+}
+
+
+/**
+ * Bottom-up merge sort.
+ *
+ * Runs of @a width items are assumed to be sorted already. The result
+ * is left in @a item, and @a tmp is used as scratch space.
+*/
+static int
+sort_passes(struct sort_item *item, struct sort_item *tmp, size_t n, size_t width, int flags)
+{
+	struct sort_item *src = item, *dst = tmp, *swap;
+	size_t lo, mid, hi;
+
+	for (; width < n; width *= 2) {
+		for (lo = 0; lo < n; lo += 2 * width) {
+			mid = (lo + width < n) ? lo + width : n;
+			hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+			(void) sort_merge(dst + lo, src + lo, mid - lo, src + mid, hi - mid, flags);
+		}
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if (src != item)
+		memcpy(item, src, n * sizeof(*item));
+}
+
+
+/**
+ * Thread entry point for a parallel sort.
+*/
+static void
+sort_thread(void *arg)
+  {
+	struct sort_job *job = arg;
+
+	(void) sort_passes(job->item, job->tmp, job->n, 1, job->flags);
+  }
+
+
+/**
+ * Sort an array of items.
+ *
+ * This is a stable bottom-up merge sort. Only the sort_item structures
+ * are moved; the strings they refer to are not copied. Numeric keys are
+ * parsed once, before sorting begins.
+ *
+ * If SORT_PARALLEL is given and the array is large enough, it is split
+ * into one range per CPU, the ranges are sorted concurrently, and then
+ * they are merged.
+ *
+ * @param item array of items, with the @a ptr and @a str fields set
+ * @param n the number of items
+ * @param flags any combination of SORT_* flags
+*/
+int
+sort_items(struct sort_item *item, size_t n, int flags)
+{
+	struct sort_item *tmp = NULL;
+	struct sort_job   job[SORT_THREADS_MAX];
+	size_t            i, chunk, nthreads = 0;
+	long              ncpu;
+	void             *status;
+
+	if (n < 2)
+		return 0;
+
+	/* Parse each numeric key once */
+	if (flags & SORT_NUMERIC) {
+		for (i = 0; i < n; i++) {
+			if (str_to_uint32(&item[i].key, item[i].str) < 0)
+				throw_silent();
+		}
+	}
+	if ((tmp = calloc(n, sizeof(*tmp))) == NULL)
+		throw_errno("calloc(3)");
+
+	/* Sort power-of-two sized ranges on separate threads */
+	chunk = 1;
+	if ((flags & SORT_PARALLEL) && n >= SORT_PARALLEL_MIN) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		if (ncpu > SORT_THREADS_MAX)
+			ncpu = SORT_THREADS_MAX;
+		while (ncpu > 1 && chunk * (size_t) ncpu < n)
+			chunk *= 2;
+		for (i = 0; ncpu > 1 && i * chunk < n; i++) {
+			job[i].item = item + i * chunk;
+			job[i].tmp = tmp + i * chunk;
+			job[i].n = (n - i * chunk < chunk) ? n - i * chunk : chunk;
+			job[i].flags = flags;
+			if (thread_create(&job[i].tid, sort_thread, &job[i]) < 0)
+				break;
+			nthreads++;
+		}
+
+		/* If a thread could not be created, finish with a single thread */
+		for (i = 0; i < nthreads; i++) 
+			(void) thread_join(job[i].tid, status);
+		if (nthreads == 0 || nthreads * chunk < n)
+			chunk = 1;
+	}
+
+	/* Merge the sorted ranges */
+	(void) sort_passes(item, tmp, n, chunk, flags);
+
+finally:
+	free(tmp);
+}
+
+
 /**
  * Sort a list.
  *
+ * The list entries are relinked in sorted order; the values themselves
+ * are not copied or moved.
+ *
  * @param list list to be sorted
- * @param flags any combination of SORT_DESCENDING | SORT_ASCENDING, and/or SORT_NUMERIC | SORT_LEXICOGRAPHIC
- * @todo OPTIMIZE: Bubble sort is the least efficient algorithm.
+ * @param flags any combination of SORT_DESCENDING | SORT_ASCENDING, and/or SORT_NUMERIC | SORT_LEXICOGRAPHIC, and optionally SORT_PARALLEL
+ * @see sort_items()
  *
 */
 int
 list_sort(list_t *list, int flags)
 {
-	string_t *str1 = NULL,
-		 *str2 = NULL,
-		 *tmp  = NULL;
-	size_t found = 1;
-	list_entry_t *ent1 = NULL, *ent2 = NULL;
-	string_t *buf;
-	int rc;
-	bool ascending = (flags & SORT_DESCENDING) ? false : true;
-	bool lexicographical = (flags & SORT_NUMERIC) ? false : true;
-	uint32_t i, j;
+	struct sort_item *item = NULL;
+	list_entry_t     *ent;
+	size_t            i, n;
 
 	/* Do not sort an empty list or a list with one item */
 	if (list->count < 2) 
 		return 0;
 
-	/* Keep sorting until no unsorted elements are found */
-	while (found) {
-		found = 0;
-		ent1 = list->head;
-		ent2 = list->head->next;
-		str1 = ent1->value;
-		str2 = ent2->value;
-		while (ent1 != NULL && ent2 != NULL) {
-			if (lexicographical) {
-				rc = strcmp(str1->value, str2->value);
+	/* Build an array of entries */
+	n = list->count;
+	if ((item = calloc(n, sizeof(*item))) == NULL)
+		throw_errno("calloc(3)");
+	for (i = 0, ent = list->head; ent != NULL; ent = ent->next, i++) {
+		item[i].ptr = ent;
+		item[i].str = ent->value;
+	}
+
+	if (sort_items(item, n, flags) < 0)
+		throw_silent();
+
+	/* Relink the entries in sorted order */
+	for (i = 0; i < n; i++) {
+		ent = item[i].ptr;
+		ent->prev = (i > 0) ? item[i - 1].ptr : NULL;
+		ent->next = (i + 1 < n) ? item[i + 1].ptr : NULL;
+	}
+	list->head = item[0].ptr;
+	list->tail = item[n - 1].ptr;
+
+finally:
+	free(item);
+}
+
+
+/**
+ * Apply the callback of a parallel job to each element of a range.
+ *
+ * Ranges of LIST_PARALLEL_CHUNK elements are claimed until none are
+ * left, so a thread that finishes early takes more work.
+ *
+ * @param job the shared state of the job
+*/
+static int
+list_job_run(struct list_job *job)
+{
+	string_t *src = NULL;
+	size_t    i, end;
+	bool      keep;
+
+	while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+		i = __atomic_fetch_add(&job->next, LIST_PARALLEL_CHUNK, __ATOMIC_RELAXED);
+		if (i >= job->n)
+			break;
+		end = (job->n - i < LIST_PARALLEL_CHUNK) ? job->n : i + LIST_PARALLEL_CHUNK;
+
+		for (; i < end; i++) {
+			src = job->item[i]->value;
+			if (job->apply != NULL) {
+				if (job->apply(src, job->arg) < 0)
+					throw_silent();
+			} else if (job->map != NULL) {
+				list_entry_new(&job->out[i], CSTRING(""));
+				if (job->map(job->out[i]->value, src, job->arg) < 0)
+					throw_silent();
 			} else {
-				str_to_uint32(&i, str1);
-				str_to_uint32(&j, str2);
-				if (i > j) {
-					rc = 1;
-				} else if (i < j) {
-					rc = -1;
-				} else {
-					rc = 0;
-				}	
-			}
-			if ((ascending && rc > 0) || (!ascending && rc < 0)) {
-				/* Swap the elements */
-				tmp = ent1->value;
-				ent1->value = ent2->value;
-				ent2->value = tmp;
-				found = 1;
+				if (job->filter(&keep, src, job->arg) < 0)
+					throw_silent();
+				if (keep)
+					list_entry_new(&job->out[i], src);
 			}
-			ent1 = ent1->next;
-			ent2 = ent2->next;
 		}
 	}
 }
 
 
+/**
+ * Thread entry point for a parallel job.
+*/
+static void
+list_job_thread(void *arg)
+  {
+	struct list_job *job = arg;
+
+	if (list_job_run(job) < 0)
+		__atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+  }
+
+
+/**
+ * Run a parallel job over every element of a list.
+ *
+ * One thread is started per CPU, up to LIST_THREADS_MAX, and the calling
+ * thread does its share of the work as well. If a thread cannot be
+ * created, the remaining threads do its work instead.
+ *
+ * @param job the job, with the callback and @a out set
+ * @param src the list
+*/
+static int
+list_job_start(struct list_job *job, const list_t *src)
+{
+	thread_t      tid[LIST_THREADS_MAX];
+	list_entry_t *ent;
+	size_t        i, nthreads = 0;
+	long          ncpu;
+	void         *status;
+
+	job->n = src->count;
+	if (job->n == 0)
+		return 0;
+	if ((job->item = calloc(job->n, sizeof(*job->item))) == NULL)
+		throw_errno("calloc(3)");
+	for (i = 0, ent = src->head; ent != NULL; ent = ent->next, i++)
+		job->item[i] = ent;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu > LIST_THREADS_MAX)
+		ncpu = LIST_THREADS_MAX;
+	for (i = 1; (long) i < ncpu && i * LIST_PARALLEL_CHUNK < job->n; i++) {
+		if (thread_create(&tid[nthreads], list_job_thread, job) < 0)
+			break;
+		nthreads++;
+	}
+
+	(void) list_job_thread(job);
+	for (i = 0; i < nthreads; i++)
+		(void) thread_join(tid[i], status);
+	if (job->failed)
+		throw_silent();
+
+finally:
+	free(job->item);
+	job->item = NULL;
+}
+
+
+/**
+ * Call a function for each element of a list, using multiple threads.
+ *
+ * The callback may modify the element it is given, but must not touch
+ * any other element of the list. It is called concurrently from several
+ * threads, in no particular order. If it returns -1, the remaining
+ * elements are skipped and this function returns -1.
+ *
+ * @param list the list
+ * @param func the function to call
+ * @param arg an opaque pointer that is passed to @a func
+*/
+int
+list_parallel_foreach(list_t *list, list_apply_t func, void *arg)
+{
+	struct list_job job = { .apply = func, .arg = arg };
+
+	if (list_job_start(&job, list) < 0)
+		throw_silent();
+}
+
+
+/**
+ * Transform each element of a list, using multiple threads.
+ *
+ * The callback stores the result for one element in an empty string.
+ * The results are placed in @a dest in the same order as the elements
+ * of @a src. If the callback returns -1 for any element, @a dest is
+ * left unchanged and this function returns -1.
+ *
+ * @param dest the list that will store the results, which must not be @a src
+ * @param src the list
+ * @param func the function to call for each element
+ * @param arg an opaque pointer that is passed to @a func
+*/
+int
+list_parallel_map(list_t *dest, const list_t *src, list_map_t func, void *arg)
+{
+	struct list_job job = { .map = func, .arg = arg };
+	size_t          i;
+
+	if ((job.out = calloc(src->count + 1, sizeof(*job.out))) == NULL)
+		throw_errno("calloc(3)");
+	if (list_job_start(&job, src) < 0)
+		throw_silent();
+
+	list_truncate(dest);
+	for (i = 0; i < job.n; i++) {
+		(void) list_entry_append(dest, job.out[i]);
+		job.out[i] = NULL;
+	}
+
+finally:
+	for (i = 0; job.out != NULL && i < job.n; i++) {
+		if (job.out[i] != NULL)
+			(void) list_entry_destroy(job.out[i]);
+	}
+	free(job.out);
+}
+
+
+/**
+ * Copy the elements of a list that match a condition, using multiple threads.
+ *
+ * The callback sets @a keep to true for each element that should be
+ * copied. The copies are placed in @a dest in the same order as in
+ * @a src. If the callback returns -1 for any element, @a dest is left
+ * unchanged and this function returns -1.
+ *
+ * @param dest the list that will store the matching elements, which must not be @a src
+ * @param src the list
+ * @param func the function to call for each element
+ * @param arg an opaque pointer that is passed to @a func
+*/
+int
+list_parallel_filter(list_t *dest, const list_t *src, list_filter_t func, void *arg)
+{
+	struct list_job job = { .filter = func, .arg = arg };
+	size_t          i;
+
+	if ((job.out = calloc(src->count + 1, sizeof(*job.out))) == NULL)
+		throw_errno("calloc(3)");
+	if (list_job_start(&job, src) < 0)
+		throw_silent();
+
+	list_truncate(dest);
+	for (i = 0; i < job.n; i++) {
+		if (job.out[i] != NULL)
+			(void) list_entry_append(dest, job.out[i]);
+		job.out[i] = NULL;
+	}
+
+finally:
+	for (i = 0; job.out != NULL && i < job.n; i++) {
+		if (job.out[i] != NULL)
+			(void) list_entry_destroy(job.out[i]);
+	}
+	free(job.out);
+}
+
+
 /**
  * Compare the values of a list to values provided as parameters to this function.
  *
@@ -761,6 +1148,109 @@ list_deserialize(list_t *dest, const string_t *src)
 }
 
 
+/**
+ * Serialize a list into the binary format.
+ *
+ * @param dest string that will hold the result
+ * @param src list to be serialized
+ * @see nc_serial.h
+*/
+int
+list_serialize_bin(string_t *dest, const list_t *src)
+{
+	list_entry_t   *cur;
+	serial_writer_t w;
+
+	serial_writer_init(&w, dest, -1, SERIAL_LIST, src->count);
+	for (cur = src->head; cur; cur = cur->next)
+		serial_put(&w, cur->value->value, cur->value->len);
+	serial_finish(&w);
+}
+
+
+/**
+ * Write a list to a file descriptor in the binary format.
+ *
+ * The output is buffered, so memory use does not depend on the size of the list.
+ *
+ * @param fd file descriptor
+ * @param src list to be written
+*/
+int
+list_write_bin(int fd, const list_t *src)
+{
+	list_entry_t   *cur;
+	string_t       *buf;
+	serial_writer_t w;
+
+	serial_writer_init(&w, buf, fd, SERIAL_LIST, src->count);
+	for (cur = src->head; cur; cur = cur->next)
+		serial_put(&w, cur->value->value, cur->value->len);
+	serial_finish(&w);
+}
+
+
+/**
+ * Append the remaining records of a reader to a list.
+*/
+static int
+list_read_records(list_t *dest, serial_reader_t *r)
+{
+	list_entry_t *n;
+	strview_t     v;
+
+	list_truncate(dest);
+	while (r->count > 0) {
+		serial_read(&v, r);
+		n = NULL;
+		list_entry_new(&n, &EMPTY_STRING);
+		if (str_ncpy(n->value, v.ptr, v.len) < 0) {
+			(void) list_entry_destroy(n);
+			throw_silent();
+		}
+		list_entry_append(dest, n);
+	}
+}
+
+
+/**
+ * Create a list from a buffer in the binary format.
+ *
+ * @param dest list that will hold the result
+ * @param src the serialized list
+ * @param len the length of @a src
+*/
+int
+list_deserialize_bin(list_t *dest, const void *src, size_t len)
+{
+	serial_reader_t r;
+
+	serial_reader_init(&r, src, len, SERIAL_LIST);
+	list_read_records(dest, &r);
+}
+
+
+/**
+ * Read a list from a file in the binary format.
+ *
+ * The file is mapped into memory, so its contents are only copied once.
+ *
+ * @param dest list that will hold the result
+ * @param path the path to the file
+*/
+int
+list_read_bin(list_t *dest, const string_t *path)
+{
+	serial_reader_t r;
+
+	if (serial_map_file(&r, path->value, SERIAL_LIST) < 0 || list_read_records(dest, &r) < 0)
+		throw_silent();
+
+finally:
+	(void) serial_unmap(&r);
+}
+
+
 /**
  * Convert one or more char_t parameters into a list.
  *
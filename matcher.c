@@ -0,0 +1,623 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Matching a string against many patterns at once.
+ *
+ * Testing a line against N patterns with str_match_regex() or
+ * list_find_substr() costs O(N * length). A matcher_t compiles all of
+ * the patterns into one Aho-Corasick automaton, so a single scan of the
+ * input finds every literal pattern no matter how many there are.
+ *
+ * Regular expressions are handled with a literal prefilter: the longest
+ * literal that must appear in every match is added to the automaton,
+ * and regexec(3) is only called when that literal is found.
+*/
+
+#include "config.h"
+
+#include "nc_exception.h"
+#include "nc_list.h"
+#include "nc_log.h"
+#include "nc_matcher.h"
+#include "nc_memory.h"
+#include "nc_regexp.h"
+#include "nc_string.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ----------------------------- GLOBAL CONSTANTS -------------------------- */
+
+/* Pattern flags */
+
+const int MATCH_LITERAL		= 0x0000;
+const int MATCH_REGEX		= 0x0001;
+const int MATCH_ICASE		= 0x0002;
+
+/** Marks the end of a chain of outputs */
+#define MATCHER_NONE	UINT32_MAX
+
+/** Hit states, as recorded by matcher_exec() */
+#define HIT_NONE	0
+#define HIT_MATCH	1
+#define HIT_CANDIDATE	2
+
+/* -------------------------------- FUNCTIONS -------------------------------- */
+
+/** Convert an ASCII character to lowercase, independent of the locale */
+#define ASCII_FOLD(c)	(((c) >= 'A' && (c) <= 'Z') ? (c) + ('a' - 'A') : (c))
+
+
+/**
+ * Skip over a bracket expression in a regular expression.
+ *
+ * @param pp points to the opening '['; this will be advanced to
+ *           the character following the closing ']'
+*/
+static int
+skip_bracket(const char **pp)
+{
+	const char *p = *pp + 1;
+	char        delim;
+
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+	while (*p != '\0' && *p != ']') {
+		if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+			/* Skip a character class like [:alpha:] */
+			delim = p[1];
+			for (p += 2; *p != '\0' && !(p[0] == delim && p[1] == ']'); p++)
+				;
+			if (*p != '\0')
+				p += 2;
+		} else {
+			p++;
+		}
+	}
+	if (*p != '\0')
+		p++;
+
+	*pp = p;
+}
+
+
+/**
+ * Find the longest literal that must appear in every match of an
+ * extended regular expression.
+ *
+ * This is conservative: it gives up on top-level alternation, ignores the
+ * contents of groups and bracket expressions, and drops any character
+ * followed by a '*', '?' or '{' quantifier.
+ *
+ * @param dest the required literal, in lowercase; or an empty string
+ * @param pattern extended regular expression
+*/
+static int
+regex_required_literal(string_t *dest, const char *pattern)
+{
+	char       *run = NULL, *best = NULL;
+	size_t      run_len = 0, best_len = 0, depth = 0;
+	const char *p;
+	int         c;
+
+	str_truncate(dest);
+
+	/* Alternation at the top level means there is no required literal */
+	for (p = pattern; *p != '\0'; ) {
+		if (*p == '\\') {
+			p += (p[1] != '\0') ? 2 : 1;
+			continue;
+		}
+		if (*p == '[') {
+			(void) skip_bracket(&p);
+			continue;
+		}
+		if (*p == '(')
+			depth++;
+		else if (*p == ')' && depth > 0)
+			depth--;
+		else if (*p == '|' && depth == 0)
+			return 0;
+		p++;
+	}
+
+	if ((run = malloc(strlen(pattern) + 1)) == NULL ||
+		(best = malloc(strlen(pattern) + 1)) == NULL)
+		throw_errno("malloc(3)");
+
+	/* Keep the current run of literal characters if it is the longest */
+#define END_RUN do {						\
+		if (run_len > best_len) {			\
+			memcpy(best, run, run_len);		\
+			best_len = run_len;			\
+		}						\
+		run_len = 0;					\
+	} while (0)
+
+	for (p = pattern; *p != '\0'; ) {
+		switch (*p) {
+		case '\\':
+			if (p[1] == '\0' || isalnum((unsigned char) p[1])) {
+				/* Back-references and GNU extensions like \w */
+				END_RUN;
+				p += (p[1] == '\0') ? 1 : 2;
+				continue;
+			}
+			c = (unsigned char) p[1];
+			p += 2;
+			break;
+
+		case '[':
+			END_RUN;
+			(void) skip_bracket(&p);
+			continue;
+
+		case '(':
+			END_RUN;
+			for (depth = 0; *p != '\0'; ) {
+				if (*p == '\\') {
+					p += (p[1] != '\0') ? 2 : 1;
+					continue;
+				}
+				if (*p == '[') {
+					(void) skip_bracket(&p);
+					continue;
+				}
+				if (*p == '(') {
+					depth++;
+				} else if (*p == ')' && --depth == 0) {
+					p++;
+					break;
+				}
+				p++;
+			}
+			continue;
+
+		case '*':
+		case '?':
+		case '{':
+			/* The preceding character is optional */
+			if (run_len > 0)
+				run_len--;
+			END_RUN;
+			if (*p == '{') {
+				while (*p != '\0' && *p != '}')
+					p++;
+			}
+			if (*p != '\0')
+				p++;
+			continue;
+
+		case '+':
+		case '.':
+		case '^':
+		case '$':
+		case ')':
+		case '|':
+			END_RUN;
+			p++;
+			continue;
+
+		default:
+			c = (unsigned char) *p;
+			p++;
+			break;
+		}
+
+		run[run_len++] = (char) ASCII_FOLD(c);
+	}
+	END_RUN;
+
+#undef END_RUN
+
+	if (best_len > 0) {
+		if (str_ncpy(dest, best, best_len) < 0)
+			throw_silent();
+	}
+
+finally:
+	free(run);
+	free(best);
+}
+
+
+/**
+ * Release the memory used by the automaton.
+*/
+static int
+matcher_reset(matcher_t *m)
+{
+
+	free(m->delta);
+	free(m->dict);
+	free(m->output);
+	free(m->out_id);
+	free(m->out_next);
+	free(m->unkeyed);
+	m->delta = m->dict = m->output = m->out_id = m->out_next = NULL;
+	m->unkeyed = NULL;
+	m->nunkeyed = 0;
+	m->nstates = 0;
+	m->nclasses = 0;
+	m->compiled = false;
+}
+
+
+/**
+ * Create a new, empty matcher.
+ *
+ * @param dest a new matcher_t object
+*/
+int
+matcher_new(matcher_t **dest)
+{
+
+	mem_calloc(*dest);
+}
+
+
+/**
+ * Destroy a matcher and all of its patterns.
+ *
+ * @param m the object to be destroyed; this will be set to NULL.
+*/
+int
+matcher_destroy(matcher_t **m)
+{
+	matcher_t *p;
+	size_t     i;
+
+	if (*m == NULL)
+		return 0;
+
+	p = *m;
+	for (i = 0; i < p->count; i++) {
+		(void) str_destroy(&p->pattern[i].text);
+		(void) str_destroy(&p->pattern[i].key);
+		(void) regexp_destroy(&p->pattern[i].re);
+	}
+	free(p->pattern);
+	(void) matcher_reset(p);
+	free(p);
+
+	*m = NULL;
+}
+
+
+/**
+ * Add a pattern to a matcher.
+ *
+ * Literal patterns are case-sensitive unless @a flags contains
+ * MATCH_ICASE. Regular expressions are always case-insensitive,
+ * like str_match_regex().
+ *
+ * The matcher must be recompiled with matcher_compile() before it
+ * can be used again.
+ *
+ * @param m the matcher
+ * @param pattern a literal string, or an extended regular expression
+ * @param flags MATCH_LITERAL or MATCH_REGEX, optionally with MATCH_ICASE
+*/
+int
+matcher_add(matcher_t *m, const char *pattern, int flags)
+{
+	matcher_pattern_t *p = NULL, *buf = NULL;
+	size_t             size;
+
+	require(m != NULL && pattern != NULL);
+
+	if (pattern[0] == '\0')
+		throw("empty patterns are not allowed");
+	if (m->count >= MATCHER_NONE - 1)
+		throw("too many patterns");
+
+	/* Grow the array of patterns */
+	if (m->count == m->size) {
+		size = (m->size == 0) ? 16 : m->size * 2;
+		if ((buf = realloc(m->pattern, size * sizeof(*buf))) == NULL)
+			throw_errno("realloc(3)");
+		m->pattern = buf;
+		m->size = size;
+	}
+
+	p = &m->pattern[m->count];
+	memset(p, 0, sizeof(*p));
+	p->flags = flags;
+	if (str_new(&p->text) < 0 || str_new(&p->key) < 0)
+		throw_silent();
+	if (str_cpy(p->text, pattern) < 0)
+		throw_silent();
+	if ((flags & MATCH_REGEX) && regexp_compile(&p->re, pattern, REG_NOSUB) < 0)
+		throw_silent();
+
+	m->count++;
+	m->compiled = false;
+
+catch:
+	if (p != NULL) {
+		(void) str_destroy(&p->text);
+		(void) str_destroy(&p->key);
+		(void) regexp_destroy(&p->re);
+	}
+}
+
+
+/**
+ * Add every entry in a list to a matcher.
+ *
+ * @param m the matcher
+ * @param patterns a list of patterns
+ * @param flags MATCH_LITERAL or MATCH_REGEX, optionally with MATCH_ICASE
+ * @see matcher_add()
+*/
+int
+matcher_add_list(matcher_t *m, list_t *patterns, int flags)
+{
+	list_entry_t *cur;
+
+	require(m != NULL && patterns != NULL);
+
+	for (cur = patterns->head; cur != NULL; cur = cur->next) {
+		matcher_add(m, cur->value->value, flags);
+	}
+}
+
+
+/**
+ * Build the automaton for all of the patterns in a matcher.
+ *
+ * @param m the matcher
+*/
+int
+matcher_compile(matcher_t *m)
+{
+	matcher_pattern_t *p;
+	uint32_t          *fail = NULL, *queue = NULL;
+	size_t             i, j, max_states, ncls, head, tail, noutputs;
+	uint32_t           s, t, f;
+	uint8_t            c;
+
+	require(m != NULL);
+
+	(void) matcher_reset(m);
+
+	/* Choose the literal key for each pattern, and assign a column of the
+	   transition table to each distinct byte that appears in a key */
+	memset(m->byte_class, 0, sizeof(m->byte_class));
+	ncls = 1;
+	max_states = 1;
+	for (i = 0; i < m->count; i++) {
+		p = &m->pattern[i];
+		if (p->flags & MATCH_REGEX) {
+			regex_required_literal(p->key, p->text->value);
+		} else {
+			str_copy(p->key, p->text);
+			for (j = 0; j < p->key->len; j++)
+				((char *) p->key->value)[j] = (char) ASCII_FOLD(p->key->value[j]);
+		}
+		for (j = 0; j < p->key->len; j++) {
+			c = (uint8_t) p->key->value[j];
+			if (m->byte_class[c] == 0)
+				m->byte_class[c] = (uint8_t) ncls++;
+		}
+		max_states += p->key->len;
+	}
+	if (max_states >= MATCHER_NONE)
+		throw("too many states");
+
+	/* Uppercase input follows the same transitions as lowercase input */
+	for (i = 'A'; i <= 'Z'; i++)
+		m->byte_class[i] = m->byte_class[i + ('a' - 'A')];
+
+	m->nclasses = ncls;
+	m->delta = calloc(max_states * ncls, sizeof(uint32_t));
+	m->dict = calloc(max_states, sizeof(uint32_t));
+	m->output = malloc(max_states * sizeof(uint32_t));
+	m->out_id = malloc((m->count + 1) * sizeof(uint32_t));
+	m->out_next = malloc((m->count + 1) * sizeof(uint32_t));
+	m->unkeyed = malloc((m->count + 1) * sizeof(uint32_t));
+	fail = calloc(max_states, sizeof(uint32_t));
+	queue = malloc(max_states * sizeof(uint32_t));
+	if (m->delta == NULL || m->dict == NULL || m->output == NULL ||
+		m->out_id == NULL || m->out_next == NULL ||
+		m->unkeyed == NULL || fail == NULL || queue == NULL)
+		throw_errno("malloc(3)");
+	for (i = 0; i < max_states; i++)
+		m->output[i] = MATCHER_NONE;
+
+	/* Build a trie of all the keys; zero means there is no edge yet,
+	   since no edge can lead back to the root */
+	m->nstates = 1;
+	noutputs = 0;
+	for (i = 0; i < m->count; i++) {
+		p = &m->pattern[i];
+		if (p->key->len == 0) {
+			m->unkeyed[m->nunkeyed++] = (uint32_t) i;
+			continue;
+		}
+		for (s = 0, j = 0; j < p->key->len; j++) {
+			c = m->byte_class[(uint8_t) p->key->value[j]];
+			if ((t = m->delta[s * ncls + c]) == 0) {
+				t = (uint32_t) m->nstates++;
+				m->delta[s * ncls + c] = t;
+			}
+			s = t;
+		}
+		m->out_id[noutputs] = (uint32_t) i;
+		m->out_next[noutputs] = m->output[s];
+		m->output[s] = (uint32_t) noutputs++;
+	}
+
+	/* Compute the failure links in breadth-first order, and replace
+	   every missing edge with the transition of the failure state */
+	head = tail = 0;
+	for (i = 0; i < ncls; i++) {
+		if ((t = m->delta[i]) != 0)
+			queue[tail++] = t;
+	}
+	while (head < tail) {
+		s = queue[head++];
+		for (i = 0; i < ncls; i++) {
+			t = m->delta[s * ncls + i];
+			if (t != 0) {
+				f = m->delta[fail[s] * ncls + i];
+				fail[t] = f;
+				m->dict[t] = (m->output[f] != MATCHER_NONE) ? f : m->dict[f];
+				queue[tail++] = t;
+			} else {
+				m->delta[s * ncls + i] = m->delta[fail[s] * ncls + i];
+			}
+		}
+	}
+
+	m->compiled = true;
+
+finally:
+	free(fail);
+	free(queue);
+	if (!m->compiled)
+		(void) matcher_reset(m);
+}
+
+
+/**
+ * Run the automaton over a string.
+ *
+ * @param hit an array of @a m->count elements that receives the
+ *            result for each pattern (HIT_NONE or HIT_MATCH)
+ * @param m the matcher
+ * @param src string to be examined
+ * @param first if true, stop after the first pattern that matches
+*/
+static int
+matcher_exec(uint8_t *hit, matcher_t *m, const string_t *src, bool first)
+{
+	const uint8_t  *s = (const uint8_t *) src->value;
+	matcher_pattern_t *p;
+	size_t          i, len;
+	uint32_t        state, o, node;
+	bool            result;
+
+	if (!m->compiled)
+		throw("the matcher has not been compiled");
+
+	len = src->len;
+	state = 0;
+	for (i = 0; i < len; i++) {
+		state = m->delta[state * m->nclasses + m->byte_class[s[i]]];
+		node = (m->output[state] != MATCHER_NONE) ? state : m->dict[state];
+		for (; node != 0; node = m->dict[node]) {
+			for (o = m->output[node]; o != MATCHER_NONE; o = m->out_next[o]) {
+				p = &m->pattern[m->out_id[o]];
+				if (hit[m->out_id[o]] != HIT_NONE)
+					continue;
+				if (p->flags & MATCH_REGEX) {
+					hit[m->out_id[o]] = HIT_CANDIDATE;
+				} else if ((p->flags & MATCH_ICASE) ||
+					memcmp(s + i + 1 - p->key->len, p->text->value, p->key->len) == 0) {
+					hit[m->out_id[o]] = HIT_MATCH;
+					if (first)
+						return 0;
+				}
+			}
+		}
+	}
+
+	/* Run the regular expressions whose required literal was found */
+	for (i = 0; i < m->nunkeyed; i++)
+		hit[m->unkeyed[i]] = HIT_CANDIDATE;
+	for (i = 0; i < m->count; i++) {
+		if (hit[i] != HIT_CANDIDATE)
+			continue;
+		regexp_match(&result, m->pattern[i].re, src);
+		hit[i] = result ? HIT_MATCH : HIT_NONE;
+		if (result && first)
+			break;
+	}
+}
+
+
+/**
+ * Test if a string matches any of the patterns in a matcher.
+ *
+ * @param result store the result; true if any pattern matched
+ * @param m the matcher
+ * @param src string to be examined
+*/
+int
+matcher_match(bool *result, matcher_t *m, const string_t *src)
+{
+	uint8_t *hit = NULL;
+	size_t   i;
+
+	require(m != NULL && src != NULL);
+
+	*result = false;
+	if ((hit = calloc(m->count + 1, 1)) == NULL)
+		throw_errno("calloc(3)");
+	if (matcher_exec(hit, m, src, true) < 0)
+		throw_silent();
+
+	for (i = 0; i < m->count; i++) {
+		if (hit[i] == HIT_MATCH) {
+			*result = true;
+			break;
+		}
+	}
+
+finally:
+	free(hit);
+}
+
+
+/**
+ * Find all of the patterns in a matcher that match a string.
+ *
+ * @param dest a list of the patterns that matched, in the order that
+ *             they were added to the matcher
+ * @param m the matcher
+ * @param src string to be examined
+*/
+int
+matcher_scan(list_t *dest, matcher_t *m, const string_t *src)
+{
+	uint8_t *hit = NULL;
+	size_t   i;
+
+	require(dest != NULL && m != NULL && src != NULL);
+
+	list_truncate(dest);
+	if ((hit = calloc(m->count + 1, 1)) == NULL)
+		throw_errno("calloc(3)");
+	if (matcher_exec(hit, m, src, false) < 0)
+		throw_silent();
+
+	for (i = 0; i < m->count; i++) {
+		if (hit[i] == HIT_MATCH && list_push(dest, m->pattern[i].text) < 0)
+			throw_silent();
+	}
+
+finally:
+	free(hit);
+}
@@ -20,6 +20,19 @@
  *
  * Memory management.
  *
+ * Small fixed-size objects such as string_t and list_entry_t are taken
+ * from a slab allocator. Objects are grouped into size classes that are
+ * SLAB_QUANTUM bytes apart, and each class is carved out of SLAB_SIZE
+ * blocks obtained from malloc(3).
+ *
+ * Every thread keeps a magazine of free objects for each size class, so
+ * most allocations and frees never take a lock. A magazine that runs
+ * empty is refilled from the shared depot, and a magazine that fills up
+ * gives half of its objects back. When a thread exits, its magazines are
+ * returned to the depot. Slabs are never returned to the system.
+ *
+ * Configure with --disable-slab (or define NC_NO_SLAB) to use plain
+ * calloc(3) and free(3) instead, e.g. when running under Valgrind.
 */
  
 #include "config.h"
@@ -27,6 +40,61 @@
 #include "nc_exception.h"
 #include "nc_log.h"
 #include "nc_memory.h"
+#include "nc_thread.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if USE_VALGRIND && !defined(NC_NO_SLAB)
+#define NC_NO_SLAB 1
+#endif
+
+/* ------------------------------ GLOBAL VARIABLES ------------------------- */
+
+#define THREAD_LOCAL	__thread
+
+/** The difference in size between two adjacent size classes */
+#define SLAB_QUANTUM	16
+
+/** The number of size classes */
+#define SLAB_CLASSES	(MEM_SLAB_MAX / SLAB_QUANTUM)
+
+/** The number of bytes that are obtained from malloc(3) each time a size class grows */
+#define SLAB_SIZE	(64 * 1024)
+
+/** The number of free objects that a thread can cache for each size class */
+#define MAGAZINE_SIZE	64
+
+/** A free object, which is linked into the depot's free list */
+struct slab_object {
+	struct slab_object *next;
+};
+
+/** The shared pool of free objects for one size class */
+static struct slab_depot {
+	mutex_t             lock;
+	struct slab_object *head;
+	size_t              count;
+} DEPOT[SLAB_CLASSES] = {
+	[0 ... SLAB_CLASSES - 1] = { MUTEX_INITIALIZER, NULL, 0 }
+};
+
+/** A per-thread cache of free objects for one size class */
+struct magazine {
+	size_t  count;
+	void   *obj[MAGAZINE_SIZE];
+};
+
+static THREAD_LOCAL struct magazine MAGAZINE[SLAB_CLASSES];
+
+/** True if the magazines of the current thread will be flushed when it exits */
+static THREAD_LOCAL bool MAGAZINE_REGISTERED;
+
+static pthread_key_t  MAGAZINE_KEY;
+static pthread_once_t MAGAZINE_ONCE = PTHREAD_ONCE_INIT;
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
 
 int
 mem_realloc(void **dest, size_t old_size, size_t new_size)
@@ -48,3 +116,169 @@ mem_realloc(void **dest, size_t old_size, size_t new_size)
 	
 	*dest = p;
 }
+
+
+#if ! NC_NO_SLAB
+
+/**
+ * Move objects from a magazine into the depot.
+ *
+ * @param cls the size class
+ * @param n the number of objects to move
+*/
+static void
+magazine_flush(size_t cls, size_t n)
+  {
+	struct magazine    *mag = &MAGAZINE[cls];
+	struct slab_depot  *depot = &DEPOT[cls];
+	struct slab_object *obj;
+
+	mutex_lock(depot->lock);
+	while (n-- > 0 && mag->count > 0) {
+		obj = mag->obj[--mag->count];
+		obj->next = depot->head;
+		depot->head = obj;
+		depot->count++;
+	}
+	mutex_unlock(depot->lock);
+  }
+
+
+/**
+ * Return all of the magazines of an exiting thread to the depot.
+*/
+static void
+magazine_destructor(void *unused)
+  {
+	size_t cls;
+
+	for (cls = 0; cls < SLAB_CLASSES; cls++)
+		magazine_flush(cls, MAGAZINE_SIZE);
+  }
+
+
+static void
+magazine_key_create(void)
+  {
+	(void) pthread_key_create(&MAGAZINE_KEY, magazine_destructor);
+  }
+
+
+/**
+ * Arrange for the magazines of the current thread to be flushed when it exits.
+*/
+static void
+magazine_register(void)
+  {
+	(void) pthread_once(&MAGAZINE_ONCE, magazine_key_create);
+	(void) pthread_setspecific(MAGAZINE_KEY, MAGAZINE);
+	MAGAZINE_REGISTERED = true;
+  }
+
+
+/**
+ * Refill an empty magazine from the depot.
+ *
+ * If the depot is empty, a new slab is carved into objects first.
+ *
+ * @param cls the size class
+*/
+static int
+magazine_refill(size_t cls)
+{
+	struct magazine    *mag = &MAGAZINE[cls];
+	struct slab_depot  *depot = &DEPOT[cls];
+	struct slab_object *obj;
+	size_t              size = (cls + 1) * SLAB_QUANTUM;
+	char               *slab, *p;
+
+	if (!MAGAZINE_REGISTERED)
+		magazine_register();
+
+	mutex_lock(depot->lock);
+	if (depot->count == 0) {
+		if ((slab = malloc(SLAB_SIZE)) == NULL) {
+			mutex_unlock(depot->lock);
+			throw_errno("malloc(3)");
+		}
+		for (p = slab; p + size <= slab + SLAB_SIZE; p += size) {
+			obj = (struct slab_object *) p;
+			obj->next = depot->head;
+			depot->head = obj;
+			depot->count++;
+		}
+	}
+	while (mag->count < MAGAZINE_SIZE / 2 && depot->count > 0) {
+		obj = depot->head;
+		depot->head = obj->next;
+		depot->count--;
+		mag->obj[mag->count++] = obj;
+	}
+	mutex_unlock(depot->lock);
+}
+
+#endif
+
+
+/**
+ * Allocate a zero-filled object from the slab allocator.
+ *
+ * Objects larger than MEM_SLAB_MAX bytes are allocated with calloc(3).
+ * Use mem_slab_calloc() instead of calling this directly.
+ *
+ * @param dest pointer to the new object
+ * @param size the size of the object, in bytes
+ * @see mem_slab_free()
+*/
+int
+mem_slab_alloc(void **dest, size_t size)
+{
+	size_t cls;
+
+#if ! NC_NO_SLAB
+	if (size > 0 && size <= MEM_SLAB_MAX) {
+		cls = (size - 1) / SLAB_QUANTUM;
+		if (MAGAZINE[cls].count == 0 && magazine_refill(cls) < 0)
+			throw_silent();
+		*dest = MAGAZINE[cls].obj[--MAGAZINE[cls].count];
+		memset(*dest, 0, size);
+		return 0;
+	}
+#endif
+
+	if ((*dest = calloc(1, size)) == NULL)
+		throw("calloc(3) failed");
+}
+
+
+/**
+ * Release an object that was allocated by mem_slab_alloc().
+ *
+ * The object is kept in the current thread's magazine so that it can be
+ * reused by the next allocation of the same size.
+ *
+ * @param ptr the object, or NULL
+ * @param size the size that was passed to mem_slab_alloc()
+*/
+void
+mem_slab_free(void *ptr, size_t size)
+  {
+	size_t cls;
+
+	if (ptr == NULL)
+		return;
+
+#if ! NC_NO_SLAB
+	if (size > 0 && size <= MEM_SLAB_MAX) {
+		cls = (size - 1) / SLAB_QUANTUM;
+		if (!MAGAZINE_REGISTERED)
+			magazine_register();
+		if (MAGAZINE[cls].count == MAGAZINE_SIZE)
+			magazine_flush(cls, MAGAZINE_SIZE / 2);
+		MAGAZINE[cls].obj[MAGAZINE[cls].count++] = ptr;
+		return;
+	}
+#endif
+
+	free(ptr);
+  }
@@ -27,20 +27,38 @@
 
 #include "nc_site.h"
 
+#include "nc_cdb.h"
+#include "nc_chash.h"
+#include "nc_cidr.h"
+#include "nc_container.h"
+#include "nc_date.h"
 #include "nc_dns.h"
+#include "nc_epoch.h"
 #include "nc_exception.h"
+#include "nc_extsort.h"
 #include "nc_file.h"
 #include "nc_hash.h"
 #include "nc_host.h"
+#include "nc_journal.h"
 #include "nc_list.h"
 #include "nc_log.h"
+#include "nc_matcher.h"
 #include "nc_memory.h"
 #include "nc_passwd.h"
 #include "nc_process.h"
+#include "nc_regexp.h"
+#include "nc_serial.h"
+#include "nc_set.h"
 #include "nc_signal.h"
+#include "nc_skiplist.h"
+#include "nc_snapshot.h"
+#include "nc_strbuf.h"
+#include "nc_strtab.h"
 #include "nc_string.h"
+#include "nc_strview.h"
 #include "nc_test.h"
 #include "nc_thread.h"
+#include "nc_vec.h"
 
 #include "nc_session.h"
 #include "nc_socket.h"
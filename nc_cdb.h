@@ -0,0 +1,123 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_CDB_H
+#define _NC_CDB_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "nc_hash.h"
+#include "nc_string.h"
+#include "nc_strview.h"
+
+/*
+ * Constant databases.
+ *
+ * A constant database is a read-only hash table in a file, in the
+ * style of D. J. Bernstein's cdb. It is built once with the cdb_make_*
+ * functions and then mapped into memory by any number of processes,
+ * which share its pages through the page cache. Opening a database
+ * does not read it, and a lookup touches about two pages.
+ *
+ * File layout (all integers are little-endian):
+ *
+ *	header	  "NCDB", a 32-bit version, a 64-bit hash seed, and 256
+ *		  (offset, slot count) pairs of 64-bit integers
+ *	records	  a 32-bit key length, a 32-bit value length, the key
+ *		  and the value
+ *	tables	  for each of the 256 tables, an array of (hash, record
+ *		  offset) pairs of 64-bit integers; an offset of zero
+ *		  marks an empty slot
+ *
+ * A key is looked up in table (hash % 256), starting at slot
+ * ((hash / 256) % slot count) and probing linearly.
+ */
+
+/** The number of hash tables in a database */
+#define CDB_TABLES		256
+
+/** The length of the file header */
+#define CDB_HEADER_SIZE		(16 + CDB_TABLES * 16)
+
+/** The length of a slot in a hash table */
+#define CDB_SLOT_SIZE		16
+
+/** The length of a record header */
+#define CDB_RECORD_SIZE		8
+
+/** A database that is being built */
+typedef struct cdb_make {
+
+	/** The output file descriptor, or -1 */
+	int       fd;
+
+	/** The path to the database, and the temporary file that is renamed to it */
+	string_t *path, *tmp_path;
+
+	/** Output that has not been written yet */
+	string_t *buf;
+
+	/** The offset of the next record */
+	uint64_t  pos;
+
+	/** The seed of the hash function */
+	uint64_t  seed;
+
+	/** The hash and offset of every record */
+	struct cdb_entry {
+		uint64_t hash;
+		uint64_t offset;
+	}        *entry;
+	size_t    count, size;
+
+} cdb_make_t;
+
+/** A database that is mapped into memory */
+typedef struct cdb {
+
+	/** The mapping, or NULL if no database is open */
+	const char *map;
+
+	/** The length of the mapping */
+	size_t      len;
+
+	/** The seed of the hash function */
+	uint64_t    seed;
+
+} cdb_t;
+
+/* Building */
+
+int cdb_make_new(cdb_make_t **dest);
+int cdb_make_destroy(cdb_make_t **cm);
+int cdb_make_start(cdb_make_t *cm, const string_t *path);
+int cdb_make_add(cdb_make_t *cm, const void *key, size_t key_len, const void *value, size_t value_len);
+int cdb_make_finish(cdb_make_t *cm);
+int cdb_make_from_hash(const string_t *path, const hash_t *hash);
+
+/* Reading */
+
+int cdb_new(cdb_t **dest);
+int cdb_destroy(cdb_t **db);
+int cdb_open(cdb_t *db, const string_t *path);
+int cdb_close(cdb_t *db);
+int cdb_find(strview_t *dest, const cdb_t *db, const void *key, size_t len);
+int cdb_get(string_t *dest, const cdb_t *db, char_t *key);
+
+#endif
@@ -0,0 +1,96 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_CHASH_H
+#define _NC_CHASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nc_string.h"
+#include "nc_thread.h"
+
+/** The number of locks that writers are spread across; a power of two */
+#define CHASH_STRIPES	64
+
+/** An entry in a concurrent hash table. Entries are never modified once they are visible. */
+typedef struct chash_node {
+
+	/** The next entry in the same bucket */
+	struct chash_node *next;
+
+	/** The hash of the key */
+	uint64_t           hash;
+
+	/** The length of the key and the value */
+	size_t             key_len, value_len;
+
+	/** The key, followed by the value; both are NUL-terminated */
+	char               data[];
+
+} chash_node_t;
+
+/** The array of buckets of a concurrent hash table */
+struct chash_table {
+	size_t             size;
+	chash_node_t      *bucket[];
+};
+
+/**
+ * Concurrent hash table.
+ *
+ * This is a hash table that can be shared by many threads without an
+ * external lock. Readers do not take a lock at all; they are protected
+ * by epoch-based reclamation (see nc_epoch.h). Writers lock one of
+ * CHASH_STRIPES mutexes, chosen by the hash of the key, so writers
+ * only contend when they touch the same stripe.
+ */
+typedef struct chash {
+
+	/** The current array of buckets */
+	struct chash_table *table;
+
+	/** The stripe locks; bucket @a i is protected by lock @a i % CHASH_STRIPES */
+	mutex_t             lock[CHASH_STRIPES];
+
+	/** The number of key/value pairs */
+	size_t              count;
+
+} chash_t;
+
+/**
+ * A function that computes a new value for chash_compute().
+ *
+ * @param value the current value, which may be modified
+ * @param exists on entry, true if the key exists; set it to false to
+ *        delete the key, or to true to store @a value
+ * @param arg the argument that was passed to chash_compute()
+ * @return zero on success, or -1 to leave the table unchanged
+ */
+typedef int (*chash_compute_t)(string_t *value, bool *exists, void *arg);
+
+int chash_new(chash_t **dest);
+int chash_destroy(chash_t **map);
+
+int chash_get(string_t *dest, chash_t *map, char_t *key);
+int chash_set(chash_t *map, char_t *key, const string_t *value);
+int chash_put_if_absent(bool *added, chash_t *map, char_t *key, const string_t *value);
+int chash_compute(chash_t *map, char_t *key, chash_compute_t func, void *arg);
+int chash_delete(chash_t *map, char_t *key);
+
+#endif
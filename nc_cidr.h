@@ -0,0 +1,77 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_CIDR_H
+#define _NC_CIDR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nc_list.h"
+#include "nc_socket.h"
+#include "nc_string.h"
+
+/** A node in a cidr_t. */
+typedef struct cidr_node {
+
+	/** The prefix, as an IPv6 address with the host bits cleared */
+	uint8_t   addr[16];
+
+	/** The length of the prefix, in bits */
+	uint8_t   len;
+
+	/** True if the prefix was added with cidr_add(); false for a branch point */
+	bool      terminal;
+
+	/** The value that was given to cidr_add() */
+	int       value;
+
+	/** The subtrees for the next bit being zero or one */
+	struct cidr_node *child[2];
+
+} cidr_node_t;
+
+/**
+ * A set of IPv4 and IPv6 network prefixes.
+ *
+ * The prefixes are stored in a path-compressed binary radix tree, so
+ * a lookup visits at most one node per distinct prefix length along
+ * the path, and compares addresses as bits instead of strings. IPv4
+ * prefixes are stored as IPv4-mapped IPv6 prefixes (::ffff:0:0/96),
+ * which also matches IPv4 clients of a dual-stack socket.
+ */
+typedef struct cidr {
+
+	/** The root of the tree */
+	cidr_node_t *root;
+
+	/** The number of prefixes */
+	size_t       count;
+
+} cidr_t;
+
+int cidr_new(cidr_t **dest);
+int cidr_destroy(cidr_t **c);
+
+int cidr_add(cidr_t *c, char_t *prefix, int value);
+int cidr_add_list(cidr_t *c, const list_t *src, int value);
+
+int cidr_lookup(int *value, const cidr_t *c, const socket_addr_t *addr);
+int cidr_match(bool *result, const cidr_t *c, const socket_addr_t *addr);
+
+#endif
@@ -0,0 +1,501 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_CONTAINER_H
+#define _NC_CONTAINER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "nc_exception.h"
+#include "nc_memory.h"
+
+/*
+ * Type-specialized containers.
+ *
+ * list_t, vec_t and hash_t only hold strings. The macros in this file
+ * generate containers for any element type, so integers, pointers and
+ * structures can be stored directly. All of the functions are static
+ * inline, which lets the compiler specialize the hash and comparison
+ * functions into each probe loop.
+ *
+ * Each macro is used once, at file scope, to define a new type:
+ *
+ *	NC_VEC(point_vec, struct point)		-> point_vec_t
+ *	NC_MAP(int_map, uint64_t, uint64_t, nc_hash_int, NC_EQ)	-> int_map_t
+ *	NC_SET(int_set, int, nc_hash_int, NC_EQ)	-> int_set_t
+ *
+ * The generated functions follow the usual conventions: _new() and
+ * _destroy() manage the object, and the other functions return zero on
+ * success and -1 on failure. ncc recognizes these macros, so the new
+ * type can be used for automatic variables like any other NC type.
+ *
+ * Maps and sets use open addressing with Robin Hood hashing, like
+ * hash_t. They do not own their elements; if an element points to
+ * memory, the caller must free it.
+ */
+
+/* ------------------------- HASH FUNCTIONS ------------------------- */
+
+/** Compare two values with the == operator */
+#define NC_EQ(a,b)	((a) == (b))
+
+/**
+ * Hash an integer.
+ *
+ * This is the finalizer of SplitMix64, which spreads every input bit
+ * across the whole result.
+ */
+static inline uint64_t UNUSED
+nc_hash_int(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+/** Hash a pointer */
+static inline uint64_t UNUSED
+nc_hash_ptr(const void *p)
+{
+	return nc_hash_int((uint64_t) (uintptr_t) p);
+}
+
+/* ----------------------------- VECTORS ----------------------------- */
+
+/**
+ * Define a vector of @a T named @a name_t.
+ *
+ * Functions: _new, _destroy, _truncate, _reserve, _push, _pop, _get,
+ * _set, _insert, _remove and _at, which returns a borrowed pointer.
+ */
+#define NC_VEC(name, T)								\
+									\
+typedef struct name {							\
+	T      *item;							\
+	size_t  count;							\
+	size_t  size;							\
+} name##_t;								\
+									\
+static inline int UNUSED						\
+name##_new(name##_t **dest)						\
+{									\
+	if ((*dest = calloc(1, sizeof(**dest))) == NULL)		\
+		throw("calloc(3) failed");				\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_destroy(name##_t **v)						\
+{									\
+	if (*v != NULL) {						\
+		free((*v)->item);					\
+		free(*v);						\
+		*v = NULL;						\
+	}								\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_truncate(name##_t *v)						\
+{									\
+	v->count = 0;							\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_reserve(name##_t *v, size_t count)				\
+{									\
+	size_t size = (v->size < 8) ? 8 : v->size;			\
+	T     *p;							\
+									\
+	if (count <= v->size)						\
+		return 0;						\
+	while (size < count) {						\
+		if (size > SIZE_MAX / sizeof(T) / 2)			\
+			throw("vector too large");			\
+		size *= 2;						\
+	}								\
+	if ((p = realloc(v->item, size * sizeof(T))) == NULL)		\
+		throw("realloc(3) failed");				\
+	v->item = p;							\
+	v->size = size;							\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_push(name##_t *v, T item)					\
+{									\
+	if (v->count == v->size && name##_reserve(v, v->count + 1) < 0)	\
+		return -1;						\
+	v->item[v->count++] = item;					\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_pop(T *dest, name##_t *v)					\
+{									\
+	if (v->count == 0)						\
+		return -1;						\
+	*dest = v->item[--v->count];					\
+	return 0;							\
+}									\
+									\
+static inline T * UNUSED						\
+name##_at(const name##_t *v, size_t i)					\
+{									\
+	return (i < v->count) ? &v->item[i] : NULL;			\
+}									\
+									\
+static inline int UNUSED						\
+name##_get(T *dest, const name##_t *v, size_t i)			\
+{									\
+	if (i >= v->count)						\
+		throw("index out of range");				\
+	*dest = v->item[i];						\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_set(name##_t *v, size_t i, T item)				\
+{									\
+	if (i >= v->count)						\
+		throw("index out of range");				\
+	v->item[i] = item;						\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_insert(name##_t *v, size_t i, T item)				\
+{									\
+	if (i > v->count)						\
+		throw("index out of range");				\
+	if (name##_reserve(v, v->count + 1) < 0)			\
+		return -1;						\
+	memmove(&v->item[i + 1], &v->item[i],				\
+			(v->count - i) * sizeof(T));			\
+	v->item[i] = item;						\
+	v->count++;							\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_remove(name##_t *v, size_t i)					\
+{									\
+	if (i >= v->count)						\
+		throw("index out of range");				\
+	v->count--;							\
+	memmove(&v->item[i], &v->item[i + 1],				\
+			(v->count - i) * sizeof(T));			\
+	return 0;							\
+}
+
+/* ------------------------- MAPS AND SETS -------------------------- */
+
+/* The distance of the slot at @a i from the home slot of hash @a h */
+#define _NC_DISTANCE(h,i,mask)	(((i) - ((h) & (mask))) & (mask))
+
+/*
+ * The parts of a map or set that do not depend on the slot contents.
+ * The slot type must have 'hash' and 'key' members, and the table
+ * type must have 'slot', 'size' and 'count' members.
+ */
+#define _NC_TABLE(name, K, hashfn, eqfn)					\
+									\
+static inline int UNUSED						\
+name##_new(name##_t **dest)						\
+{									\
+	if ((*dest = calloc(1, sizeof(**dest))) == NULL)		\
+		throw("calloc(3) failed");				\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_destroy(name##_t **t)						\
+{									\
+	if (*t != NULL) {						\
+		free((*t)->slot);					\
+		free(*t);						\
+		*t = NULL;						\
+	}								\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_truncate(name##_t *t)						\
+{									\
+	if (t->size > 0)						\
+		memset(t->slot, 0, t->size * sizeof(*t->slot));		\
+	t->count = 0;							\
+	return 0;							\
+}									\
+									\
+static inline uint64_t UNUSED						\
+name##_hash(K key)							\
+{									\
+	uint64_t h = hashfn(key);					\
+	return (h == 0) ? 1 : h;					\
+}									\
+									\
+/* Return the index of the slot that holds @a key, or -1 */		\
+static inline ssize_t UNUSED						\
+name##_probe(const name##_t *t, K key, uint64_t h)			\
+{									\
+	size_t mask = t->size - 1, i, dist;				\
+									\
+	if (t->size == 0)						\
+		return -1;						\
+	for (i = h & mask, dist = 0; ; i = (i + 1) & mask, dist++) {	\
+		if (t->slot[i].hash == 0 ||				\
+		    _NC_DISTANCE(t->slot[i].hash, i, mask) < dist)	\
+			return -1;					\
+		if (t->slot[i].hash == h && eqfn(t->slot[i].key, key))	\
+			return (ssize_t) i;				\
+	}								\
+}									\
+									\
+/* Place a slot whose key is not already in the table */		\
+static inline void UNUSED						\
+name##_place(struct name##_slot *slot, size_t size, struct name##_slot ent) \
+{									\
+	struct name##_slot tmp;						\
+	size_t mask = size - 1, i, dist, d;				\
+									\
+	for (i = ent.hash & mask, dist = 0; slot[i].hash != 0;		\
+			i = (i + 1) & mask, dist++) {			\
+		d = _NC_DISTANCE(slot[i].hash, i, mask);		\
+		if (d < dist) {						\
+			tmp = slot[i];					\
+			slot[i] = ent;					\
+			ent = tmp;					\
+			dist = d;					\
+		}							\
+	}								\
+	slot[i] = ent;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_resize(name##_t *t, size_t size)					\
+{									\
+	struct name##_slot *old = t->slot;				\
+	size_t              i;						\
+									\
+	if ((t->slot = calloc(size, sizeof(*t->slot))) == NULL) {	\
+		t->slot = old;						\
+		throw("calloc(3) failed");				\
+	}								\
+	for (i = 0; i < t->size; i++) {					\
+		if (old[i].hash != 0)					\
+			name##_place(t->slot, size, old[i]);		\
+	}								\
+	free(old);							\
+	t->size = size;							\
+	return 0;							\
+}									\
+									\
+/* Make room for at least @a count entries, at a load factor of 7/8 */	\
+static inline int UNUSED						\
+name##_reserve(name##_t *t, size_t count)				\
+{									\
+	size_t size = 8;						\
+									\
+	while (count > size - size / 8) {				\
+		if (size > SIZE_MAX / sizeof(*t->slot) / 2)		\
+			throw("table too large");			\
+		size *= 2;						\
+	}								\
+	return (size > t->size) ? name##_resize(t, size) : 0;		\
+}									\
+									\
+/* Remove the entry at @a i by shifting the following entries back */	\
+static inline int UNUSED						\
+name##_remove_at(name##_t *t, size_t i)					\
+{									\
+	size_t mask = t->size - 1, next;				\
+									\
+	for (;;) {							\
+		next = (i + 1) & mask;					\
+		if (t->slot[next].hash == 0 ||				\
+		    _NC_DISTANCE(t->slot[next].hash, next, mask) == 0)	\
+			break;						\
+		t->slot[i] = t->slot[next];				\
+		i = next;						\
+	}								\
+	memset(&t->slot[i], 0, sizeof(t->slot[i]));			\
+	t->count--;							\
+	return 0;							\
+}
+
+/**
+ * Define a map from @a K to @a V named @a name_t.
+ *
+ * @a hashfn takes a key and returns a uint64_t, and @a eqfn takes two
+ * keys and returns true if they are equal; either may be a macro.
+ *
+ * Functions: _new, _destroy, _truncate, _reserve, _set, _get, _delete,
+ * _next for iteration, and _lookup, which returns a borrowed pointer to
+ * the value or NULL.
+ */
+#define NC_MAP(name, K, V, hashfn, eqfn)					\
+									\
+struct name##_slot {							\
+	uint64_t hash;							\
+	K        key;							\
+	V        value;							\
+};									\
+									\
+typedef struct name {							\
+	struct name##_slot *slot;					\
+	size_t              size;					\
+	size_t              count;					\
+} name##_t;								\
+									\
+_NC_TABLE(name, K, hashfn, eqfn)						\
+									\
+static inline V * UNUSED						\
+name##_lookup(const name##_t *t, K key)					\
+{									\
+	ssize_t i = name##_probe(t, key, name##_hash(key));		\
+									\
+	return (i < 0) ? NULL : &t->slot[i].value;			\
+}									\
+									\
+static inline int UNUSED						\
+name##_get(V *dest, const name##_t *t, K key)				\
+{									\
+	V *p = name##_lookup(t, key);					\
+									\
+	if (p == NULL)							\
+		return -1;						\
+	*dest = *p;							\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_set(name##_t *t, K key, V value)					\
+{									\
+	struct name##_slot ent;						\
+	ssize_t            i;						\
+									\
+	ent.hash = name##_hash(key);					\
+	if ((i = name##_probe(t, key, ent.hash)) >= 0) {		\
+		t->slot[i].value = value;				\
+		return 0;						\
+	}								\
+	if (name##_reserve(t, t->count + 1) < 0)			\
+		return -1;						\
+	ent.key = key;							\
+	ent.value = value;						\
+	name##_place(t->slot, t->size, ent);				\
+	t->count++;							\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_delete(name##_t *t, K key)					\
+{									\
+	ssize_t i = name##_probe(t, key, name##_hash(key));		\
+									\
+	return (i < 0) ? -1 : name##_remove_at(t, (size_t) i);		\
+}									\
+									\
+/* Get the next entry; set *pos to zero to start. Returns -1 at the end. */ \
+static inline int UNUSED						\
+name##_next(K *key, V *value, size_t *pos, const name##_t *t)		\
+{									\
+	for (; *pos < t->size; (*pos)++) {				\
+		if (t->slot[*pos].hash != 0) {				\
+			*key = t->slot[*pos].key;			\
+			*value = t->slot[(*pos)++].value;		\
+			return 0;					\
+		}							\
+	}								\
+	return -1;							\
+}
+
+/**
+ * Define a set of @a T named @a name_t.
+ *
+ * Functions: _new, _destroy, _truncate, _reserve, _add, _contains,
+ * _delete, and _next for iteration.
+ */
+#define NC_SET(name, T, hashfn, eqfn)					\
+									\
+struct name##_slot {							\
+	uint64_t hash;							\
+	T        key;							\
+};									\
+									\
+typedef struct name {							\
+	struct name##_slot *slot;					\
+	size_t              size;					\
+	size_t              count;					\
+} name##_t;								\
+									\
+_NC_TABLE(name, T, hashfn, eqfn)						\
+									\
+static inline bool UNUSED						\
+name##_contains(const name##_t *t, T key)				\
+{									\
+	return name##_probe(t, key, name##_hash(key)) >= 0;		\
+}									\
+									\
+static inline int UNUSED						\
+name##_add(name##_t *t, T key)						\
+{									\
+	struct name##_slot ent;						\
+									\
+	ent.hash = name##_hash(key);					\
+	if (name##_probe(t, key, ent.hash) >= 0)			\
+		return 0;						\
+	if (name##_reserve(t, t->count + 1) < 0)			\
+		return -1;						\
+	ent.key = key;							\
+	name##_place(t->slot, t->size, ent);				\
+	t->count++;							\
+	return 0;							\
+}									\
+									\
+static inline int UNUSED						\
+name##_delete(name##_t *t, T key)					\
+{									\
+	ssize_t i = name##_probe(t, key, name##_hash(key));		\
+									\
+	return (i < 0) ? -1 : name##_remove_at(t, (size_t) i);		\
+}									\
+									\
+/* Get the next element; set *pos to zero to start. Returns -1 at the end. */ \
+static inline int UNUSED						\
+name##_next(T *key, size_t *pos, const name##_t *t)			\
+{									\
+	for (; *pos < t->size; (*pos)++) {				\
+		if (t->slot[*pos].hash != 0) {				\
+			*key = t->slot[(*pos)++].key;			\
+			return 0;					\
+		}							\
+	}								\
+	return -1;							\
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_DATE_H
+#define _NC_DATE_H
+
+#include <time.h>
+
+#include "nc_string.h"
+
+/* Date format flags */
+
+extern const int DATE_RFC2822,
+       DATE_RFC3339,
+       DATE_NO_WEEKDAY;
+
+/** The maximum length of a date that is generated by date_format() */
+#define DATE_MAX	40
+
+/* Parsing */
+
+int date_parse(time_t *dest, int *offset, const char *src, size_t len);
+int date_parse_rfc2822(time_t *dest, int *offset, const char *src, size_t len);
+int date_parse_rfc3339(time_t *dest, int *offset, const char *src, size_t len);
+
+/* Formatting */
+
+int date_format(string_t *dest, time_t t, int offset, int flags);
+int date_format_local(string_t *dest, time_t t, int flags);
+int date_strftime(string_t *dest, time_t t, const char *format);
+
+/* Time zone conversion */
+
+int date_localtime(struct tm *dest, int *offset, time_t t);
+
+#endif
@@ -23,7 +23,7 @@
 
 /** This regular expression should match all syntactically valid domain names */
 #define DOMAIN_REGEX "[a-zA-Z0-9.-]+"
-#define dns_validate_hostname(result,query)  str_match_regex(result, DOMAIN_REGEX, query)
+#define dns_validate_hostname(result,query)  str_match_regex(result, query, DOMAIN_REGEX)
 
 int dns_library_init(void);
 
@@ -0,0 +1,44 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_EPOCH_H
+#define _NC_EPOCH_H
+
+#include "nc_thread.h"
+
+/*
+ * Epoch-based memory reclamation.
+ *
+ * Readers surround each access to a shared structure with epoch_enter()
+ * and epoch_exit(). A writer that unlinks an object passes it to
+ * epoch_retire() instead of freeing it, and the object is freed once
+ * every reader that might still hold a pointer to it has left its
+ * critical section. Readers never take a lock or write to shared memory.
+ *
+ * Critical sections may be nested, but they must not block for a long
+ * time, since retired objects cannot be freed while any thread is in
+ * an older epoch.
+ */
+
+int  epoch_enter(void);
+void epoch_exit(void);
+int  epoch_retire(void *ptr, callback_t func);
+int  epoch_synchronize(void);
+int  epoch_poll(void);
+
+#endif
@@ -0,0 +1,38 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_EXTSORT_H
+#define _NC_EXTSORT_H
+
+#include <sys/types.h>
+
+#include "nc_string.h"
+
+/** The amount of memory used to sort each run, if no budget is given */
+#define EXTSORT_BUDGET_DEFAULT	(64 * 1024 * 1024)
+
+/** The maximum number of runs that are merged at the same time */
+#define EXTSORT_FANIN		64
+
+/** The size of the buffer used to read or write each file, in bytes */
+#define EXTSORT_IO_SIZE		(256 * 1024)
+
+int extsort_fd(int dest, int src, const string_t *tmpdir, int flags, size_t budget);
+int extsort_file(const string_t *dest, const string_t *src, int flags, size_t budget);
+
+#endif
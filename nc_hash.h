@@ -19,16 +19,59 @@
 #ifndef _NC_HASH_H
 #define _NC_HASH_H
 
+#include <stdint.h>
+#include <string.h>
+
 #include "nc_list.h"
 
-/** Hash table */
+/** A slot in a hash table. */
+typedef struct hash_slot {
+
+	/** The hash of the key, or zero if the slot has never been used */
+	uint64_t  hash;
+
+	/** The key, or NULL if the slot is empty or was deleted */
+	string_t *key;
+
+	/** The value associated with the key */
+	string_t *value;
+
+} hash_slot_t;
+
+/**
+ * Hash table.
+ *
+ * This is an open-addressing table that uses Robin Hood hashing with
+ * linear probing. The hash of each key is stored in its slot, so most
+ * failed comparisons never touch the key itself.
+ *
+ * When the table grows, the previous array is kept in @a old and is
+ * moved into the new array a few slots at a time by each later call
+ * to hash_set() or hash_delete(), so no single call has to rehash
+ * the whole table.
+ */
 typedef struct hash {
 
-	/** An array of 'buckets' large enough to support an 8-bit hashing function */
-	list_t *bucket[256]; 
+	/** The array of slots that new entries are added to */
+	hash_slot_t *slot;
+
+	/** The number of elements in @a slot; always zero or a power of two */
+	size_t       size;
 
 	/** The total number of key/value pairs in the hash */
-	size_t  count;
+	size_t       count;
+
+	/** The previous array of slots, while a resize is in progress */
+	hash_slot_t *old;
+
+	/** The number of elements in @a old */
+	size_t       old_size;
+
+	/** The number of slots at the beginning of @a old that have been moved */
+	size_t       old_moved;
+
+	/** The number of key/value pairs that remain in @a old */
+	size_t       old_count;
 
 } hash_t;
 
@@ -36,8 +79,12 @@ typedef struct hash {
 int hash_new(hash_t **dest);
 int hash_destroy(hash_t **hash_ref);
 int hash_copy(hash_t *dest, hash_t *src);
+int hash_reserve(hash_t *hash, size_t count);
+int hash_key(uint64_t *dest, char_t *key, size_t len);
 
 int hash_get(string_t *dest, hash_t *hash, char_t *key);
+int hash_lookup(const string_t **dest, const hash_t *hash, char_t *key);
+int hash_iterate(const string_t **key, const string_t **value, size_t *pos, const hash_t *hash);
 int hash_set(hash_t *hash, char_t *key, const string_t *value);
 int hash_delete(hash_t *dest, char_t *key);
 
@@ -50,8 +97,76 @@ int hash_print(hash_t *hash);
 
 int hash_serialize(string_t *str, const hash_t *hash);
 int hash_deserialize(hash_t *hash, const string_t *str);
+int hash_serialize_bin(string_t *dest, const hash_t *hash);
+int hash_deserialize_bin(hash_t *hash, const void *src, size_t len);
+int hash_write_bin(int fd, const hash_t *hash);
+int hash_read_bin(hash_t *hash, const string_t *path);
 
 int hash_from_char(hash_t *hash, ...);
 int hash_from_list(hash_t *hash, list_t *list);
 
+/* ---------------------------- INLINE FUNCTIONS ------------------------------ */
+
+#define HASH_ROTL(x,b)	(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define HASH_SIPROUND(v0,v1,v2,v3) do {					\
+	v0 += v1; v1 = HASH_ROTL(v1, 13); v1 ^= v0; v0 = HASH_ROTL(v0, 32);	\
+	v2 += v3; v3 = HASH_ROTL(v3, 16); v3 ^= v2;				\
+	v0 += v3; v3 = HASH_ROTL(v3, 21); v3 ^= v0;				\
+	v2 += v1; v1 = HASH_ROTL(v1, 17); v1 ^= v2; v2 = HASH_ROTL(v2, 32);	\
+} while (0)
+
+/**
+ * Compute a keyed hash of a buffer.
+ *
+ * This is SipHash-1-3, which is fast on short keys and makes it
+ * impractical for a client to choose keys that all collide. Words are
+ * read in native byte order, so results differ between architectures.
+ *
+ * @param src the data to be hashed
+ * @param len the length of @a src, in bytes
+ * @param seed a secret, random key
+ * @return the hash value
+ */
+static inline UNUSED uint64_t
+hash_bytes(const void *src, size_t len, uint64_t seed)
+{
+	const uint8_t *p = src;
+	uint64_t k0 = seed, k1 = seed ^ 0x9e3779b97f4a7c15ULL;
+	uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+	uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+	uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+	uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+	uint64_t m, b = ((uint64_t) len) << 56;
+	size_t   i, tail = len & 7;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		memcpy(&m, p + i, 8);
+		v3 ^= m;
+		HASH_SIPROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+
+	p += len - tail;
+	switch (tail) {
+	case 7: b |= ((uint64_t) p[6]) << 48;	/* FALLTHROUGH */
+	case 6: b |= ((uint64_t) p[5]) << 40;	/* FALLTHROUGH */
+	case 5: b |= ((uint64_t) p[4]) << 32;	/* FALLTHROUGH */
+	case 4: b |= ((uint64_t) p[3]) << 24;	/* FALLTHROUGH */
+	case 3: b |= ((uint64_t) p[2]) << 16;	/* FALLTHROUGH */
+	case 2: b |= ((uint64_t) p[1]) << 8;	/* FALLTHROUGH */
+	case 1: b |= ((uint64_t) p[0]);
+	}
+
+	v3 ^= b;
+	HASH_SIPROUND(v0, v1, v2, v3);
+	v0 ^= b;
+	v2 ^= 0xff;
+	HASH_SIPROUND(v0, v1, v2, v3);
+	HASH_SIPROUND(v0, v1, v2, v3);
+	HASH_SIPROUND(v0, v1, v2, v3);
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
 #endif
@@ -0,0 +1,107 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_JOURNAL_H
+#define _NC_JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nc_hash.h"
+#include "nc_string.h"
+#include "nc_thread.h"
+
+/* Flags for journal_open() */
+
+extern const int JOURNAL_NOSYNC,
+       JOURNAL_NO_COMPACTION;
+
+/** The default size of the log that triggers a compaction, in bytes */
+#define JOURNAL_COMPACT_SIZE	(4 * 1024 * 1024)
+
+/**
+ * A hash table that is persisted with an append-only log.
+ *
+ * The table is stored in two files: a snapshot in the format of
+ * hash_write_bin(), and a log of the changes that were made after the
+ * snapshot was taken. Each update appends one record to the log, so a
+ * durable update costs O(record) instead of O(table).
+ *
+ * Updates from concurrent threads share an fsync(2): the first thread
+ * to commit writes the records of every waiting thread, and the others
+ * wait for it. A background thread compacts the log into a new snapshot
+ * when it grows larger than @a compact_size.
+ */
+typedef struct journal {
+
+	/** The contents of the table. Use journal_get() to read it while the journal is open. */
+	hash_t   *hash;
+
+	/** The paths to the snapshot, the log, and the log that is being compacted */
+	string_t *path, *log_path, *old_path;
+
+	/** The log file descriptor, or -1 if the journal is closed */
+	int       fd;
+
+	/** Flags that were passed to journal_open() */
+	int       flags;
+
+	/** Protects every field, except those used only by the compactor */
+	mutex_t   lock;
+
+	/** Signalled when records have been synced, and when a compaction is needed */
+	cond_t    synced_cond, compact_cond;
+
+	/** Records that have been added but not written, and records that are being written */
+	string_t *pending, *writing;
+
+	/** The number of bytes of records that have been added, and that are durable */
+	uint64_t  appended, synced;
+
+	/** True while a thread is writing records to the log */
+	bool      syncing;
+
+	/** True after a write to the log has failed; every update fails until the journal is reopened */
+	bool      failed;
+
+	/** The number of bytes in the log file */
+	size_t    log_size;
+
+	/** The log size that triggers a compaction */
+	size_t    compact_size;
+
+	/** Serializes calls to journal_compact() */
+	mutex_t   compact_lock;
+
+	/** The background compaction thread */
+	thread_t  compactor;
+	bool      compactor_running, stop;
+
+} journal_t;
+
+int journal_new(journal_t **dest);
+int journal_destroy(journal_t **j);
+int journal_open(journal_t *j, const string_t *path, int flags);
+int journal_close(journal_t *j);
+
+int journal_get(string_t *dest, journal_t *j, char_t *key);
+int journal_set(journal_t *j, char_t *key, const string_t *value);
+int journal_delete(journal_t *j, char_t *key);
+int journal_compact(journal_t *j);
+
+#endif
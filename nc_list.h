@@ -28,7 +28,8 @@ extern const int SORT_DEFAULT,
        SORT_ASCENDING,
        SORT_DESCENDING,
        SORT_LEXICOGRAPHIC,
-       SORT_NUMERIC;
+       SORT_NUMERIC,
+       SORT_PARALLEL;
 
 /** An element in a doubly linked list. */
 typedef struct list_entry_t {
@@ -41,6 +42,15 @@ typedef struct list_entry_t {
 } list_entry_t;
 
 
+/** A callback for list_parallel_foreach() */
+typedef int (*list_apply_t)(string_t *item, void *arg);
+
+/** A callback for list_parallel_map() that stores the result for @a src in @a dest */
+typedef int (*list_map_t)(string_t *dest, const string_t *src, void *arg);
+
+/** A callback for list_parallel_filter() that sets @a keep if @a src should be copied */
+typedef int (*list_filter_t)(bool *keep, const string_t *src, void *arg);
+
 /** A doubly linked list. */
 typedef struct list {
 
@@ -93,10 +103,20 @@ int list_parse(list_t **dest, char *src, char *delimiter);
 int list_sort(list_t *list, int flags);
 int list_write(int fd, list_t *list, char_t *eol);
 
+/* Parallel algorithms */
+
+int list_parallel_foreach(list_t *list, list_apply_t func, void *arg);
+int list_parallel_map(list_t *dest, const list_t *src, list_map_t func, void *arg);
+int list_parallel_filter(list_t *dest, const list_t *src, list_filter_t func, void *arg);
+
 /* Serialization */
 
 int list_serialize(string_t *dest, list_t *src);
 int list_deserialize(list_t *dest, const string_t *src);
+int list_serialize_bin(string_t *dest, const list_t *src);
+int list_deserialize_bin(list_t *dest, const void *src, size_t len);
+int list_write_bin(int fd, const list_t *src);
+int list_read_bin(list_t *dest, const string_t *path);
 
 /* Direct access to list entries */
 
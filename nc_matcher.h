@@ -0,0 +1,111 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_MATCHER_H
+#define _NC_MATCHER_H
+
+#include <stdint.h>
+
+#include "nc_list.h"
+#include "nc_regexp.h"
+#include "nc_string.h"
+
+/* Pattern flags */
+
+extern const int MATCH_LITERAL,
+       MATCH_REGEX,
+       MATCH_ICASE;
+
+/** A single pattern within a matcher_t. */
+typedef struct matcher_pattern {
+
+	/** The pattern, exactly as it was given to matcher_add() */
+	string_t *text;
+
+	/** MATCH_LITERAL or MATCH_REGEX, optionally combined with MATCH_ICASE */
+	int       flags;
+
+	/** The compiled expression, if this is a MATCH_REGEX pattern */
+	regexp_t *re;
+
+	/** The lowercase literal that is fed to the automaton.
+	 *  For a regular expression, this is the longest literal that must
+	 *  appear in every match, or an empty string if there is none.
+	 */
+	string_t *key;
+
+} matcher_pattern_t;
+
+/** A set of patterns that can be matched against a string in a single pass.
+ *
+ * Literal patterns, and the required literals of regular expressions,
+ * are compiled into a single Aho-Corasick automaton. A regular expression
+ * is only executed if its required literal was seen by the automaton.
+ */
+typedef struct matcher {
+
+	/** The number of patterns */
+	size_t    count;
+
+	/** The number of patterns that can be stored without reallocation */
+	size_t    size;
+
+	/** An array of patterns */
+	matcher_pattern_t *pattern;
+
+	/** If true, the automaton is up to date with the list of patterns */
+	bool      compiled;
+
+	/** Maps each input byte to a column of the transition table */
+	uint8_t   byte_class[256];
+
+	/** The number of columns in the transition table */
+	size_t    nclasses;
+
+	/** The number of states in the automaton */
+	size_t    nstates;
+
+	/** The transition table, with @a nstates rows of @a nclasses columns */
+	uint32_t *delta;
+
+	/** The nearest suffix of each state that has an output, or zero */
+	uint32_t *dict;
+
+	/** The first output of each state */
+	uint32_t *output;
+
+	/** The pattern number and next output of each output */
+	uint32_t *out_id, *out_next;
+
+	/** Regular expressions that have no required literal */
+	uint32_t *unkeyed;
+	size_t    nunkeyed;
+
+} matcher_t;
+
+int matcher_new(matcher_t **dest);
+int matcher_destroy(matcher_t **m);
+
+int matcher_add(matcher_t *m, const char *pattern, int flags);
+int matcher_add_list(matcher_t *m, list_t *patterns, int flags);
+int matcher_compile(matcher_t *m);
+
+int matcher_match(bool *result, matcher_t *m, const string_t *src);
+int matcher_scan(list_t *dest, matcher_t *m, const string_t *src);
+
+#endif
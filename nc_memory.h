@@ -75,5 +75,27 @@
 
 int mem_realloc(void **dest, size_t old_size, size_t new_size);
 
+/* Slab allocator */
+
+/** The largest object that is allocated from a slab; larger objects use calloc(3) */
+#define MEM_SLAB_MAX	256
+
+/** Like mem_calloc(), but take the object from the slab allocator.
+ *  Objects must be released with mem_slab_release(), not free(3).
+ */
+#define mem_slab_calloc(ptr) { \
+		if (ptr != NULL) { \
+			throw("double new() detected; pointers must be preset to NULL"); \
+		} \
+		if (mem_slab_alloc((void **) &(ptr), sizeof(*(ptr))) < 0) \
+		    throw_silent(); \
+		}
+
+/** Release an object that was allocated by mem_slab_calloc() */
+#define mem_slab_release(ptr)	mem_slab_free(ptr, sizeof(*(ptr)))
+
+int mem_slab_alloc(void **dest, size_t size);
+void mem_slab_free(void *ptr, size_t size);
+
 #endif
 
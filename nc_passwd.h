@@ -19,16 +19,38 @@
 #ifndef _NC_PASSWD_H
 #define _NC_PASSWD_H
 
+#include "nc_container.h"
 #include "nc_string.h"
-#include "nc_hash.h"
+#include "nc_strtab.h"
 
 #include <sys/types.h>
 #include <unistd.h>
 
+/** A map from numeric UIDs to the index of a name in a strtab_t */
+NC_MAP(uid_index, uid_t, size_t, nc_hash_int, NC_EQ)
+
+/**
+ * A map from numeric UIDs to symbolic user names.
+ *
+ * The names are stored in a string table, so they can be of any length.
+ */
+typedef struct uid_map {
+
+	/** The index of the name of each UID within @a names */
+	uid_index_t *index;
+
+	/** The symbolic names */
+	strtab_t    *names;
+
+} uid_map_t;
+
+int uid_map_new(uid_map_t **dest);
+int uid_map_destroy(uid_map_t **map);
+
 /* System /etc/passwd and /etc/group functions */
 
-int passwd_get_symbolic_uid(string_t *dest, hash_t *map, uid_t uid);
-int passwd_get_uid_map(hash_t *map);
+int passwd_get_symbolic_uid(string_t *dest, const uid_map_t *map, uid_t uid);
+int passwd_get_uid_map(uid_map_t *map);
 
 int passwd_get_name_by_id(string_t *name, const uid_t uid);
 int passwd_get_id_by_name(uid_t *uid, const string_t *name);
@@ -0,0 +1,75 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_REGEXP_H
+#define _NC_REGEXP_H
+
+#include <sys/types.h>
+#include <regex.h>
+
+#include "nc_string.h"
+
+/** The maximum number of compiled expressions kept in the regex cache */
+#define REGEXP_CACHE_MAX	64
+
+/** The maximum number of sub-expressions that can be extracted */
+#define REGEXP_NSUB_MAX		16
+
+/** A compiled regular expression.
+ *
+ * Objects are reference counted so that a compiled expression can be
+ * shared between the regex cache and any number of threads.
+ * Every regexp_compile() or regexp_cache_get() must be paired with
+ * a call to regexp_destroy().
+ */
+typedef struct regexp {
+
+	/** The compiled expression, as returned by regcomp(3) */
+	regex_t   preg;
+
+	/** The source text of the expression */
+	string_t *pattern;
+
+	/** The flags that were passed to regcomp(3) */
+	int       cflags;
+
+	/** A hash of the pattern, used to speed up cache lookups */
+	uint32_t  hash;
+
+	/** The number of references to this object */
+	unsigned int refcount;
+
+	/** Navigation pointers for the least-recently-used cache list */
+	struct regexp *next, *prev;
+
+} regexp_t;
+
+int regexp_compile(regexp_t **dest, const char *pattern, int cflags);
+int regexp_destroy(regexp_t **re);
+
+int regexp_match(bool *result, regexp_t *re, const string_t *src);
+int regexp_subst(string_t *src, regexp_t *re, const char *replacement);
+int regexp_extract(regexp_t *re, const string_t *src, ...);
+int regexp_vextract(regexp_t *re, const string_t *src, va_list ap);
+
+/* Compiled regex cache */
+
+int regexp_cache_get(regexp_t **dest, const char *pattern, int cflags);
+int regexp_cache_flush(void);
+
+#endif
@@ -0,0 +1,121 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_SERIAL_H
+#define _NC_SERIAL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "nc_string.h"
+#include "nc_strview.h"
+
+/*
+ * Binary serialization.
+ *
+ * A serialized object is a header, a sequence of records and a trailer:
+ *
+ *	magic	  4 bytes, SERIAL_MAGIC
+ *	type	  1 byte, SERIAL_LIST or SERIAL_HASH
+ *	count	  varint, the number of records
+ *	records	  each one is a varint length followed by the raw bytes
+ *	checksum  8 bytes, little-endian, of everything before it
+ *
+ * A list is stored as one record per element. A hash is stored as a
+ * key record followed by a value record for each pair. Varints use the
+ * LEB128 encoding: seven bits per byte, least significant group first.
+ */
+
+/** The first bytes of every serialized object */
+#define SERIAL_MAGIC		"NCB1"
+
+/* Object types */
+#define SERIAL_LIST		'L'
+#define SERIAL_HASH		'H'
+
+/** The length of the magic number and type */
+#define SERIAL_HEADER_SIZE	5
+
+/** The length of the checksum */
+#define SERIAL_CHECKSUM_SIZE	8
+
+/** The length of the longest varint */
+#define SERIAL_VARINT_MAX	10
+
+/** The amount of output that a writer buffers before writing to a file descriptor */
+#define SERIAL_FLUSH_SIZE	(256 * 1024)
+
+/** A running checksum */
+typedef struct serial_sum {
+	uint64_t hash;
+	uint64_t carry;
+	size_t   carry_len;
+	uint64_t total;
+} serial_sum_t;
+
+/** An encoder that writes to a string, or through a string to a file descriptor. */
+typedef struct serial_writer {
+
+	/** The output, or the output that has not yet been written to @a fd */
+	string_t    *buf;
+
+	/** The output file descriptor, or -1 to keep all output in @a buf */
+	int          fd;
+
+	/** The number of bytes at the start of @a buf that are included in @a sum */
+	size_t       summed;
+
+	serial_sum_t sum;
+
+} serial_writer_t;
+
+/**
+ * A decoder.
+ *
+ * Each record is returned as a view of the input buffer, so nothing is
+ * copied. The input must remain valid for as long as the views are used.
+ */
+typedef struct serial_reader {
+
+	/** The next byte to decode, and the end of the records */
+	const char *pos, *end;
+
+	/** The number of records that have not been read */
+	size_t      count;
+
+	/** The object type */
+	int         type;
+
+	/** The memory that was mapped by serial_map_file(), or NULL */
+	void       *map;
+	size_t      map_len;
+
+} serial_reader_t;
+
+int serial_checksum(uint64_t *dest, const void *buf, size_t len);
+
+int serial_writer_init(serial_writer_t *w, string_t *buf, int fd, int type, size_t count);
+int serial_put(serial_writer_t *w, const void *src, size_t len);
+int serial_finish(serial_writer_t *w);
+
+int serial_reader_init(serial_reader_t *r, const void *buf, size_t len, int type);
+int serial_read(strview_t *dest, serial_reader_t *r);
+int serial_map_file(serial_reader_t *r, const char *path, int type);
+int serial_unmap(serial_reader_t *r);
+
+#endif
@@ -19,6 +19,7 @@
 #ifndef _NC_SERVER_H
 #define _NC_SERVER_H
 
+#include "nc_cidr.h"
 #include "nc_string.h"
 #include "nc_socket.h"
 
@@ -50,6 +51,15 @@ typedef struct server {
 	/** The server socket used for the bind(2) call */
 	socket_t   *sock;
 
+	/** Network prefixes that are allowed (1) or denied (0) by server_allow()
+	 *  and server_deny(), or NULL to accept every client. The longest
+	 *  matching prefix decides, before any session is created.
+	 */
+	cidr_t     *acl;
+
+	/** If true, clients that do not match any prefix in @a acl are rejected */
+	bool        acl_default_deny;
+
 	/** A session controller; function pointers for all aspects of a session
 	 *
 	 * This should be set by the user prior to calling server_run()
@@ -69,6 +79,8 @@ int server_destroy(server_t **srv);
 int server_socket(server_t *srv);
 int server_multiplex(list_t *bind_addr, int (*constructor[])(server_t *));
 int server_dump(server_t *srv);
+int server_allow(server_t *srv, char_t *prefix);
+int server_deny(server_t *srv, char_t *prefix);
 
 /** @bug ugly hack */
 
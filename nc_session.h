@@ -92,6 +92,9 @@ typedef struct session {
 		string_t  *header;
 		string_t  *body;
 		bool       asis;
+
+		/** Chunked body for large responses, sent with socket_put_strbuf() */
+		strbuf_t  *chunks;
 	} response;
 
 	/** Pointer to an opaque, protocol-specific data structure */
@@ -139,7 +142,7 @@ int session_controller_invoke(session_t *s, session_hook_t func_num, void *arg);
 
 int session_new(session_t **dest);
 int session_connect(session_t *session, int family, string_t *address, uint16_t port);
-int session_accept(session_t *s, struct server *srv);
+int session_accept(session_t *s, struct server *srv, socket_t *sock);
 int session_handler(session_t *s);
 int session_destroy(session_t **s);
 int session_reset(session_t *s);
@@ -0,0 +1,93 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_SET_H
+#define _NC_SET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nc_hash.h"
+#include "nc_list.h"
+#include "nc_string.h"
+
+/** The number of 64-bit words in each block of the Bloom filter; one cache line */
+#define SET_BLOCK_WORDS		8
+
+/** The number of Bloom filter bits per member */
+#define SET_BLOOM_BITS		16
+
+/** The number of bits that are set in the Bloom filter for each member */
+#define SET_BLOOM_K		6
+
+struct set_table;
+
+/**
+ * A set of strings with constant-time membership tests.
+ *
+ * list_find() and hash_value_exists() compare the search string with
+ * every element. A set_t stores its members in a hash table, so testing
+ * for membership costs O(length) no matter how many members there are.
+ *
+ * A blocked Bloom filter sits in front of the table. Each member sets
+ * SET_BLOOM_K bits within a single 512-bit block, so most strings that
+ * are not members are rejected after reading one cache line, without
+ * probing the table or comparing any strings.
+ *
+ * set_sort() builds a sorted array of the members, which is used by
+ * set_find_prefix() and set_to_list(). It is discarded whenever the set
+ * is modified.
+ */
+typedef struct set {
+
+	/** The number of members */
+	size_t    count;
+
+	/** The members, in an open-addressed hash table */
+	struct set_table *table;
+
+	/** The Bloom filter, with @a nblocks blocks of SET_BLOCK_WORDS words */
+	uint64_t *bloom;
+	size_t    nblocks;
+
+	/** The members in sorted order, or NULL if the set has changed since set_sort() */
+	const string_t **sorted;
+
+} set_t;
+
+int set_new(set_t **dest);
+int set_destroy(set_t **s);
+int set_truncate(set_t *s);
+
+/* Adding and removing members */
+
+int set_add(set_t *s, char_t *value);
+int set_add_str(set_t *s, const string_t *value);
+int set_delete(set_t *s, char_t *value);
+int set_from_list(set_t *dest, const list_t *src);
+int set_from_hash_values(set_t *dest, const hash_t *src);
+
+/* Searching */
+
+int set_contains(bool *result, const set_t *s, char_t *value);
+int set_contains_str(bool *result, const set_t *s, const string_t *value);
+int set_sort(set_t *s);
+int set_find_prefix(list_t *dest, set_t *s, char_t *prefix);
+int set_to_list(list_t *dest, set_t *s);
+
+#endif
@@ -39,5 +39,7 @@ void default_sigchld_handler(void);
 int signal_library_init(void);
 int signal_mask_all(void);
 int signal_unmask_all(void);
+int signal_wakeup_fd(int *dest);
+int signal_wakeup_drain(void);
 
 #endif
@@ -0,0 +1,127 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_SKIPLIST_H
+#define _NC_SKIPLIST_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "nc_list.h"
+#include "nc_memory.h"
+#include "nc_string.h"
+
+/** The maximum number of levels in a skip list */
+#define SKIPLIST_LEVEL_MAX	32
+
+/** A node in a skip list. */
+typedef struct skiplist_node {
+
+	/** The key, which determines the position of the node */
+	string_t *key;
+
+	/** The value associated with the key */
+	string_t *value;
+
+	/** The previous node in key order, or NULL if this is the first node */
+	struct skiplist_node *prev;
+
+	/** The number of elements in @a next */
+	size_t    level;
+
+	/** The next node at each level; next[0] is the next node in key order */
+	struct skiplist_node *next[];
+
+} skiplist_node_t;
+
+/**
+ * Ordered map.
+ *
+ * This is a skip list of key/value pairs that is kept in ascending key
+ * order, using the same ordering as list_sort() with SORT_DEFAULT. Insert,
+ * delete and lookup take O(log n) time on average, and the entries can
+ * be walked in order at any time without sorting them.
+ *
+ * Integer keys are stored as 8-byte big-endian strings by the *_u64()
+ * functions, so that they sort in numeric order. A list should use
+ * either string keys or integer keys, but not both.
+ */
+typedef struct skiplist {
+
+	/** A sentinel node with SKIPLIST_LEVEL_MAX levels that precedes the first node */
+	skiplist_node_t *head;
+
+	/** The last node, or NULL if the list is empty */
+	skiplist_node_t *tail;
+
+	/** The number of levels that are in use */
+	size_t    level;
+
+	/** The number of key/value pairs in the list */
+	size_t    count;
+
+	/** The state of the random number generator that chooses node levels */
+	uint64_t  seed;
+
+} skiplist_t;
+
+int skiplist_new(skiplist_t **dest);
+int skiplist_destroy(skiplist_t **sl);
+int skiplist_truncate(skiplist_t *sl);
+
+/* String keys */
+
+int skiplist_set(skiplist_t *sl, char_t *key, const string_t *value);
+int skiplist_get(string_t *dest, const skiplist_t *sl, char_t *key);
+int skiplist_lookup(const string_t **dest, const skiplist_t *sl, char_t *key);
+int skiplist_delete(skiplist_t *sl, char_t *key);
+int skiplist_seek(const skiplist_node_t **dest, const skiplist_t *sl, char_t *key);
+
+/* Integer keys */
+
+int skiplist_set_u64(skiplist_t *sl, uint64_t key, const string_t *value);
+int skiplist_get_u64(string_t *dest, const skiplist_t *sl, uint64_t key);
+int skiplist_delete_u64(skiplist_t *sl, uint64_t key);
+int skiplist_seek_u64(const skiplist_node_t **dest, const skiplist_t *sl, uint64_t key);
+int skiplist_key_u64(uint64_t *dest, const skiplist_node_t *node);
+
+/* Ordered access */
+
+int skiplist_first(const skiplist_node_t **dest, const skiplist_t *sl);
+int skiplist_last(const skiplist_node_t **dest, const skiplist_t *sl);
+int skiplist_pop_first(string_t *key, string_t *value, skiplist_t *sl);
+int skiplist_get_keys(list_t *dest, const skiplist_t *sl);
+
+/* ---------------------------- INLINE FUNCTIONS ------------------------------ */
+
+/**
+ * Get the node that follows another node in key order.
+ *
+ * Together with skiplist_first() or skiplist_seek(), this walks a range
+ * of keys. The pointer is invalidated when the node is deleted.
+ *
+ * @param node the current node
+ * @return the next node, or NULL if @a node is the last one
+ */
+static inline UNUSED const skiplist_node_t *
+skiplist_next(const skiplist_node_t *node)
+{
+	return node->next[0];
+}
+
+#endif
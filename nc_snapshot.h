@@ -0,0 +1,100 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_SNAPSHOT_H
+#define _NC_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "nc_hash.h"
+#include "nc_list.h"
+#include "nc_string.h"
+#include "nc_thread.h"
+
+struct snapshot;
+
+/** Builds a new version of a snapshot and publishes it; called by snapshot_reload() */
+typedef int (*snapshot_loader_t)(struct snapshot *s, void *arg);
+
+/**
+ * A shared, read-only object that can be replaced while it is being read.
+ *
+ * Configuration that is read by every session thread, such as a list
+ * or hash table, is built once and published with snapshot_publish_list()
+ * or snapshot_publish_hash(). After that it must never be modified.
+ * Readers surround each use of it with snapshot_acquire() and
+ * snapshot_release(), which take no locks:
+ *
+ *	const hash_t *conf;
+ *
+ *	snapshot_acquire((const void **) &conf, s);
+ *	... read conf ...
+ *	snapshot_release();
+ *
+ * Publishing a new version swaps the pointer atomically. Readers that
+ * already hold the old version keep using it, and it is destroyed with
+ * epoch_retire() once the last of them has called snapshot_release().
+ *
+ * If a loader is set with snapshot_set_loader(), server_multiplex()
+ * calls it to build and publish a new version when SIGHUP is received.
+ */
+typedef struct snapshot {
+
+	/** The current object. Readers must use snapshot_acquire(). */
+	void       *current;
+
+	/** The function that destroys @a current */
+	callback_t  destroy;
+
+	/** The number of objects that have been published */
+	uint64_t    version;
+
+	/** Serializes writers */
+	mutex_t     lock;
+
+	/** The function that builds a new version, or NULL */
+	snapshot_loader_t loader;
+	void       *loader_arg;
+
+	/** The next snapshot that is reloaded by snapshot_reload_all() */
+	struct snapshot *next;
+
+} snapshot_t;
+
+int snapshot_new(snapshot_t **dest);
+int snapshot_destroy(snapshot_t **s);
+
+/* Publishing */
+
+int snapshot_publish(snapshot_t *s, void *obj, callback_t destroy);
+int snapshot_publish_list(snapshot_t *s, list_t **list);
+int snapshot_publish_hash(snapshot_t *s, hash_t **hash);
+
+/* Reading */
+
+int  snapshot_acquire(const void **dest, snapshot_t *s);
+void snapshot_release(void);
+int  snapshot_get(string_t *dest, snapshot_t *s, char_t *key);
+
+/* Reloading */
+
+int snapshot_set_loader(snapshot_t *s, snapshot_loader_t loader, void *arg);
+int snapshot_reload(snapshot_t *s);
+int snapshot_reload_all(void);
+
+#endif
@@ -38,6 +38,7 @@
 #endif
 
 #include "nc_list.h"
+#include "nc_strbuf.h"
 
 /* The size (in bytes) of the socket receive buffer */
 #define RECV_BUF_SIZE     16*1024
@@ -189,4 +190,17 @@ socket_put_str(socket_t *sock, string_t *src)
 	return socket_write(sock, src->value, str_len(src));
 }
 
+
+/**
+ * Write the contents of a string builder to a socket.
+ * 
+ * @param sock socket object
+ * @param src a string builder
+*/
+static inline int
+socket_put_strbuf(socket_t *sock, const strbuf_t *src)
+{
+	return strbuf_write(src, sock->fd);
+}
+
 #endif
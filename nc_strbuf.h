@@ -0,0 +1,90 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_STRBUF_H
+#define _NC_STRBUF_H
+
+#include <stdarg.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "nc_string.h"
+
+/** The number of bytes of data in each chunk that is owned by a strbuf_t */
+#define STRBUF_CHUNK_SIZE	8192
+
+/** The maximum number of chunks that are passed to a single writev(2) call */
+#define STRBUF_IOV_MAX		64
+
+/** A single chunk within a strbuf_t. */
+typedef struct strbuf_chunk {
+
+	/** The next chunk in the chain */
+	struct strbuf_chunk *next;
+
+	/** Pointer to the data; either @a buf or a borrowed buffer */
+	const char *data;
+
+	/** The number of bytes of data in the chunk */
+	size_t      len;
+
+	/** The capacity of @a buf, or zero if the data is borrowed */
+	size_t      size;
+
+	/** Storage for the data of an owned chunk */
+	char        buf[];
+
+} strbuf_chunk_t;
+
+/**
+ * A string builder made of a chain of fixed-size chunks.
+ *
+ * Appending never moves data that has already been written, so a large
+ * response can be built in linear time. The chunks can be passed directly
+ * to writev(2) without first copying them into a single buffer.
+ */
+typedef struct strbuf {
+
+	/** The first and last chunks in the chain */
+	strbuf_chunk_t *head, *tail;
+
+	/** The total length of the data, in bytes */
+	size_t    len;
+
+	/** The number of chunks in the chain */
+	size_t    nchunks;
+
+} strbuf_t;
+
+int strbuf_new(strbuf_t **dest);
+int strbuf_destroy(strbuf_t **sb);
+int strbuf_truncate(strbuf_t *sb);
+
+int strbuf_append(strbuf_t *sb, const void *src, size_t len);
+int strbuf_append_ref(strbuf_t *sb, const void *src, size_t len);
+int strbuf_append_str(strbuf_t *sb, const string_t *src);
+int strbuf_cat(strbuf_t *sb, const char *src);
+int strbuf_printf(strbuf_t *sb, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+int strbuf_vprintf(strbuf_t *sb, const char *format, va_list ap);
+
+int strbuf_to_iovec(struct iovec *dest, size_t max, size_t *count, const strbuf_t *sb);
+int strbuf_to_str(string_t *dest, const strbuf_t *sb);
+int strbuf_write(const strbuf_t *sb, int fd);
+
+#endif
@@ -104,7 +104,7 @@ extern const string_t EMPTY_STRING;
 /**
  * New, fancy C99 way to convert a (const char *) to a (const string *)
  */
-#define CSTRING(x)	(&(const string_t){ x, sizeof(x) - 1, sizeof(x), false })
+#define CSTRING(x)	(&(const string_t){ x, sizeof(x), sizeof(x) - 1, false })
 
 #define str_assert(s)	(s != NULL && s->value != NULL)
 
@@ -129,6 +129,8 @@ int str_resize(string_t *str, size_t new_size);
 int str_cat(string_t *dest, /*@unique@*/ const char *src);
 int str_prepend(string_t *dest, /*@unique@*/ const string_t *src);
 int str_append(string_t *dest, const string_t *src);
+int str_append_bytes(string_t *dest, const void *src, size_t len);
+int str_ncat(string_t *dest, const char *src, size_t len);
 int str_putc(string_t *dest, const int c);
 int str_get_char(var_char_t *dest, string_t *str, size_t position);
 int str_divide(/*@unique@*/ string_t *left, /*@unique@*/ string_t *right, /*@unique@*/ const string_t *src, size_t position);
@@ -152,6 +154,8 @@ int str_to_int(int *dest, string_t *src);
 int str_to_int32(int32_t *dest, string_t *src);
 int str_to_uint32(uint32_t *dest, const string_t *src);
 int str_to_ulong(unsigned long *dest, const string_t *src);
+int str_parse_uint64(uint64_t *dest, const char *src, size_t len);
+int str_parse_int64(int64_t *dest, const char *src, size_t len);
 
 /* System UID and GID conversion */
 // DEADWOOD - Moved to passwd.c
@@ -0,0 +1,111 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_STRTAB_H
+#define _NC_STRTAB_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "nc_list.h"
+#include "nc_memory.h"
+#include "nc_string.h"
+#include "nc_strview.h"
+
+/** The location of one string within a strtab_t. */
+typedef struct strtab_entry {
+
+	/** The offset of the first character within the buffer */
+	size_t    offset;
+
+	/** The length of the string, not counting its NUL terminator */
+	size_t    len;
+
+} strtab_entry_t;
+
+/**
+ * A packed table of strings.
+ *
+ * Every string is appended to one growable buffer, followed by a NUL
+ * character, and its location is recorded in an array of entries. A
+ * table of small strings therefore needs two allocations in total,
+ * instead of three per element for a list_t, and iterating over it
+ * reads memory sequentially.
+ *
+ * Sorting rearranges only the entries; the strings are never moved.
+ */
+typedef struct strtab {
+
+	/** The buffer that holds the strings */
+	char     *data;
+
+	/** The number of bytes of @a data that are in use, and allocated */
+	size_t    data_len, data_size;
+
+	/** The array of entries, in index order */
+	strtab_entry_t *entry;
+
+	/** The number of entries in use, and allocated */
+	size_t    count, size;
+
+	/** True if the entries are in ascending order, so strtab_search() can be used */
+	bool      sorted;
+
+} strtab_t;
+
+int strtab_new(strtab_t **dest);
+int strtab_destroy(strtab_t **tab);
+int strtab_truncate(strtab_t *tab);
+int strtab_reserve(strtab_t *tab, size_t count, size_t bytes);
+
+/* Adding and reading strings */
+
+int strtab_append(strtab_t *tab, const void *src, size_t len);
+int strtab_push(strtab_t *tab, const string_t *src);
+int strtab_cat(strtab_t *tab, const char *src);
+int strtab_get(strview_t *dest, const strtab_t *tab, size_t index);
+int strtab_next(strview_t *dest, size_t *pos, const strtab_t *tab);
+
+/* Sorting and searching */
+
+int strtab_sort(strtab_t *tab, int flags);
+int strtab_search(size_t *index, const strtab_t *tab, const void *key, size_t len);
+
+/* Conversion */
+
+int strtab_from_list(strtab_t *dest, const list_t *src);
+int strtab_to_list(list_t *dest, const strtab_t *src);
+
+/* ---------------------------- INLINE FUNCTIONS ------------------------------ */
+
+/**
+ * Borrow a pointer to a NUL-terminated string, without copying it.
+ *
+ * The pointer is invalidated by any call that adds strings to the table.
+ *
+ * @param tab the table
+ * @param index the index of the string
+ * @return the string, or NULL if @a index is out of range
+ */
+static inline UNUSED const char *
+strtab_at(const strtab_t *tab, size_t index)
+{
+	return (index < tab->count) ? tab->data + tab->entry[index].offset : NULL;
+}
+
+#endif
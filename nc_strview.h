@@ -0,0 +1,240 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_STRVIEW_H
+#define _NC_STRVIEW_H
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "nc_memory.h"
+#include "nc_string.h"
+
+/**
+ * A borrowed, read-only slice of a string.
+ *
+ * A view does not own the memory it points to and is not NUL-terminated.
+ * It is only valid for as long as the underlying buffer is not modified
+ * or destroyed.
+ */
+typedef struct strview {
+
+	/** Pointer to the first character of the view */
+	const char *ptr;
+
+	/** The number of characters in the view */
+	size_t      len;
+
+} strview_t;
+
+/** Create a view of a string literal */
+#define STRVIEW(x)	((strview_t){ x, sizeof(x) - 1 })
+
+int strview_split(strview_t *dest, size_t max, size_t *count, strview_t src, int delimiter);
+int str_split_views(strview_t *dest, size_t max, size_t *count, const string_t *src, int delimiter);
+
+int strview_to_uint64(uint64_t *dest, strview_t src);
+int strview_to_int64(int64_t *dest, strview_t src);
+int strview_to_uint32(uint32_t *dest, strview_t src);
+
+int str_from_view(string_t *dest, strview_t src);
+
+/* ---------------------------- INLINE FUNCTIONS ------------------------------ */
+
+/** Create a view of an entire string_t */
+static inline strview_t UNUSED
+strview_from_str(const string_t *s)
+{
+	return (strview_t){ s->value, s->len };
+}
+
+
+/** Create a view of a NUL-terminated character array */
+static inline strview_t UNUSED
+strview_from_cstr(const char *s)
+{
+	return (strview_t){ s, strlen(s) };
+}
+
+
+/**
+ * Return a view of part of another view.
+ *
+ * The offset and length are clamped to the bounds of @a v.
+ */
+static inline strview_t UNUSED
+strview_sub(strview_t v, size_t offset, size_t len)
+{
+	if (offset > v.len)
+		offset = v.len;
+	if (len > v.len - offset)
+		len = v.len - offset;
+	return (strview_t){ v.ptr + offset, len };
+}
+
+
+/**
+ * Compare two views.
+ *
+ * @return less than, equal to, or greater than zero, like memcmp(3)
+ */
+static inline int UNUSED
+strview_cmp(strview_t a, strview_t b)
+{
+	int rc;
+
+	rc = memcmp(a.ptr, b.ptr, a.len < b.len ? a.len : b.len);
+	if (rc != 0)
+		return rc;
+	return (a.len > b.len) - (a.len < b.len);
+}
+
+
+/** Return true if two views contain the same characters */
+static inline bool UNUSED
+strview_eq(strview_t a, strview_t b)
+{
+	return (a.len == b.len && memcmp(a.ptr, b.ptr, a.len) == 0);
+}
+
+
+/** Return true if a view is equal to a NUL-terminated character array */
+static inline bool UNUSED
+strview_eq_cstr(strview_t a, const char *s)
+{
+	return strview_eq(a, strview_from_cstr(s));
+}
+
+
+/** Return true if two views are equal, ignoring case; NUL bytes are compared too */
+static inline bool UNUSED
+strview_case_eq(strview_t a, strview_t b)
+{
+	size_t i;
+
+	if (a.len != b.len)
+		return false;
+	for (i = 0; i < a.len; i++) {
+		if (tolower((unsigned char) a.ptr[i]) != tolower((unsigned char) b.ptr[i]))
+			return false;
+	}
+	return true;
+}
+
+
+/** Return true if a view begins with @a prefix */
+static inline bool UNUSED
+strview_starts_with(strview_t v, strview_t prefix)
+{
+	return (v.len >= prefix.len && memcmp(v.ptr, prefix.ptr, prefix.len) == 0);
+}
+
+
+/**
+ * Find the first occurrence of a character in a view.
+ *
+ * @return the offset of the character, or -1 if it was not found
+ */
+static inline ssize_t UNUSED
+strview_chr(strview_t v, int c)
+{
+	const char *p;
+
+	if ((p = memchr(v.ptr, c, v.len)) == NULL)
+		return -1;
+	return (ssize_t) (p - v.ptr);
+}
+
+
+/**
+ * Find the first occurrence of @a needle in a view.
+ *
+ * @return the offset of the match, or -1 if it was not found
+ */
+static inline ssize_t UNUSED
+strview_find(strview_t v, strview_t needle)
+{
+	const char *p, *last;
+
+	if (needle.len == 0)
+		return 0;
+	if (needle.len > v.len)
+		return -1;
+
+	last = v.ptr + (v.len - needle.len);
+	for (p = v.ptr; p <= last; p++) {
+		if ((p = memchr(p, needle.ptr[0], (size_t) (last - p) + 1)) == NULL)
+			break;
+		if (memcmp(p, needle.ptr, needle.len) == 0)
+			return (ssize_t) (p - v.ptr);
+	}
+	return -1;
+}
+
+
+/** Return a view with leading and trailing whitespace removed */
+static inline strview_t UNUSED
+strview_trim(strview_t v)
+{
+	while (v.len > 0 && isspace((unsigned char) v.ptr[0])) {
+		v.ptr++;
+		v.len--;
+	}
+	while (v.len > 0 && isspace((unsigned char) v.ptr[v.len - 1]))
+		v.len--;
+	return v;
+}
+
+
+/**
+ * Remove the next token from the front of a view.
+ *
+ * This is an allocation-free replacement for strsep(3). Each call
+ * stores the text up to the next @a delimiter in @a tok and advances
+ * @a rest past it.
+ *
+ * @param tok view that will hold the token
+ * @param rest the unparsed remainder of the input
+ * @param delimiter the character that separates tokens
+ * @return false when there are no tokens left
+ */
+static inline bool UNUSED
+strview_tok(strview_t *tok, strview_t *rest, int delimiter)
+{
+	const char *p;
+
+	if (rest->ptr == NULL)
+		return false;
+
+	tok->ptr = rest->ptr;
+	if ((p = memchr(rest->ptr, delimiter, rest->len)) == NULL) {
+		tok->len = rest->len;
+		rest->ptr = NULL;
+		rest->len = 0;
+	} else {
+		tok->len = (size_t) (p - rest->ptr);
+		rest->len -= tok->len + 1;
+		rest->ptr = p + 1;
+	}
+	return true;
+}
+
+#endif
@@ -44,6 +44,7 @@ typedef void (*callback_t) (void *);
 #define cond_init(c)		((pthread_cond_init(&c, NULL) == 0) ? 0 : -1)
 #define cond_wait(c,m)		((pthread_cond_wait(&c, &m) == 0) ? 0 : -1)
 #define cond_signal(c)		((pthread_cond_signal(&c) == 0) ? 0 : -1)
+#define cond_broadcast(c)	((pthread_cond_broadcast(&c) == 0) ? 0 : -1)
 
 
 /** A thread. */
@@ -68,8 +69,7 @@ typedef void (*callback_t) (void *);
 /* thread_create() is a syscall in Darwin, so this shim is needed to avoid linker problems. */
 #define thread_create(a,b,c)	nc_thread_create(a,b,c)
 
-// FIXME: workaround for openbsd 4.0 wierdness
-//int nc_thread_create(thread_t *dest, callback_t func, void *data);
+int nc_thread_create(thread_t *dest, callback_t func, void *data);
 
 int thread_create_detached(callback_t func, void *data);
 
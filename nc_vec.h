@@ -0,0 +1,90 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _NC_VEC_H
+#define _NC_VEC_H
+
+#include "nc_list.h"
+#include "nc_string.h"
+
+/**
+ * A vector of strings.
+ *
+ * The strings are stored in a single contiguous array, so indexed access
+ * is O(1) and iteration touches consecutive memory. Each element owns a
+ * copy of its value. The array grows geometrically, so appending is
+ * amortized O(1).
+ */
+typedef struct vec {
+
+	/** The array of elements */
+	string_t *item;
+
+	/** The number of elements in use */
+	size_t    count;
+
+	/** The number of elements that @a item has room for */
+	size_t    size;
+
+} vec_t;
+
+int vec_new(vec_t **dest);
+int vec_destroy(vec_t **vec);
+int vec_truncate(vec_t *vec);
+int vec_reserve(vec_t *vec, size_t count);
+
+/* Adding and removing elements */
+
+int vec_push(vec_t *vec, const string_t *src);
+int vec_cat(vec_t *vec, const char *src);
+int vec_pop(string_t *dest, vec_t *vec);
+int vec_get(string_t *dest, const vec_t *vec, size_t offset);
+int vec_set(vec_t *vec, size_t offset, const string_t *src);
+int vec_insert(vec_t *vec, size_t offset, const string_t *src);
+int vec_remove(vec_t *vec, size_t offset);
+
+/* Conversion */
+
+int vec_from_list(vec_t *dest, const list_t *src);
+int vec_to_list(list_t *dest, const vec_t *src);
+int vec_join(string_t *dest, const vec_t *src, int delimiter);
+int vec_sort(vec_t *vec, int flags);
+
+/* Serialization */
+
+int vec_serialize(string_t *dest, const vec_t *src);
+int vec_deserialize(vec_t *dest, const string_t *src);
+
+/* ---------------------------- INLINE FUNCTIONS ------------------------------ */
+
+/**
+ * Borrow a pointer to an element, without copying it.
+ *
+ * The pointer is invalidated by any call that adds or removes elements.
+ *
+ * @param vec the vector
+ * @param offset the index of the element
+ * @return the element, or NULL if @a offset is out of range
+ */
+static inline UNUSED const string_t *
+vec_at(const vec_t *vec, size_t offset)
+{
+	return (offset < vec->count) ? &vec->item[offset] : NULL;
+}
+
+#endif
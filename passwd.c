@@ -26,11 +26,12 @@
 
 #include "nc_exception.h"
 #include "nc_file.h"
-#include "nc_hash.h"
 #include "nc_list.h"
 #include "nc_log.h"
 #include "nc_memory.h"
 #include "nc_string.h"
+#include "nc_strtab.h"
+#include "nc_strview.h"
 #include "nc_thread.h"
 
 #include "nc_passwd.h"
@@ -105,59 +106,95 @@ passwd_getpwuid(uid_t uid, struct passwd *pwbuf, char *buf, size_t buflen, struc
 /* ----------------- GLOBAL FUNCTIONS ------------------------------*/
 
 
+/**
+ * Create a new UID map.
+ *
+ * @param dest the new map
+*/
 int
-passwd_get_symbolic_uid(string_t *dest, hash_t *map, uid_t uid)
+uid_map_new(uid_map_t **dest)
 {
-	string_t *uid_str, *result;
+	uid_map_t *map = NULL;
+
+	mem_calloc(map);
+	if (uid_index_new(&map->index) < 0 || strtab_new(&map->names) < 0)
+		throw_silent();
+	*dest = map;
+	map = NULL;
+
+finally:
+	(void) uid_map_destroy(&map);
+}
 
-	/* Convert the UID to a string */
-	str_sprintf(uid_str, "%u", uid);
 
-	/* Lookup the UID in the map */
-	hash_get(result, map, uid_str->value);
+/**
+ * Destroy a UID map.
+ *
+ * @param map the object to be destroyed; this will be set to NULL.
+*/
+int
+uid_map_destroy(uid_map_t **map)
+{
+
+	if (*map == NULL)
+		return 0;
 
-	/* Copy the result to the caller */
-	str_copy(dest, result);
+	(void) uid_index_destroy(&(*map)->index);
+	(void) strtab_destroy(&(*map)->names);
+	free(*map);
+	*map = NULL;
 }
 
 
 int
-passwd_get_uid_map(hash_t *map)
+passwd_get_symbolic_uid(string_t *dest, const uid_map_t *map, uid_t uid)
 {
-	string_t *buf, *path, *line, *uid_num, *uid_sym;
-	list_t   *rows, *cols;
-	size_t    i    = 0;
+	size_t *i;
 
-	hash_truncate(map);
+	if ((i = uid_index_lookup(map->index, uid)) == NULL)
+		throwf("unknown UID: %u", (unsigned int) uid);
+
+	str_cpy(dest, strtab_at(map->names, *i));
+}
+
+
+int
+passwd_get_uid_map(uid_map_t *map)
+{
+	string_t *buf, *path;
+	strview_t rest, line, col[4];
+	uint32_t  uid;
+	size_t    ncols;
+
+	uid_index_truncate(map->index);
+	strtab_truncate(map->names);
 
 	/* Read the contents of the /etc/passwd file */
 	str_cpy(path, "/etc/passwd");
 	file_read(buf, path);
 
-	/* Convert the raw buffer into a list of lines */
-	str_chomp(buf);
-	str_split(rows, buf, '\n');
-
 	/* Process each row */
-	for (i = 0; i < rows->count; i++) {
-
-		list_get(line, rows, i);
+	rest = strview_from_str(buf);
+	while (strview_tok(&line, &rest, '\n')) {
 
-		/* Skip lines that are commented out */
-		if (str_ncmp(line, "#", 1) == 0) 
+		/* Skip blank lines and lines that are commented out */
+		if (line.len == 0 || line.ptr[0] == '#') 
 			continue;
 
 		/* Split the row into ':' delimited columns */
-		str_split(cols, line, ':');
-
-		/* Load the symbolic UID and numeric UID */
-		list_get(uid_sym, cols, 0);
-		list_get(uid_num, cols, 2);
+		strview_split(col, 4, &ncols, line, ':');
+		if (ncols < 3)
+			continue;
 
-		//log_debug("%s (uid=%s)", uid_sym->value, uid_num->value);
+		/* Parse the numeric UID */
+		if (strview_to_uint32(&uid, col[2]) < 0)
+			continue;
 
-		/* Add it to the hash */
-		hash_set(map, uid_num->value, uid_sym);
+		/* Add the symbolic UID to the map */
+		if (strtab_append(map->names, col[0].ptr, col[0].len) < 0 || uid_index_set(map->index, (uid_t) uid, map->names->count - 1) < 0) {
+			log_error("%s", "unable to add a user to the UID map");
+			throw_silent();
+		}
 	}
 }
 
@@ -0,0 +1,487 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Compiled regular expressions.
+ *
+ * Compiling a pattern with regcomp(3) is much more expensive than
+ * executing it, so compiled expressions are kept in a small
+ * least-recently-used cache that is shared by all threads.
+ * The str_*_regex() functions use the cache transparently; programs
+ * that run the same expression many times can hold on to a regexp_t
+ * object instead.
+*/
+
+#include "config.h"
+
+#include "nc_exception.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_regexp.h"
+#include "nc_string.h"
+#include "nc_thread.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------- GLOBAL VARIABLES ------------------------------- */
+
+/** Protects the regex cache and the reference count of every regexp_t */
+static mutex_t REGEXP_CACHE_MUTEX = MUTEX_INITIALIZER;
+
+/** The most-recently-used entry in the regex cache */
+static regexp_t *REGEXP_CACHE_HEAD = NULL;
+
+/** The least-recently-used entry in the regex cache */
+static regexp_t *REGEXP_CACHE_TAIL = NULL;
+
+/** The number of entries in the regex cache */
+static size_t REGEXP_CACHE_SIZE = 0;
+
+/* -------------------------------- FUNCTIONS -------------------------------- */
+
+/**
+ * Print a regular expression error message to the system log.
+ *
+ * @param regex_errno errno as returned by a regex function call
+ * @param preg the compiled regular expression that caused the error
+ * @returns This function always returns -1.
+*/
+static inline int
+regexp_error(int regex_errno, regex_t *preg)
+{
+	char errbuf[80];
+
+	(void) regerror(regex_errno, preg, (char *) &errbuf, sizeof(errbuf));
+	log_error("regex error: %s", errbuf);
+
+	throw_silent();
+}
+
+
+/**
+ * Compute the 32-bit FNV-1a hash of a pattern.
+ *
+ * @param result the computed hash value
+ * @param pattern regular expression pattern
+*/
+static inline int
+regexp_hash(uint32_t *result, const char *pattern)
+{
+	uint32_t h = 2166136261U;
+
+	for (; *pattern != '\0'; pattern++) {
+		h ^= (uint8_t) *pattern;
+		h *= 16777619U;
+	}
+
+	*result = h;
+}
+
+
+/**
+ * Release the memory used by a regexp_t object.
+ *
+ * This is an internal function that ignores the reference count.
+*/
+static int
+regexp_free(regexp_t *re)
+{
+
+	regfree(&re->preg);
+	(void) str_destroy(&re->pattern);
+	free(re);
+}
+
+
+/**
+ * Remove an entry from the regex cache.
+ *
+ * The caller must hold REGEXP_CACHE_MUTEX.
+*/
+static int
+regexp_cache_unlink(regexp_t *re)
+{
+
+	if (re->prev != NULL)
+		re->prev->next = re->next;
+	else
+		REGEXP_CACHE_HEAD = re->next;
+
+	if (re->next != NULL)
+		re->next->prev = re->prev;
+	else
+		REGEXP_CACHE_TAIL = re->prev;
+
+	re->next = re->prev = NULL;
+	REGEXP_CACHE_SIZE--;
+}
+
+
+/**
+ * Add an entry to the front of the regex cache.
+ *
+ * The caller must hold REGEXP_CACHE_MUTEX.
+*/
+static int
+regexp_cache_push(regexp_t *re)
+{
+
+	re->prev = NULL;
+	re->next = REGEXP_CACHE_HEAD;
+	if (REGEXP_CACHE_HEAD != NULL)
+		REGEXP_CACHE_HEAD->prev = re;
+	else
+		REGEXP_CACHE_TAIL = re;
+	REGEXP_CACHE_HEAD = re;
+	REGEXP_CACHE_SIZE++;
+}
+
+
+/**
+ * Search the regex cache for a compiled expression.
+ *
+ * If a match is found, it is moved to the front of the cache
+ * and a new reference is given to the caller.
+ * The caller must hold REGEXP_CACHE_MUTEX.
+ *
+ * @param dest the matching entry, or NULL if there was no match
+*/
+static int
+regexp_cache_search(regexp_t **dest, uint32_t hash, const char *pattern, int cflags)
+{
+	regexp_t *cur;
+
+	for (cur = REGEXP_CACHE_HEAD; cur != NULL; cur = cur->next) {
+		if (cur->hash == hash && cur->cflags == cflags &&
+				strcmp(cur->pattern->value, pattern) == 0) {
+			regexp_cache_unlink(cur);
+			regexp_cache_push(cur);
+			cur->refcount++;
+			break;
+		}
+	}
+
+	*dest = cur;
+}
+
+
+/**
+ * Compile a regular expression.
+ *
+ * Patterns are always compiled as case-insensitive extended regular
+ * expressions, in addition to any flags given in @a cflags.
+ *
+ * @param dest a new regexp_t object
+ * @param pattern regular expression pattern
+ * @param cflags additional flags passed to regcomp(3)
+*/
+int
+regexp_compile(regexp_t **dest, const char *pattern, int cflags)
+{
+	regexp_t *re = NULL;
+	int i;
+
+	require(pattern != NULL);
+
+	mem_calloc(re);
+	re->cflags = REG_EXTENDED | REG_ICASE | cflags;
+	re->refcount = 1;
+	if (str_new(&re->pattern) < 0 || str_cpy(re->pattern, pattern) < 0)
+		throw_silent();
+	(void) regexp_hash(&re->hash, pattern);
+
+	if ((i = regcomp(&re->preg, pattern, re->cflags)) != 0) {
+		log_warning("regex compilation failed for `%s'", pattern);
+		(void) regexp_error(i, &re->preg);
+		throw_silent();
+	}
+
+	*dest = re;
+	re = NULL;
+
+finally:
+	if (re != NULL) {
+		(void) str_destroy(&re->pattern);
+		free(re);
+	}
+}
+
+
+/**
+ * Release a reference to a compiled regular expression.
+ *
+ * The object is freed when the last reference is released.
+ *
+ * @param re the object to be released; this will be set to NULL.
+*/
+int
+regexp_destroy(regexp_t **re)
+{
+	regexp_t *p;
+	bool      last;
+
+	if (*re == NULL)
+		return 0;
+
+	p = *re;
+	*re = NULL;
+
+	mutex_lock(REGEXP_CACHE_MUTEX);
+	last = (--p->refcount == 0);
+	mutex_unlock(REGEXP_CACHE_MUTEX);
+
+	if (last)
+		(void) regexp_free(p);
+}
+
+
+/**
+ * Test if a string matches a compiled regular expression.
+ *
+ * @param result store the result; matched (true) or not matched (false)
+ * @param re compiled regular expression
+ * @param src string to be examined
+*/
+int
+regexp_match(bool *result, regexp_t *re, const string_t *src)
+{
+	int i;
+
+	require(re != NULL && src != NULL);
+
+	i = regexec(&re->preg, src->value, 0, NULL, 0);
+	if (i == 0) {
+		*result = true;
+	} else if (i == REG_NOMATCH) {
+		*result = false;
+	} else {
+		return regexp_error(i, &re->preg);
+	}
+}
+
+
+/**
+ * Perform substring replacement using a compiled regular expression.
+ *
+ * Whatever the expression matches will be replaced.
+ *
+ * @param src string to be modified
+ * @param re compiled regular expression
+ * @param replacement replacement text
+*/
+int
+regexp_subst(string_t *src, regexp_t *re, const char *replacement)
+{
+	string_t   *result;
+	regmatch_t  pmatch[1];
+	int i;
+
+	require(re != NULL && src != NULL);
+
+	if (re->cflags & REG_NOSUB)
+		throw("expression was compiled with REG_NOSUB");
+
+	i = regexec(&re->preg, src->value, 1, pmatch, 0);
+	if (i == REG_NOMATCH)
+		return 0;
+	else if (i != 0)
+		return regexp_error(i, &re->preg);
+
+	/* NOTE: rm_so and rm_eo are 'long long' (a.k.a regoff_t) type
+	   and must be downcast to 'size_t' type
+	 */
+
+	/* Copy the beginning part of the string */
+	str_ncpy(result, src->value, (size_t) pmatch[0].rm_so);
+
+	/* Insert the replacement text */
+	str_cat(result, replacement);
+
+	/* Copy the end part of the original string */
+	str_cat(result, src->value + (size_t) pmatch[0].rm_eo);
+
+	/* Replace the input buffer with the result */
+	str_move(src, result);
+}
+
+
+/**
+ * Retrieve one or more substrings using a compiled regular expression.
+ *
+ * Each parenthesized sub-expression is copied into the next string_t
+ * in the argument list. Sub-expressions that did not participate
+ * in the match are copied as empty strings.
+ *
+ * @param re compiled regular expression
+ * @param src string to be examined
+ * @param ap a list of (string_t *) to store the results in
+ * @return 0 if the expression matches, -1 if there is no match or an error
+*/
+int
+regexp_vextract(regexp_t *re, const string_t *src, va_list ap)
+{
+	regmatch_t  pmatch[REGEXP_NSUB_MAX];
+	string_t   *buf = NULL;
+	size_t      i;
+	int         rc;
+
+	require(re != NULL && src != NULL);
+
+	if (re->cflags & REG_NOSUB)
+		throw("expression was compiled with REG_NOSUB");
+
+	/* Check if pmatch is large enough to hold all the results */
+	if (re->preg.re_nsub >= REGEXP_NSUB_MAX)
+		throw("too many sub-expressions");
+
+	/* Execute the regex */
+	rc = regexec(&re->preg, src->value, REGEXP_NSUB_MAX, pmatch, 0);
+	if (rc == REG_NOMATCH) {
+		return -1;
+	} else if (rc != 0) {
+		log_warning("regexec failed for `%s'", re->pattern->value);
+		return regexp_error(rc, &re->preg);
+	}
+
+	/* Retreive the results and copy them to the caller */
+	for (i = 1; i <= re->preg.re_nsub; i++) {
+		if ((buf = va_arg(ap, string_t *)) == NULL)
+			break;
+		if (pmatch[i].rm_so < 0) {
+			str_truncate(buf);
+		} else {
+			str_ncpy(buf,
+					src->value + pmatch[i].rm_so,
+					(size_t) pmatch[i].rm_eo - (size_t) pmatch[i].rm_so
+				);
+		}
+	}
+}
+
+
+/**
+ * Retrieve one or more substrings using a compiled regular expression.
+ *
+ * @see regexp_vextract()
+*/
+int
+regexp_extract(regexp_t *re, const string_t *src, ...)
+{
+	va_list ap;
+	int     rc;
+
+	va_start(ap, src);
+	rc = regexp_vextract(re, src, ap);
+	va_end(ap);
+
+	return rc;
+}
+
+
+/**
+ * Get a compiled regular expression from the regex cache.
+ *
+ * If the pattern is not in the cache, it is compiled and added to the
+ * cache. When the cache is full, the least-recently-used entry is evicted;
+ * it remains valid until the last thread using it calls regexp_destroy().
+ *
+ * @param dest a reference to the compiled expression
+ * @param pattern regular expression pattern
+ * @param cflags additional flags passed to regcomp(3)
+ * @see regexp_compile()
+*/
+int
+regexp_cache_get(regexp_t **dest, const char *pattern, int cflags)
+{
+	regexp_t *cur = NULL, *re = NULL, *victim = NULL;
+	uint32_t  hash;
+
+	require(pattern != NULL);
+
+	(void) regexp_hash(&hash, pattern);
+	cflags |= REG_EXTENDED | REG_ICASE;
+
+	/* Look for the expression in the cache */
+	mutex_lock(REGEXP_CACHE_MUTEX);
+	(void) regexp_cache_search(&cur, hash, pattern, cflags);
+	mutex_unlock(REGEXP_CACHE_MUTEX);
+	if (cur != NULL) {
+		*dest = cur;
+		return 0;
+	}
+
+	/* Compile the expression without holding the lock */
+	if (regexp_compile(&re, pattern, cflags) < 0)
+		throw_silent();
+
+	mutex_lock(REGEXP_CACHE_MUTEX);
+
+	/* Another thread may have added the same expression in the meantime */
+	(void) regexp_cache_search(&cur, hash, pattern, cflags);
+	if (cur == NULL) {
+
+		/* The cache holds its own reference to the new entry */
+		re->refcount++;
+		(void) regexp_cache_push(re);
+		cur = re;
+		re = NULL;
+
+		/* Evict the least-recently-used entry */
+		if (REGEXP_CACHE_SIZE > REGEXP_CACHE_MAX) {
+			victim = REGEXP_CACHE_TAIL;
+			(void) regexp_cache_unlink(victim);
+			if (--victim->refcount > 0)
+				victim = NULL;
+		}
+	}
+
+	mutex_unlock(REGEXP_CACHE_MUTEX);
+
+	*dest = cur;
+
+finally:
+	if (re != NULL)
+		(void) regexp_free(re);
+	if (victim != NULL)
+		(void) regexp_free(victim);
+}
+
+
+/**
+ * Remove all entries from the regex cache.
+ *
+ * Entries that are still referenced by another thread remain valid
+ * until they are released with regexp_destroy().
+*/
+int
+regexp_cache_flush(void)
+{
+	regexp_t *cur;
+
+	mutex_lock(REGEXP_CACHE_MUTEX);
+	while ((cur = REGEXP_CACHE_HEAD) != NULL) {
+		(void) regexp_cache_unlink(cur);
+		if (--cur->refcount == 0)
+			(void) regexp_free(cur);
+	}
+	mutex_unlock(REGEXP_CACHE_MUTEX);
+}
@@ -0,0 +1,400 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Binary serialization.
+ *
+ * The text format of list_serialize() escapes every character and
+ * needs a second pass to split and unescape it. The binary format that
+ * is described in nc_serial.h stores each string as a length and its
+ * raw bytes, so encoding is a sequence of memcpy(3) calls and decoding
+ * can return views of the input without copying anything at all.
+ *
+ * The checksum processes eight bytes per step, so that verifying a
+ * large file costs little more than reading it.
+*/
+
+#include "config.h"
+
+#include "nc_exception.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_serial.h"
+#include "nc_string.h"
+#include "nc_strview.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ------------------------------ GLOBAL VARIABLES ------------------------- */
+
+#define SERIAL_ROTL(x,b)	(((x) << (b)) | ((x) >> (64 - (b))))
+
+/** Mix one little-endian word into the checksum */
+#define SERIAL_MIX(h,w)		(SERIAL_ROTL((h) ^ ((w) * 0x9e3779b97f4a7c15ULL), 31) * 0xc2b2ae3d27d4eb4fULL)
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Add bytes to a running checksum.
+*/
+static void
+serial_sum_update(serial_sum_t *sum, const void *buf, size_t len)
+  {
+	const unsigned char *p = buf;
+	uint64_t             w, h = sum->hash;
+
+	sum->total += len;
+
+	/* Complete a word that was started by the previous call */
+	while (sum->carry_len > 0 && len > 0) {
+		sum->carry |= (uint64_t) *p++ << (8 * sum->carry_len++);
+		len--;
+		if (sum->carry_len == 8) {
+			h = SERIAL_MIX(h, sum->carry);
+			sum->carry = 0;
+			sum->carry_len = 0;
+		}
+	}
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&w, p, 8);
+		h = SERIAL_MIX(h, le64toh(w));
+	}
+
+	/* Keep the remaining bytes for the next call */
+	while (len-- > 0)
+		sum->carry |= (uint64_t) *p++ << (8 * sum->carry_len++);
+	sum->hash = h;
+  }
+
+
+/**
+ * Get the final value of a running checksum.
+*/
+static int
+serial_sum_final(uint64_t *dest, const serial_sum_t *sum)
+{
+	uint64_t h = sum->hash;
+
+	if (sum->carry_len > 0)
+		h = SERIAL_MIX(h, sum->carry);
+	h ^= sum->total;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	*dest = h;
+}
+
+
+/**
+ * Compute the checksum of a buffer.
+ *
+ * @param dest the checksum
+ * @param buf the data
+ * @param len the length of @a buf
+*/
+int
+serial_checksum(uint64_t *dest, const void *buf, size_t len)
+{
+	serial_sum_t sum = { 0, 0, 0, 0 };
+
+	serial_sum_update(&sum, buf, len);
+	serial_sum_final(dest, &sum);
+}
+
+
+/**
+ * Append a varint to a string.
+*/
+static int
+serial_put_varint(string_t *dest, uint64_t n)
+{
+	unsigned char buf[SERIAL_VARINT_MAX];
+	size_t        len = 0;
+
+	while (n >= 0x80) {
+		buf[len++] = (unsigned char) (n | 0x80);
+		n >>= 7;
+	}
+	buf[len++] = (unsigned char) n;
+	str_append_bytes(dest, buf, len);
+}
+
+
+/**
+ * Decode a varint.
+ *
+ * @param dest the value
+ * @param pos the position of the varint; this is advanced past it
+ * @param end the end of the buffer
+*/
+static int
+serial_get_varint(uint64_t *dest, const char **pos, const char *end)
+{
+	const unsigned char *p = (const unsigned char *) *pos;
+	uint64_t             n = 0;
+	unsigned int         shift;
+
+	for (shift = 0; shift < 64; shift += 7) {
+		if (p >= (const unsigned char *) end)
+			throw("truncated varint");
+		n |= (uint64_t) (*p & 0x7f) << shift;
+		if ((*p++ & 0x80) == 0) {
+			*dest = n;
+			*pos = (const char *) p;
+			return 0;
+		}
+	}
+	throw("invalid varint");
+}
+
+
+/**
+ * Write the unsummed part of the buffer to the checksum and, if there is
+ * a file descriptor, write the buffer to it.
+*/
+static int
+serial_flush(serial_writer_t *w)
+{
+	const char *p;
+	size_t      len;
+	ssize_t     n;
+
+	serial_sum_update(&w->sum, w->buf->value + w->summed, w->buf->len - w->summed);
+	w->summed = w->buf->len;
+	if (w->fd < 0)
+		return 0;
+
+	for (p = w->buf->value, len = w->buf->len; len > 0; p += n, len -= (size_t) n) {
+		if ((n = write(w->fd, p, len)) < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			throw_errno("write(2)");
+		}
+	}
+	str_truncate(w->buf);
+	w->summed = 0;
+}
+
+
+/**
+ * Start writing an object.
+ *
+ * @param w the writer
+ * @param buf the string that will hold the output; any previous contents are discarded
+ * @param fd the file descriptor to write to, or -1 to keep the output in @a buf
+ * @param type SERIAL_LIST or SERIAL_HASH
+ * @param count the number of records that will follow
+*/
+int
+serial_writer_init(serial_writer_t *w, string_t *buf, int fd, int type, size_t count)
+{
+	char type_byte = (char) type;
+
+	memset(w, 0, sizeof(*w));
+	w->buf = buf;
+	w->fd = fd;
+
+	str_truncate(buf);
+	str_append_bytes(buf, SERIAL_MAGIC, 4);
+	str_append_bytes(buf, &type_byte, 1);
+	serial_put_varint(buf, count);
+}
+
+
+/**
+ * Write one record.
+ *
+ * @param w the writer
+ * @param src the data
+ * @param len the length of @a src
+*/
+int
+serial_put(serial_writer_t *w, const void *src, size_t len)
+{
+
+	serial_put_varint(w->buf, len);
+	str_append_bytes(w->buf, src, len);
+	if (w->fd >= 0 && w->buf->len >= SERIAL_FLUSH_SIZE)
+		serial_flush(w);
+}
+
+
+/**
+ * Finish writing an object by appending the checksum.
+ *
+ * @param w the writer
+*/
+int
+serial_finish(serial_writer_t *w)
+{
+	uint64_t sum;
+
+	serial_flush(w);
+	serial_sum_final(&sum, &w->sum);
+	sum = htole64(sum);
+	str_append_bytes(w->buf, &sum, sizeof(sum));
+	w->summed = w->buf->len;
+	if (w->fd >= 0)
+		serial_flush(w);
+}
+
+
+/**
+ * Start reading an object from a buffer.
+ *
+ * The header and checksum are verified before anything is read.
+ *
+ * @param r the reader
+ * @param buf the serialized object
+ * @param len the length of @a buf
+ * @param type SERIAL_LIST or SERIAL_HASH
+*/
+int
+serial_reader_init(serial_reader_t *r, const void *buf, size_t len, int type)
+{
+	const char *p = buf;
+	uint64_t    sum, expect, count;
+
+	memset(r, 0, sizeof(*r));
+
+	if (len < SERIAL_HEADER_SIZE + 1 + SERIAL_CHECKSUM_SIZE)
+		throw("object is too short");
+	if (memcmp(p, SERIAL_MAGIC, 4) != 0)
+		throw("invalid magic number");
+	if (p[4] != (char) type)
+		throwf("wrong object type: `%c'", p[4]);
+
+	len -= SERIAL_CHECKSUM_SIZE;
+	memcpy(&expect, p + len, sizeof(expect));
+	serial_checksum(&sum, p, len);
+	if (sum != le64toh(expect))
+		throw("checksum mismatch");
+
+	r->pos = p + SERIAL_HEADER_SIZE;
+	r->end = p + len;
+	r->type = type;
+	serial_get_varint(&count, &r->pos, r->end);
+	if (count > (uint64_t) (r->end - r->pos))
+		throw("invalid record count");
+	r->count = (size_t) count;
+}
+
+
+/**
+ * Read the next record.
+ *
+ * @param dest a view of the record, within the input buffer
+ * @param r the reader
+ * @return 0 if a record was read, or -1 if there are no more records or an error occurred
+*/
+int
+serial_read(strview_t *dest, serial_reader_t *r)
+{
+	uint64_t len;
+
+	if (r->count == 0)
+		return -1;
+
+	serial_get_varint(&len, &r->pos, r->end);
+	if (len > (uint64_t) (r->end - r->pos))
+		throw("truncated record");
+	dest->ptr = r->pos;
+	dest->len = (size_t) len;
+	r->pos += len;
+	r->count--;
+}
+
+
+/**
+ * Map a file into memory and start reading the object it contains.
+ *
+ * Records are returned as views of the mapped file. Call serial_unmap()
+ * when the views are no longer needed.
+ *
+ * @param r the reader
+ * @param path the path to the file
+ * @param type SERIAL_LIST or SERIAL_HASH
+*/
+int
+serial_map_file(serial_reader_t *r, const char *path, int type)
+{
+	struct stat st;
+	void       *map = MAP_FAILED;
+	int         fd = -1;
+
+	memset(r, 0, sizeof(*r));
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		throw_errno("open(2)");
+	if (fstat(fd, &st) < 0)
+		throw_errno("fstat(2)");
+	if (st.st_size == 0) {
+		log_error("`%s' is empty", path);
+		throw_silent();
+	}
+	map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		throw_errno("mmap(2)");
+	(void) madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+
+	if (serial_reader_init(r, map, (size_t) st.st_size, type) < 0)
+		throw_silent();
+	r->map = map;
+	r->map_len = (size_t) st.st_size;
+	map = MAP_FAILED;
+
+catch:
+	log_error("while reading `%s' ..", path);
+
+finally:
+	if (map != MAP_FAILED)
+		(void) munmap(map, (size_t) st.st_size);
+	if (fd >= 0)
+		(void) close(fd);
+}
+
+
+/**
+ * Unmap the file that was mapped by serial_map_file().
+ *
+ * @param r the reader
+*/
+int
+serial_unmap(serial_reader_t *r)
+{
+
+	if (r->map != NULL && munmap(r->map, r->map_len) < 0)
+		throw_errno("munmap(2)");
+	r->map = NULL;
+	r->map_len = 0;
+	r->pos = r->end = NULL;
+	r->count = 0;
+}
@@ -22,6 +22,7 @@
  *
 */
  
+#include "nc_cidr.h"
 #include "nc_dns.h"
 #include "nc_exception.h"
 #include "nc_file.h"
@@ -34,6 +35,8 @@
 #include "nc_passwd.h"
 #include "nc_process.h"
 #include "nc_session.h"
+#include "nc_signal.h"
+#include "nc_snapshot.h"
 #include "nc_socket.h"
 #include "nc_string.h"
 #include "nc_thread.h"
@@ -102,6 +105,7 @@ server_destroy(server_t **srv)
 	str_destroy(&s->service);
 	str_destroy(&s->address);
 	socket_destroy(&s->sock);
+	cidr_destroy(&s->acl);
 	free(s->controller);
 
 	/* Free the object */
@@ -250,33 +254,103 @@ drop_privileges(const string_t *uid_str, const string_t *gid_str, const string_t
 }
 
 
+/**
+ * Allow clients from a network to connect to a server.
+ *
+ * Once any network is allowed, clients that do not match an allowed
+ * or denied network are rejected.
+ *
+ * @param srv a server object
+ * @param prefix a network prefix, such as "192.168.0.0/16" or "::1"
+*/
+int
+server_allow(server_t *srv, char_t *prefix)
+{
+
+	if (srv->acl == NULL)
+		cidr_new(&srv->acl);
+	cidr_add(srv->acl, prefix, 1);
+	srv->acl_default_deny = true;
+}
+
+
+/**
+ * Reject clients from a network.
+ *
+ * A more specific server_allow() prefix overrides this, so a network
+ * can be denied except for some of its subnets.
+ *
+ * @param srv a server object
+ * @param prefix a network prefix, such as "10.0.0.0/8"
+*/
+int
+server_deny(server_t *srv, char_t *prefix)
+{
+
+	if (srv->acl == NULL)
+		cidr_new(&srv->acl);
+	cidr_add(srv->acl, prefix, 0);
+}
+
+
 /**
  * Accept an incoming connection on a server and create a new client session.
  *
+ * Clients that are rejected by the access control list are disconnected
+ * before any session state is allocated.
+ *
  * @param srv a server object
 */
 static int
 server_accept(server_t *srv)
 {
 	session_t *session = NULL;
-
-	/* Initialize a session object */
-	session_new(&session);
-
-	/* Run the protocol-specific initialization hook */
-	session->controller_handle = srv->controller_handle;
-	session_controller_invoke(session, SESSION_INIT, NULL);
+	socket_t  *sock = NULL;
+	int        allowed, rc;
 
 	/* Accept a client connection */
-	session_accept(session, srv);
+	socket_new(&sock);
+	if (socket_set_family(sock, srv->family) < 0 || socket_accept(sock, srv->sock) < 0)
+		throw_silent();
+	if (!sock->status.connected)
+		return 0;
+
+	/* Check the client address against the access control list */
+	if (srv->acl != NULL) {
+		if (cidr_lookup(&allowed, srv->acl, &sock->remote) < 0)
+			allowed = !srv->acl_default_deny;
+		if (!allowed) {
+			log_debug("rejected a connection on fd# %d", sock->fd);
+			return 0;
+		}
+	}
 
 	/* Reject the connection if the maximum number of clients has been reached */
-	if (session->sock->fd >= MAX_CLIENT_COUNT)
-		throw("connection limits exceeded");
+	if (sock->fd >= MAX_CLIENT_COUNT) {
+		log_error("connection limits exceeded on fd# %d", sock->fd);
+		throw_silent();
+	}
 
 	/* Ensure that fd is not negative */
-	if (session->sock->fd < 0 )
-		throw("invalid session fd");
+	if (sock->fd < 0 ) {
+		log_error("invalid session fd %d", sock->fd);
+		throw_silent();
+	}
+
+	/* Initialize a session object */
+	if (session_new(&session) < 0)
+		throw_silent();
+
+	/* Run the protocol-specific initialization hook */
+	session->controller_handle = srv->controller_handle;
+	if (session_controller_invoke(session, SESSION_INIT, NULL) < 0)
+		throw_silent();
+
+	/* The session takes ownership of the socket, even if this fails */
+	rc = session_accept(session, srv, sock);
+	sock = NULL;
+	if (rc < 0)
+		throw_silent();
 
 	/* Create a new thread */
 	/** @todo proper casting */
@@ -320,6 +394,12 @@ catch:
 		(void) session_close(session);
 		destroy(session, &session);
 	}
+
+finally:
+	if (sock != NULL) {
+		(void) socket_close(sock);
+		(void) socket_destroy(&sock);
+	}
 }
 
 
@@ -376,6 +456,55 @@ server_signal_handler(int fd UNUSED, short event_type UNUSED, void *arg)
   }
 
 
+/* Set while a reload thread is running, and when another reload is requested */
+static int RELOAD_RUNNING = 0;
+static int RELOAD_PENDING = 0;
+
+/**
+ * Reload the configuration snapshots until no more reloads are pending.
+ *
+ * Runs in a detached thread so that server_multiplex() keeps accepting
+ * connections while the loaders run.
+ *
+ * @param pending the RELOAD_PENDING flag
+ */
+static int
+server_reload_handler(int *pending)
+{
+	do {
+		while (__atomic_exchange_n(pending, 0, __ATOMIC_ACQ_REL)) {
+			log_info("reloading the configuration after %s", "SIGHUP");
+			if (snapshot_reload_all() < 0)
+				log_error("%s", "some of the configuration could not be reloaded");
+		}
+		__atomic_store_n(&RELOAD_RUNNING, 0, __ATOMIC_RELEASE);
+
+	/* Pick up a request that arrived before RELOAD_RUNNING was cleared */
+	} while (__atomic_load_n(pending, __ATOMIC_ACQUIRE) &&
+		!__atomic_exchange_n(&RELOAD_RUNNING, 1, __ATOMIC_ACQ_REL));
+}
+
+
+/**
+ * Replace the shared configuration snapshots in the background.
+ *
+ * Sessions keep reading the old versions until they are done. If a reload
+ * is already running, it will run the loaders again when it finishes.
+ */
+static int
+server_reload(void)
+{
+	__atomic_store_n(&RELOAD_PENDING, 1, __ATOMIC_RELEASE);
+	if (__atomic_exchange_n(&RELOAD_RUNNING, 1, __ATOMIC_ACQ_REL))
+		return 0;
+
+	if (thread_create_detached((callback_t) server_reload_handler, &RELOAD_PENDING) < 0) {
+		__atomic_store_n(&RELOAD_RUNNING, 0, __ATOMIC_RELEASE);
+		throw("unable to start the reload thread");
+	}
+}
+
+
 /**
  * Run multiple servers inside a single process
  *
@@ -387,7 +516,7 @@ server_multiplex(list_t *bind_addr, int (*constructor[])(server_t *))
 	list_entry_t *cur = NULL; 
 	string_t  *item;
 	server_t  *srv;
-	size_t     num_servers = 0, pfd_count = 0;
+	size_t     num_servers = 0, pfd_count = 0, wakeup;
 	struct pollfd *pfd;
 	struct server **handler;
 	int        i, j, n;
@@ -402,8 +531,8 @@ server_multiplex(list_t *bind_addr, int (*constructor[])(server_t *))
 	for (; constructor[num_servers] != NULL; num_servers++) {}
 	log_debug("%zu server objects", num_servers);
 
-	/* Allocate memory for the poll(2) descriptor set */
-	pfd_count = bind_addr->count * num_servers;
+	/* Allocate memory for the poll(2) descriptor set, plus the signal pipe */
+	pfd_count = bind_addr->count * num_servers + 1;
 	mem_malloc(pfd, pfd_count * sizeof(struct pollfd));
 
 	/* Allocate memory for the server handler table */
@@ -476,8 +605,21 @@ server_multiplex(list_t *bind_addr, int (*constructor[])(server_t *))
 		}
 	}
 
+	/* Watch for SIGHUP, which may be delivered to any thread */
+	if (signal_wakeup_fd(&pfd[pfd_count].fd) < 0)
+		throw("unable to watch for signals");
+	pfd[pfd_count].events = POLLIN;
+	handler[pfd_count] = NULL;
+	wakeup = pfd_count++;
+
 	for (;;) {
 
+		/* Replace the shared configuration snapshots after a SIGHUP */
+		if (SIGHUP_triggered) {
+			SIGHUP_triggered = 0;
+			(void) server_reload();
+		}
+
 		/* Wait for a connection on one of the socket descriptors */
 		if ((i = poll(pfd, pfd_count, -1)) < 0) {
 
@@ -491,7 +633,16 @@ server_multiplex(list_t *bind_addr, int (*constructor[])(server_t *))
 		log_debug("%d connections waiting", i);
 
 		/* Examine each poll(2) descriptor */
-		for (j = 0, n = 0; n <= pfd_count && j < i; n++) {
+		for (j = 0, n = 0; n < pfd_count && j < i; n++) {
+
+			/* Test if a signal was caught */
+			if (n == wakeup) {
+				if (pfd[n].revents & POLLIN) {
+					(void) signal_wakeup_drain();
+					j++;
+				}
+				continue;
+			}
 
 			/* Test if a client is waiting */
 			if (pfd[n].revents & POLLIN) {
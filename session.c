@@ -33,6 +33,8 @@
 #include "nc_string.h"
 #include "nc_thread.h"
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <time.h>
@@ -175,6 +177,7 @@ response_reset(session_t *s)
 
 	str_truncate(s->response.header);
 	str_truncate(s->response.body);
+	strbuf_truncate(s->response.chunks);
 	s->response.asis = false;
 	s->response.code = 0;
 }
@@ -198,7 +201,7 @@ session_new(session_t **dest)
 	string_t  *path   = NULL;
 
 	/* Allocate memory for a new session */
-	mem_calloc(*dest);
+	mem_slab_calloc(*dest);
 	s = *dest;
 
 	/* Initialize the object members */
@@ -206,6 +209,7 @@ session_new(session_t **dest)
 	list_new(&s->context);
 	list_new(&s->groups);
 	str_new(&s->response.body);
+	strbuf_new(&s->response.chunks);
 	str_new(&s->response.header);
 	str_new(&s->user);
 	s->response.code = 0;
@@ -303,6 +307,7 @@ session_destroy(session_t **session_ref)
 	list_destroy(&s->context);
 	list_destroy(&s->groups);
 	str_destroy(&s->response.body);
+	strbuf_destroy(&s->response.chunks);
 	str_destroy(&s->response.header);
 	str_destroy(&s->user);
 	
@@ -310,7 +315,7 @@ session_destroy(session_t **session_ref)
 	session_controller_invoke(s, SESSION_DESTROY, NULL);
 
 	socket_destroy(&s->sock);
-	free(*session_ref);
+	mem_slab_release(*session_ref);
 
 	*session_ref = NULL;
 }
@@ -379,27 +384,23 @@ session_process_request(session_t *s)
 
 
 /**
- * Create a new client session based on a pending server connection.
+ * Create a new client session for a connection that was accepted by a server.
  *
  * @param s new session
  * @param srv server
+ * @param sock the client socket, from socket_accept(); the session takes
+ *             ownership of it, and it is destroyed by session_destroy()
 */
 int
-session_accept(session_t *s, struct server *srv)
+session_accept(session_t *s, struct server *srv, socket_t *sock)
 {
 
-	/* Create a socket object for the new client */
-	/* SA-NOTE: socket_destroy(&s->sock) called by session_destroy() */
-	socket_new(&s->sock);
-	socket_set_family(s->sock, srv->family);
+	s->sock = sock;
 	s->srv = srv;
 
 	/* Copy the session controller handle from the server */
 	s->controller_handle = srv->controller_handle;
 
-	/* Accept(2) an incoming connection */
-	socket_accept(s->sock, srv->sock);
-
 	/* Set the socket timeout */
 	socket_set_timeout(s->sock, srv->timeout, 60);
 
@@ -450,18 +451,33 @@ session_handler(session_t *s)
 /**
  * Determine if a session is being conducted via a loopback interface.
  *
- * @todo OPTIMIZE: unnecessary ASCII conversion.
- * @todo is this function even needed?
+ * The peer address is tested directly: 127.0.0.0/8 for IPv4, and ::1
+ * or an IPv4-mapped loopback address for IPv6.
  *
+ * @return 0 if the peer is a loopback address, or -1 if it is not
 */
 int
 session_is_loopback(session_t *s)
 {
-	string_t *buf;
-
-	str_from_inet(buf, s->sock->remote.in.sin_addr);
-	if (str_cmp(buf, "127.0.0.1") < 0)
+	const socket_addr_t   *addr = &s->sock->remote;
+	const struct in6_addr *a6;
+
+	switch (addr->a.sa_family) {
+	case AF_INET:
+		if ((ntohl(addr->in.sin_addr.s_addr) >> 24) != 127)
+			throw_silent();
+		break;
+
+	case AF_INET6:
+		a6 = &addr->in6.sin6_addr;
+		if (!IN6_IS_ADDR_LOOPBACK(a6) &&
+				!(IN6_IS_ADDR_V4MAPPED(a6) && a6->s6_addr[12] == 127))
+			throw_silent();
+		break;
+
+	default:
 		throw_silent();
+	}
 }
 
 
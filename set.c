@@ -0,0 +1,477 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Sets of strings.
+ *
+ * Each member is stored once, in a table generated by NC_SET(), along
+ * with its hash value. Lookups hash the string once with hash_key(), and
+ * the same value selects the Bloom filter block, the bits within it,
+ * and the first slot to probe in the table.
+ *
+ * Removing a member leaves its bits in the Bloom filter. This can only
+ * cause extra probes of the table, never a wrong answer, and the filter
+ * is rebuilt from the current members whenever it grows.
+*/
+
+#include "config.h"
+
+#include "nc_container.h"
+#include "nc_exception.h"
+#include "nc_hash.h"
+#include "nc_list.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_set.h"
+#include "nc_string.h"
+#include "sort.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------------ GLOBAL VARIABLES ------------------------- */
+
+/** A member of the set, or a string to look for */
+typedef struct set_member {
+	uint64_t hash;
+	string_t str;
+} set_member_t;
+
+#define SET_MEMBER_HASH(m)	((m).hash)
+#define SET_MEMBER_EQ(a,b)	((a).str.len == (b).str.len && memcmp((a).str.value, (b).str.value, (a).str.len) == 0)
+
+NC_SET(set_table, set_member_t, SET_MEMBER_HASH, SET_MEMBER_EQ)
+
+/** The Bloom filter block that holds the bits of a hash value */
+#define SET_BLOCK(s, h)	((s)->bloom + (((h) >> 32) & ((s)->nblocks - 1)) * SET_BLOCK_WORDS)
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Set the Bloom filter bits for a hash value.
+ *
+ * The bits are taken from a second mix of the hash, nine at a time:
+ * three to choose a word in the block and six to choose a bit.
+*/
+static int
+set_bloom_mark(set_t *s, uint64_t hash)
+{
+	uint64_t *block = SET_BLOCK(s, hash);
+	uint64_t  h2 = nc_hash_int(hash);
+	int       i;
+
+	for (i = 0; i < SET_BLOOM_K; i++, h2 >>= 9)
+		block[(h2 >> 6) & 7] |= 1ULL << (h2 & 63);
+}
+
+
+/**
+ * Rebuild the Bloom filter with room for at least @a count members.
+ *
+ * @param s the set
+ * @param count the number of members
+*/
+static int
+set_bloom_resize(set_t *s, size_t count)
+{
+	uint64_t *bloom;
+	size_t    nblocks = 1, i;
+
+	while (nblocks * SET_BLOCK_WORDS * 64 < count * SET_BLOOM_BITS) {
+		if (nblocks > SIZE_MAX / (SET_BLOCK_WORDS * 64 * 2))
+			throw("set too large");
+		nblocks *= 2;
+	}
+	if ((bloom = calloc(nblocks, SET_BLOCK_WORDS * sizeof(*bloom))) == NULL)
+		throw_errno("calloc(3)");
+
+	free(s->bloom);
+	s->bloom = bloom;
+	s->nblocks = nblocks;
+	for (i = 0; i < s->table->size; i++) {
+		if (s->table->slot[i].hash != 0)
+			(void) set_bloom_mark(s, s->table->slot[i].hash);
+	}
+}
+
+
+/**
+ * Make room for at least @a count members.
+*/
+static int
+set_reserve(set_t *s, size_t count)
+{
+
+	set_table_reserve(s->table, count);
+	if (count > s->nblocks * SET_BLOCK_WORDS * 64 / SET_BLOOM_BITS)
+		set_bloom_resize(s, (count > 2 * s->count) ? count : 2 * s->count);
+}
+
+
+/**
+ * Discard the sorted array, after the set has been modified.
+*/
+static int
+set_unsort(set_t *s)
+{
+
+	free(s->sorted);
+	s->sorted = NULL;
+}
+
+
+/**
+ * Test if a byte string is a member of a set.
+*/
+static int
+set_lookup(bool *result, const set_t *s, const char *value, size_t len)
+{
+	const uint64_t *block;
+	set_member_t    key;
+	uint64_t        h2;
+	int             i;
+
+	*result = false;
+	if (s->count == 0)
+		return 0;
+	hash_key(&key.hash, value, len);
+
+	/* Most strings that are not members are rejected here */
+	block = SET_BLOCK(s, key.hash);
+	h2 = nc_hash_int(key.hash);
+	for (i = 0; i < SET_BLOOM_K; i++, h2 >>= 9) {
+		if ((block[(h2 >> 6) & 7] & (1ULL << (h2 & 63))) == 0)
+			return 0;
+	}
+
+	key.str.value = (char *) value;
+	key.str.len = len;
+	*result = set_table_contains(s->table, key);
+}
+
+
+/**
+ * Add a byte string to a set, unless it is already a member.
+*/
+static int
+set_insert(set_t *s, const char *value, size_t len)
+{
+	set_member_t key;
+	char        *copy = NULL;
+
+	hash_key(&key.hash, value, len);
+	key.str.value = (char *) value;
+	key.str.len = len;
+	if (set_table_contains(s->table, key))
+		return 0;
+
+	set_reserve(s, s->count + 1);
+	if ((copy = malloc(len + 1)) == NULL)
+		throw_errno("malloc(3)");
+	memcpy(copy, value, len);
+	copy[len] = '\0';
+	key.str.value = copy;
+	key.str.size = len + 1;
+	key.str.owner = true;
+	if (set_table_add(s->table, key) < 0)
+		throw_silent();
+	copy = NULL;
+	s->count++;
+
+	(void) set_bloom_mark(s, key.hash);
+	(void) set_unsort(s);
+
+finally:
+	free(copy);
+}
+
+
+/**
+ * Create a new, empty set.
+ *
+ * @param dest a new set_t object
+*/
+int
+set_new(set_t **dest)
+{
+	set_t *s = NULL;
+
+	mem_calloc(s);
+	set_table_new(&s->table);
+	*dest = s;
+
+catch:
+	(void) set_destroy(&s);
+}
+
+
+/**
+ * Destroy a set.
+ *
+ * @param s the object to be destroyed; this will be set to NULL.
+*/
+int
+set_destroy(set_t **s)
+{
+
+	if (*s == NULL)
+		return 0;
+
+	if ((*s)->table != NULL)
+		(void) set_truncate(*s);
+	(void) set_table_destroy(&(*s)->table);
+	free((*s)->bloom);
+	free(*s);
+	*s = NULL;
+}
+
+
+/**
+ * Remove all members from a set.
+ *
+ * @param s the set
+*/
+int
+set_truncate(set_t *s)
+{
+	size_t i;
+
+	for (i = 0; i < s->table->size; i++) {
+		if (s->table->slot[i].hash != 0)
+			free((char *) s->table->slot[i].key.str.value);
+	}
+	(void) set_table_truncate(s->table);
+	if (s->bloom != NULL)
+		memset(s->bloom, 0, s->nblocks * SET_BLOCK_WORDS * sizeof(*s->bloom));
+	s->count = 0;
+	(void) set_unsort(s);
+}
+
+
+/**
+ * Add a string to a set.
+ *
+ * Adding a string that is already a member has no effect.
+ *
+ * @param s the set
+ * @param value the string to be added
+*/
+int
+set_add(set_t *s, char_t *value)
+{
+
+	set_insert(s, value, strlen(value));
+}
+
+
+/**
+ * Add a string to a set.
+ *
+ * @param s the set
+ * @param value the string to be added; this may contain NUL characters
+*/
+int
+set_add_str(set_t *s, const string_t *value)
+{
+
+	set_insert(s, value->value, value->len);
+}
+
+
+/**
+ * Remove a string from a set.
+ *
+ * @param s the set
+ * @param value the string to be removed
+ * @return -1 if @a value is not a member
+*/
+int
+set_delete(set_t *s, char_t *value)
+{
+	set_member_t key;
+	ssize_t      i;
+
+	key.str.value = (char *) value;
+	key.str.len = strlen(value);
+	hash_key(&key.hash, value, key.str.len);
+	if ((i = set_table_probe(s->table, key, key.hash)) < 0)
+		throw_silent();
+
+	free((char *) s->table->slot[i].key.str.value);
+	(void) set_table_remove_at(s->table, (size_t) i);
+	s->count--;
+	(void) set_unsort(s);
+}
+
+
+/**
+ * Add every element of a list to a set.
+ *
+ * @param dest the set
+ * @param src the list
+*/
+int
+set_from_list(set_t *dest, const list_t *src)
+{
+	list_entry_t *cur;
+
+	set_reserve(dest, dest->count + src->count);
+	for (cur = src->head; cur != NULL; cur = cur->next)
+		set_insert(dest, cur->value->value, cur->value->len);
+}
+
+
+/**
+ * Add every value of a hash table to a set.
+ *
+ * @param dest the set
+ * @param src the hash table
+*/
+int
+set_from_hash_values(set_t *dest, const hash_t *src)
+{
+	const string_t *key, *value;
+	size_t          pos = 0;
+
+	set_reserve(dest, dest->count + src->count);
+	while (hash_iterate(&key, &value, &pos, src) == 0)
+		set_insert(dest, value->value, value->len);
+}
+
+
+/**
+ * Test if a string is a member of a set.
+ *
+ * @param result true if @a value is a member, false otherwise
+ * @param s the set
+ * @param value the string to look for
+*/
+int
+set_contains(bool *result, const set_t *s, char_t *value)
+{
+
+	(void) set_lookup(result, s, value, strlen(value));
+}
+
+
+/**
+ * Test if a string is a member of a set.
+ *
+ * @param result true if @a value is a member, false otherwise
+ * @param s the set
+ * @param value the string to look for
+*/
+int
+set_contains_str(bool *result, const set_t *s, const string_t *value)
+{
+
+	(void) set_lookup(result, s, value->value, value->len);
+}
+
+
+/**
+ * Build the sorted array of members, if it does not already exist.
+ *
+ * The members are sorted by byte value, like list_sort() with SORT_DEFAULT.
+ *
+ * @param s the set
+*/
+int
+set_sort(set_t *s)
+{
+	struct sort_item *item = NULL;
+	size_t            i, n = 0;
+
+	if (s->sorted != NULL || s->count == 0)
+		return 0;
+
+	if ((item = calloc(s->count, sizeof(*item))) == NULL)
+		throw_errno("calloc(3)");
+	for (i = 0; i < s->table->size; i++) {
+		if (s->table->slot[i].hash != 0)
+			item[n++].str = &s->table->slot[i].key.str;
+	}
+	if (sort_items(item, n, SORT_DEFAULT) < 0)
+		throw_silent();
+
+	if ((s->sorted = calloc(n, sizeof(*s->sorted))) == NULL)
+		throw_errno("calloc(3)");
+	for (i = 0; i < n; i++)
+		s->sorted[i] = item[i].str;
+
+finally:
+	free(item);
+}
+
+
+/**
+ * Find every member that begins with a prefix.
+ *
+ * The members are found with a binary search of the sorted array, which
+ * is built first if needed. They are appended to @a dest in sorted order.
+ *
+ * @param dest list that will hold the matching members
+ * @param s the set
+ * @param prefix the prefix to search for
+*/
+int
+set_find_prefix(list_t *dest, set_t *s, char_t *prefix)
+{
+	const string_t *str;
+	size_t          lo = 0, hi, mid, len = strlen(prefix);
+	int             rc;
+
+	set_sort(s);
+
+	/* Find the first member that is not less than the prefix */
+	hi = s->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		str = s->sorted[mid];
+		rc = memcmp(str->value, prefix, (str->len < len) ? str->len : len);
+		if (rc < 0 || (rc == 0 && str->len < len))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < s->count; lo++) {
+		str = s->sorted[lo];
+		if (str->len < len || memcmp(str->value, prefix, len) != 0)
+			break;
+		list_push(dest, str);
+	}
+}
+
+
+/**
+ * Copy the members of a set to a list, in sorted order.
+ *
+ * @param dest list that will hold the members
+ * @param s the set
+*/
+int
+set_to_list(list_t *dest, set_t *s)
+{
+	size_t i;
+
+	set_sort(s);
+	for (i = 0; i < s->count; i++)
+		list_push(dest, s->sorted[i]);
+}
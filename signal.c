@@ -28,11 +28,14 @@
 #include "nc_log.h"
 #include "nc_signal.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <sys/signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 
 /* 	SIGNAL HANDLERS		*/
@@ -43,6 +46,19 @@ volatile sig_atomic_t 	SIGUSR1_triggered = 0;
 volatile sig_atomic_t 	SIGUSR2_triggered = 0;
 volatile sig_atomic_t 	SIGTERM_triggered = 0;
 
+/* A pipe that is written to when a signal is caught, see signal_wakeup_fd() */
+static int SIGNAL_PIPE[2] = { -1, -1 };
+
+static void
+signal_wakeup(void)
+  {
+	int saved_errno = errno;
+
+	if (SIGNAL_PIPE[1] >= 0)
+		(void) write(SIGNAL_PIPE[1], "", 1);
+	errno = saved_errno;
+  }
+
 static void
 default_signal_handler(int signum) 
   {  
@@ -52,6 +68,7 @@ default_signal_handler(int signum)
 
 		  case SIGHUP:
 			  SIGHUP_triggered = 1;	
+			  signal_wakeup();
 			  break;
 
 		  case SIGUSR1:
@@ -93,6 +110,46 @@ signal_library_init()
 }
 
 
+/**
+ * Get a descriptor that becomes readable when SIGHUP is caught.
+ *
+ * The signal handler can run in any thread, so a thread that waits in
+ * poll(2) should watch this descriptor instead of relying on EINTR.
+ * Call signal_wakeup_drain() after it becomes readable.
+ *
+ * @param dest the read end of the pipe
+*/
+int
+signal_wakeup_fd(int *dest)
+{
+	int i;
+
+	if (SIGNAL_PIPE[0] < 0) {
+		if (pipe(SIGNAL_PIPE) < 0)
+			throw_errno("pipe(2)");
+		for (i = 0; i < 2; i++) {
+			if (fcntl(SIGNAL_PIPE[i], F_SETFL, O_NONBLOCK) < 0 || fcntl(SIGNAL_PIPE[i], F_SETFD, FD_CLOEXEC) < 0)
+				throw_errno("fcntl(2)");
+		}
+	}
+	*dest = SIGNAL_PIPE[0];
+}
+
+
+/**
+ * Discard any pending wakeups from the descriptor returned by signal_wakeup_fd().
+ */
+int
+signal_wakeup_drain(void)
+{
+	char buf[64];
+
+	if (SIGNAL_PIPE[0] < 0)
+		return 0;
+	while (read(SIGNAL_PIPE[0], buf, sizeof(buf)) > 0) {}
+}
+
+
 /**
  * Tell the process to ignore all incoming signals.
  */
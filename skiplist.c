@@ -0,0 +1,633 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Ordered map, implemented as a skip list.
+ *
+ * Each node is given a random number of levels, with each level a
+ * quarter as likely as the one below it, and is linked into that many
+ * forward chains. A search starts in the sparsest chain at the head of
+ * the list and drops down a level whenever the next key is too large,
+ * so it visits O(log n) nodes on average.
+ *
+ * Unlike a list_t that is re-sorted after each insert, the entries are
+ * always in order, so the smallest key can be removed in O(1) time and
+ * a range of keys can be walked from skiplist_seek().
+*/
+
+#include "config.h"
+
+#include "nc_exception.h"
+#include "nc_list.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_skiplist.h"
+#include "nc_string.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Compare the key of a node with a buffer.
+ *
+ * @param rc less than, equal to, or greater than zero
+*/
+static inline int
+skiplist_compare(int *rc, const skiplist_node_t *node, const void *key, size_t len)
+{
+	const string_t *s = node->key;
+
+	*rc = memcmp(s->value, key, (s->len < len) ? s->len : len);
+	if (*rc == 0)
+		*rc = (s->len > len) - (s->len < len);
+}
+
+
+/**
+ * Find the last node at each level whose key is less than a given key.
+ *
+ * @param update array of SKIPLIST_LEVEL_MAX nodes that will store the result
+ * @param sl the skip list
+ * @param key the key
+ * @param len the length of @a key
+*/
+static int
+skiplist_search(skiplist_node_t **update, const skiplist_t *sl, const void *key, size_t len)
+{
+	skiplist_node_t *x = sl->head;
+	size_t           i;
+	int              rc;
+
+	for (i = SKIPLIST_LEVEL_MAX; i > 0; i--) {
+		if (i <= sl->level) {
+			while (x->next[i - 1] != NULL) {
+				(void) skiplist_compare(&rc, x->next[i - 1], key, len);
+				if (rc >= 0)
+					break;
+				x = x->next[i - 1];
+			}
+		}
+		update[i - 1] = x;
+	}
+}
+
+
+/**
+ * Find the node with a given key.
+ *
+ * @param dest the node
+ * @return -1 if the key does not exist; no error is logged
+*/
+static int
+skiplist_find(skiplist_node_t **dest, const skiplist_t *sl, const void *key, size_t len)
+{
+	skiplist_node_t *update[SKIPLIST_LEVEL_MAX];
+	int              rc;
+
+	(void) skiplist_search(update, sl, key, len);
+	*dest = update[0]->next[0];
+	if (*dest == NULL)
+		return -1;
+	(void) skiplist_compare(&rc, *dest, key, len);
+	if (rc != 0)
+		return -1;
+}
+
+
+/**
+ * Free a node and its key and value.
+ *
+ * @param node the node, which may be NULL
+*/
+static int
+skiplist_node_destroy(skiplist_node_t *node)
+{
+
+	if (node == NULL)
+		return 0;
+
+	(void) str_destroy(&node->key);
+	(void) str_destroy(&node->value);
+	free(node);
+}
+
+
+/**
+ * Choose the number of levels for a new node.
+ *
+ * This uses a xorshift generator; each additional level has a
+ * probability of 1/4.
+ *
+ * @param level the number of levels
+ * @param sl the skip list
+*/
+static int
+skiplist_random_level(size_t *level, skiplist_t *sl)
+{
+	uint64_t x = sl->seed;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	sl->seed = x;
+
+	*level = 1;
+	while ((x & 3) == 0 && *level < SKIPLIST_LEVEL_MAX) {
+		(*level)++;
+		x >>= 2;
+	}
+}
+
+
+/**
+ * Remove a node from all of its chains.
+ *
+ * @param sl the skip list
+ * @param update the result of skiplist_search() for the key of @a node
+ * @param node the node to be removed
+*/
+static int
+skiplist_unlink(skiplist_t *sl, skiplist_node_t **update, skiplist_node_t *node)
+{
+	size_t i;
+
+	for (i = 0; i < node->level; i++)
+		update[i]->next[i] = node->next[i];
+	if (node->next[0] != NULL)
+		node->next[0]->prev = node->prev;
+	else
+		sl->tail = node->prev;
+
+	while (sl->level > 1 && sl->head->next[sl->level - 1] == NULL)
+		sl->level--;
+	sl->count--;
+}
+
+
+/**
+ * Add or replace a key/value pair.
+ *
+ * @param sl the skip list
+ * @param key the key
+ * @param len the length of @a key
+ * @param value the value to be associated with the key
+*/
+static int
+skiplist_insert(skiplist_t *sl, const void *key, size_t len, const string_t *value)
+{
+	skiplist_node_t *update[SKIPLIST_LEVEL_MAX];
+	skiplist_node_t *node = NULL;
+	size_t           i, level;
+	int              rc;
+
+	/* Update the value of an existing key */
+	(void) skiplist_search(update, sl, key, len);
+	if (update[0]->next[0] != NULL) {
+		(void) skiplist_compare(&rc, update[0]->next[0], key, len);
+		if (rc == 0) {
+			str_copy(update[0]->next[0]->value, value);
+			return 0;
+		}
+	}
+
+	/* Create a new node */
+	(void) skiplist_random_level(&level, sl);
+	if ((node = calloc(1, sizeof(*node) + level * sizeof(node->next[0]))) == NULL)
+		throw_errno("calloc(3)");
+	node->level = level;
+	if (str_new(&node->key) < 0 || str_append_bytes(node->key, key, len) < 0)
+		throw_silent();
+	if (str_new(&node->value) < 0 || str_copy(node->value, value) < 0)
+		throw_silent();
+
+	/* Link it into each chain, after the nodes found by the search */
+	if (level > sl->level)
+		sl->level = level;
+	for (i = 0; i < level; i++) {
+		node->next[i] = update[i]->next[i];
+		update[i]->next[i] = node;
+	}
+	node->prev = (update[0] == sl->head) ? NULL : update[0];
+	if (node->next[0] != NULL)
+		node->next[0]->prev = node;
+	else
+		sl->tail = node;
+	sl->count++;
+	node = NULL;
+
+catch:
+	(void) skiplist_node_destroy(node);
+}
+
+
+/**
+ * Remove a key/value pair.
+ *
+ * @return -1 if the key does not exist; no error is logged
+*/
+static int
+skiplist_remove(skiplist_t *sl, const void *key, size_t len)
+{
+	skiplist_node_t *update[SKIPLIST_LEVEL_MAX];
+	skiplist_node_t *node;
+	int              rc;
+
+	(void) skiplist_search(update, sl, key, len);
+	if ((node = update[0]->next[0]) == NULL)
+		return -1;
+	(void) skiplist_compare(&rc, node, key, len);
+	if (rc != 0)
+		return -1;
+
+	(void) skiplist_unlink(sl, update, node);
+	(void) skiplist_node_destroy(node);
+}
+
+
+/**
+ * Find the first node whose key is greater than or equal to a given key.
+ *
+ * @return -1 if there is no such node; no error is logged
+*/
+static int
+skiplist_lower_bound(const skiplist_node_t **dest, const skiplist_t *sl, const void *key, size_t len)
+{
+	skiplist_node_t *update[SKIPLIST_LEVEL_MAX];
+
+	(void) skiplist_search(update, sl, key, len);
+	if ((*dest = update[0]->next[0]) == NULL)
+		return -1;
+}
+
+
+/**
+ * Convert an integer key into a string that sorts in numeric order.
+ *
+ * @param dest buffer of 8 bytes
+ * @param key the integer key
+*/
+static int
+skiplist_encode_u64(unsigned char *dest, uint64_t key)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--) {
+		dest[i] = (unsigned char) (key & 0xff);
+		key >>= 8;
+	}
+}
+
+
+/**
+ * Create a new, empty skip list.
+ *
+ * @param dest a new skiplist_t object
+*/
+int
+skiplist_new(skiplist_t **dest)
+{
+	skiplist_t *sl = NULL;
+
+	mem_calloc(sl);
+	if ((sl->head = calloc(1, sizeof(*sl->head) + SKIPLIST_LEVEL_MAX * sizeof(sl->head->next[0]))) == NULL)
+		throw_errno("calloc(3)");
+	sl->head->level = SKIPLIST_LEVEL_MAX;
+	sl->level = 1;
+	sl->seed = 0x9e3779b97f4a7c15ULL ^ (uint64_t) (uintptr_t) sl;
+	*dest = sl;
+	sl = NULL;
+
+catch:
+	if (sl != NULL) {
+		free(sl->head);
+		free(sl);
+	}
+}
+
+
+/**
+ * Destroy a skip list.
+ *
+ * @param sl the object to be destroyed; this will be set to NULL.
+*/
+int
+skiplist_destroy(skiplist_t **sl)
+{
+
+	if (*sl == NULL)
+		return 0;
+
+	(void) skiplist_truncate(*sl);
+	free((*sl)->head);
+	free(*sl);
+	*sl = NULL;
+}
+
+
+/**
+ * Delete all key/value pairs from a skip list.
+ *
+ * @param sl the skip list
+*/
+int
+skiplist_truncate(skiplist_t *sl)
+{
+	skiplist_node_t *node, *next;
+	size_t           i;
+
+	for (node = sl->head->next[0]; node != NULL; node = next) {
+		next = node->next[0];
+		(void) skiplist_node_destroy(node);
+	}
+	for (i = 0; i < SKIPLIST_LEVEL_MAX; i++)
+		sl->head->next[i] = NULL;
+	sl->tail = NULL;
+	sl->level = 1;
+	sl->count = 0;
+}
+
+
+/**
+ * Set the value associated with a key.
+ *
+ * @param sl the skip list
+ * @param key the key to be set
+ * @param value string value to be associated with the key
+*/
+int
+skiplist_set(skiplist_t *sl, char_t *key, const string_t *value)
+{
+
+	skiplist_insert(sl, key, strlen(key), value);
+}
+
+
+/**
+ * Retrieve a borrowed reference to the value associated with a key.
+ *
+ * The reference remains valid until the key is deleted.
+ *
+ * @param dest pointer to the value
+ * @param sl the skip list
+ * @param key the key to be retrieved
+ * @return -1 if the key does not exist; no error is logged
+*/
+int
+skiplist_lookup(const string_t **dest, const skiplist_t *sl, char_t *key)
+{
+	skiplist_node_t *node;
+
+	if (skiplist_find(&node, sl, key, strlen(key)) < 0)
+		throw_silent();
+	*dest = node->value;
+}
+
+
+/**
+ * Retrieve a copy of the value associated with a key.
+ *
+ * @param dest buffer to store the result
+ * @param sl the skip list
+ * @param key the key to be retrieved
+ * @return -1 if the key does not exist; no error is logged
+*/
+int
+skiplist_get(string_t *dest, const skiplist_t *sl, char_t *key)
+{
+	const string_t *value;
+
+	if (skiplist_lookup(&value, sl, key) < 0)
+		throw_silent();
+	str_copy(dest, value);
+}
+
+
+/**
+ * Delete a key/value pair.
+ *
+ * @param sl the skip list
+ * @param key the key to be deleted
+ * @return -1 if the key does not exist; no error is logged
+*/
+int
+skiplist_delete(skiplist_t *sl, char_t *key)
+{
+
+	if (skiplist_remove(sl, key, strlen(key)) < 0)
+		throw_silent();
+}
+
+
+/**
+ * Find the first node whose key is greater than or equal to a given key.
+ *
+ * This is the starting point for walking a range of keys with skiplist_next().
+ *
+ * @param dest the node
+ * @param sl the skip list
+ * @param key the lower bound of the range
+ * @return -1 if every key is less than @a key; no error is logged
+*/
+int
+skiplist_seek(const skiplist_node_t **dest, const skiplist_t *sl, char_t *key)
+{
+
+	if (skiplist_lower_bound(dest, sl, key, strlen(key)) < 0)
+		throw_silent();
+}
+
+
+/**
+ * Set the value associated with an integer key.
+ *
+ * @param sl the skip list
+ * @param key the key to be set
+ * @param value string value to be associated with the key
+*/
+int
+skiplist_set_u64(skiplist_t *sl, uint64_t key, const string_t *value)
+{
+	unsigned char buf[8];
+
+	(void) skiplist_encode_u64(buf, key);
+	skiplist_insert(sl, buf, sizeof(buf), value);
+}
+
+
+/**
+ * Retrieve a copy of the value associated with an integer key.
+ *
+ * @param dest buffer to store the result
+ * @param sl the skip list
+ * @param key the key to be retrieved
+ * @return -1 if the key does not exist; no error is logged
+*/
+int
+skiplist_get_u64(string_t *dest, const skiplist_t *sl, uint64_t key)
+{
+	skiplist_node_t *node;
+	unsigned char    buf[8];
+
+	(void) skiplist_encode_u64(buf, key);
+	if (skiplist_find(&node, sl, buf, sizeof(buf)) < 0)
+		throw_silent();
+	str_copy(dest, node->value);
+}
+
+
+/**
+ * Delete the key/value pair with an integer key.
+ *
+ * @param sl the skip list
+ * @param key the key to be deleted
+ * @return -1 if the key does not exist; no error is logged
+*/
+int
+skiplist_delete_u64(skiplist_t *sl, uint64_t key)
+{
+	unsigned char buf[8];
+
+	(void) skiplist_encode_u64(buf, key);
+	if (skiplist_remove(sl, buf, sizeof(buf)) < 0)
+		throw_silent();
+}
+
+
+/**
+ * Find the first node whose integer key is greater than or equal to a given key.
+ *
+ * @param dest the node
+ * @param sl the skip list
+ * @param key the lower bound of the range
+ * @return -1 if every key is less than @a key; no error is logged
+*/
+int
+skiplist_seek_u64(const skiplist_node_t **dest, const skiplist_t *sl, uint64_t key)
+{
+	unsigned char buf[8];
+
+	(void) skiplist_encode_u64(buf, key);
+	if (skiplist_lower_bound(dest, sl, buf, sizeof(buf)) < 0)
+		throw_silent();
+}
+
+
+/**
+ * Get the integer value of the key of a node.
+ *
+ * @param dest the key
+ * @param node a node that was added with skiplist_set_u64()
+*/
+int
+skiplist_key_u64(uint64_t *dest, const skiplist_node_t *node)
+{
+	const unsigned char *p = (const unsigned char *) node->key->value;
+	size_t               i;
+
+	if (node->key->len != 8)
+		throw("not an integer key");
+
+	*dest = 0;
+	for (i = 0; i < 8; i++)
+		*dest = (*dest << 8) | p[i];
+}
+
+
+/**
+ * Get the node with the smallest key.
+ *
+ * @param dest the node
+ * @param sl the skip list
+ * @return -1 if the list is empty; no error is logged
+*/
+int
+skiplist_first(const skiplist_node_t **dest, const skiplist_t *sl)
+{
+
+	if ((*dest = sl->head->next[0]) == NULL)
+		throw_silent();
+}
+
+
+/**
+ * Get the node with the largest key.
+ *
+ * @param dest the node
+ * @param sl the skip list
+ * @return -1 if the list is empty; no error is logged
+*/
+int
+skiplist_last(const skiplist_node_t **dest, const skiplist_t *sl)
+{
+
+	if ((*dest = sl->tail) == NULL)
+		throw_silent();
+}
+
+
+/**
+ * Remove the key/value pair with the smallest key.
+ *
+ * This takes O(1) time on average, since the first node is only
+ * linked from the head of the list.
+ *
+ * @param key buffer to store the key, or NULL
+ * @param value buffer to store the value, or NULL
+ * @param sl the skip list
+ * @return -1 if the list is empty; no error is logged
+*/
+int
+skiplist_pop_first(string_t *key, string_t *value, skiplist_t *sl)
+{
+	skiplist_node_t *update[SKIPLIST_LEVEL_MAX];
+	skiplist_node_t *node;
+	size_t           i;
+
+	if ((node = sl->head->next[0]) == NULL)
+		throw_silent();
+
+	if (key != NULL)
+		str_swap(key, node->key);
+	if (value != NULL)
+		str_swap(value, node->value);
+
+	for (i = 0; i < node->level; i++)
+		update[i] = sl->head;
+	(void) skiplist_unlink(sl, update, node);
+	(void) skiplist_node_destroy(node);
+}
+
+
+/**
+ * Copy all keys into a list, in ascending order.
+ *
+ * @param dest the list, whose previous contents will be removed
+ * @param sl the skip list
+*/
+int
+skiplist_get_keys(list_t *dest, const skiplist_t *sl)
+{
+	const skiplist_node_t *node;
+
+	list_truncate(dest);
+	for (node = sl->head->next[0]; node != NULL; node = node->next[0])
+		list_push(dest, node->key);
+}
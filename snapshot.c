@@ -0,0 +1,310 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Immutable snapshots of shared data.
+ *
+ * The current object is published with an atomic exchange, and the
+ * previous one is handed to epoch_retire(), so a reader only needs
+ * epoch_enter(), an acquire load, and epoch_exit(). Writers are
+ * serialized by a mutex that readers never touch.
+ *
+ * If a loader fails during a reload, the previous version stays in
+ * place, so a bad configuration file never leaves readers without one.
+*/
+
+#include "config.h"
+
+#include "nc_epoch.h"
+#include "nc_exception.h"
+#include "nc_hash.h"
+#include "nc_list.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_snapshot.h"
+#include "nc_string.h"
+#include "nc_thread.h"
+
+#include <stdlib.h>
+
+/* ------------------------------ GLOBAL VARIABLES ------------------------- */
+
+/** Snapshots that have a loader, in the order the loaders were set */
+static snapshot_t *SNAPSHOTS = NULL;
+
+/** Protects SNAPSHOTS */
+static mutex_t SNAPSHOT_MUTEX = MUTEX_INITIALIZER;
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Destroy a list that was published with snapshot_publish_list().
+*/
+static void
+snapshot_free_list(void *ptr)
+  {
+	list_t *list = ptr;
+
+	(void) list_destroy(&list);
+  }
+
+
+/**
+ * Destroy a hash table that was published with snapshot_publish_hash().
+*/
+static void
+snapshot_free_hash(void *ptr)
+  {
+	hash_t *hash = ptr;
+
+	(void) hash_destroy(&hash);
+  }
+
+
+/**
+ * Create a new snapshot, which holds no object.
+ *
+ * @param dest a new snapshot_t object
+*/
+int
+snapshot_new(snapshot_t **dest)
+{
+	snapshot_t *s = NULL;
+
+	mem_calloc(s);
+	(void) mutex_init(&s->lock);
+	*dest = s;
+}
+
+
+/**
+ * Destroy a snapshot.
+ *
+ * The current object is retired, so readers that are still using it
+ * are not affected, but no thread may call snapshot_acquire() on this
+ * snapshot after it has been destroyed.
+ *
+ * @param s the object to be destroyed; this will be set to NULL.
+*/
+int
+snapshot_destroy(snapshot_t **s)
+{
+
+	if (*s == NULL)
+		return 0;
+
+	(void) snapshot_set_loader(*s, NULL, NULL);
+	if ((*s)->current != NULL)
+		(void) epoch_retire((*s)->current, (*s)->destroy);
+	(void) pthread_mutex_destroy(&(*s)->lock);
+	free(*s);
+	*s = NULL;
+}
+
+
+/**
+ * Replace the current object.
+ *
+ * The previous object is destroyed once every reader that acquired it
+ * has released it.
+ *
+ * @param s the snapshot
+ * @param obj the new object, which must not be modified from now on
+ * @param destroy the function that destroys @a obj
+*/
+int
+snapshot_publish(snapshot_t *s, void *obj, callback_t destroy)
+{
+	void       *old;
+	callback_t  old_destroy;
+
+	mutex_lock(s->lock);
+	old = __atomic_exchange_n(&s->current, obj, __ATOMIC_ACQ_REL);
+	old_destroy = s->destroy;
+	s->destroy = destroy;
+	s->version++;
+	mutex_unlock(s->lock);
+
+	if (old != NULL) {
+		epoch_retire(old, old_destroy);
+		(void) epoch_poll();
+	}
+}
+
+
+/**
+ * Replace the current object with a list.
+ *
+ * @param s the snapshot
+ * @param list the new list; the snapshot takes ownership of it, and
+ *             this will be set to NULL
+*/
+int
+snapshot_publish_list(snapshot_t *s, list_t **list)
+{
+	void *obj = *list;
+
+	*list = NULL;
+	snapshot_publish(s, obj, snapshot_free_list);
+}
+
+
+/**
+ * Replace the current object with a hash table.
+ *
+ * @param s the snapshot
+ * @param hash the new hash table; the snapshot takes ownership of it,
+ *             and this will be set to NULL
+*/
+int
+snapshot_publish_hash(snapshot_t *s, hash_t **hash)
+{
+	void *obj = *hash;
+
+	*hash = NULL;
+	snapshot_publish(s, obj, snapshot_free_hash);
+}
+
+
+/**
+ * Get the current object, and keep it from being destroyed until
+ * snapshot_release() is called.
+ *
+ * Calls may be nested, but the caller must not block between this
+ * and snapshot_release().
+ *
+ * @param dest the current object, or NULL if none has been published
+ * @param s the snapshot
+*/
+int
+snapshot_acquire(const void **dest, snapshot_t *s)
+{
+
+	epoch_enter();
+	*dest = __atomic_load_n(&s->current, __ATOMIC_ACQUIRE);
+}
+
+
+/**
+ * Allow the objects acquired by the current thread to be destroyed.
+*/
+void
+snapshot_release(void)
+  {
+	epoch_exit();
+  }
+
+
+/**
+ * Get a copy of a value from a snapshot of a hash table.
+ *
+ * @param dest string that will hold the value
+ * @param s a snapshot that was published with snapshot_publish_hash()
+ * @param key the key
+ * @return -1 if the key does not exist; no error is logged
+*/
+int
+snapshot_get(string_t *dest, snapshot_t *s, char_t *key)
+{
+	const hash_t   *hash;
+	const string_t *value;
+	bool            acquired = false;
+
+	snapshot_acquire((const void **) &hash, s);
+	acquired = true;
+	if (hash == NULL || hash_lookup(&value, hash, key) < 0)
+		throw_silent();
+	if (str_copy(dest, value) < 0)
+		throw_silent();
+
+finally:
+	if (acquired)
+		snapshot_release();
+}
+
+
+/**
+ * Set the function that builds a new version of a snapshot.
+ *
+ * Snapshots with a loader are reloaded by snapshot_reload_all().
+ *
+ * @param s the snapshot
+ * @param loader the function, or NULL to remove the loader
+ * @param arg an argument that is passed to @a loader
+*/
+int
+snapshot_set_loader(snapshot_t *s, snapshot_loader_t loader, void *arg)
+{
+	snapshot_t **p = NULL;
+
+	mutex_lock(SNAPSHOT_MUTEX);
+	s->loader = loader;
+	s->loader_arg = arg;
+	for (p = &SNAPSHOTS; *p != NULL && *p != s; p = &(*p)->next) {}
+	if (loader != NULL && *p == NULL) {
+		s->next = NULL;
+		*p = s;
+	} else if (loader == NULL && *p == s) {
+		*p = s->next;
+		s->next = NULL;
+	}
+	mutex_unlock(SNAPSHOT_MUTEX);
+}
+
+
+/**
+ * Build and publish a new version of a snapshot with its loader.
+ *
+ * @param s the snapshot
+*/
+int
+snapshot_reload(snapshot_t *s)
+{
+
+	if (s->loader == NULL)
+		throw("snapshot has no loader");
+	if (s->loader(s, s->loader_arg) < 0)
+		throw("unable to load a new snapshot");
+}
+
+
+/**
+ * Reload every snapshot that has a loader.
+ *
+ * A snapshot that fails to load keeps its current version, and the
+ * remaining snapshots are still reloaded.
+ *
+ * @return -1 if any snapshot could not be reloaded
+*/
+int
+snapshot_reload_all(void)
+{
+	snapshot_t *s = NULL;
+	int         failed = 0;
+
+	mutex_lock(SNAPSHOT_MUTEX);
+	for (s = SNAPSHOTS; s != NULL; s = s->next) {
+		if (snapshot_reload(s) < 0)
+			failed++;
+	}
+	mutex_unlock(SNAPSHOT_MUTEX);
+
+	if (failed > 0)
+		throwf("%d snapshot(s) could not be reloaded", failed);
+}
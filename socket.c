@@ -23,6 +23,7 @@
 */
 #include "config.h"
 
+#include "bytescan.h"
 #include "nc_dns.h"
 #include "nc_exception.h"
 #include "nc_file.h"
@@ -162,7 +163,7 @@ socket_new(socket_t **dest)
 	socket_t *s = NULL;
 	
 	/* Allocate memory for thee socket_t structure */
-	mem_calloc(*dest);
+	mem_slab_calloc(*dest);
 	s = *dest;
 
 	list_new(&s->read_buf);
@@ -196,7 +197,7 @@ socket_destroy(socket_t **s)
 	list_destroy(&cur->read_buf);
 
 	/* Free the object */
-	free(cur);
+	mem_slab_release(cur);
 
 	*s = NULL;
 }
@@ -516,11 +517,15 @@ established:
 	dest->family = src->family;
 
 	/* Determine the IP address of the client */
-	if (src->family == PF_INET) {
+	if (src->family == PF_INET || src->family == PF_INET6) {
+		len = (socklen_t) sizeof(addr);
 		if (getpeername(dest->fd, (struct sockaddr *) &addr, &len) < 0) 
 			throw_errno("getpeername(2)");
+		if (len > (socklen_t) sizeof(dest->remote))
+			len = (socklen_t) sizeof(dest->remote);
 		memcpy(&dest->remote, &addr, (size_t) len);
-
+	}
+	if (src->family == PF_INET) {
 		str_from_inet(buf, dest->remote.in.sin_addr);
 		log_info("incoming connection on port %d (fd #%d) from %s", 
 				ntohs(src->local.in.sin_port),
@@ -841,6 +846,7 @@ int
 socket_readline(string_t *dest, socket_t *sock)
 {
 	ssize_t     i = 0;
+	size_t      scanned = 0;
 	string_t   *line, *fragment;
 	list_t     *tok;
 	var_char_t  buf[RECV_BUF_SIZE];
@@ -855,11 +861,8 @@ socket_readline(string_t *dest, socket_t *sock)
 read_loop:
 	do {
 
-		/* Clear the contents of the temporary buffer */
-		memset(buf, 0, sizeof(buf));
-
 		/* Read  data */
-		i = read(sock->fd, buf, sizeof(buf) - 1);
+		i = read(sock->fd, buf, sizeof(buf));
 		if (i < 0 ) {
 			switch (errno) {
 
@@ -883,7 +886,7 @@ read_loop:
 		}
 
 		if (i > 0) {
-			str_cat(line, buf);
+			str_append_bytes(line, buf, (size_t) i);
 
 		} else if (i == 0) {
 			/* WORKAROUND: Is this correct behavior? */
@@ -902,8 +905,11 @@ read_loop:
 		throw("truncated read(2), connection aborted");
 	}
 
-	/* If there is not a complete line, keep reading.. */
-	if (sock->status.connected && strchr(line->value, '\n') == NULL) {
+	/* If there is not a complete line, keep reading..
+	   Only the bytes that were appended since the last check are scanned. */
+	if (sock->status.connected && 
+			bytescan_find_any(line->value + scanned, line->len - scanned, "\n", 1) == NULL) {
+		scanned = line->len;
 		goto read_loop;
 	}
 
@@ -0,0 +1,49 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The merge sort behind list_sort() and vec_sort().
+ *
+ * This is a private header that is not installed. Each container builds
+ * an array of sort_item structures that point back to its own elements,
+ * sorts the array with sort_items(), and then reorders itself to match.
+ */
+
+#ifndef _SORT_H
+#define _SORT_H
+
+#include <stdint.h>
+
+#include "nc_string.h"
+
+/** An element of the array that is sorted by sort_items() */
+struct sort_item {
+
+	/** The container element that holds @a str */
+	void           *ptr;
+
+	/** The value to be compared */
+	const string_t *str;
+
+	/** The numeric value of @a str, if SORT_NUMERIC was given */
+	uint32_t        key;
+};
+
+int sort_items(struct sort_item *item, size_t n, int flags);
+
+#endif
@@ -0,0 +1,382 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Chunked string builder.
+ *
+ * Building a large response with str_cat() reallocates and copies the
+ * whole string every time the buffer grows. A strbuf_t stores its data
+ * in a chain of fixed-size chunks instead, so appending is O(length of
+ * the new data), and the result can be sent with a single writev(2)
+ * call per STRBUF_IOV_MAX chunks.
+ *
+ * A chunk can also refer to memory owned by the caller with
+ * strbuf_append_ref(), so that large static or cached buffers are
+ * never copied at all.
+*/
+
+#include "config.h"
+
+#include "nc_exception.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_strbuf.h"
+#include "nc_string.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Add a new chunk to the end of the chain.
+ *
+ * @param sb the string builder
+ * @param size the capacity of the new chunk, or zero for a borrowed chunk
+*/
+static int
+strbuf_chunk_push(strbuf_t *sb, size_t size)
+{
+	strbuf_chunk_t *c;
+
+	if ((c = malloc(sizeof(*c) + size)) == NULL)
+		throw_errno("malloc(3)");
+	c->next = NULL;
+	c->data = c->buf;
+	c->len = 0;
+	c->size = size;
+
+	if (sb->tail != NULL)
+		sb->tail->next = c;
+	else
+		sb->head = c;
+	sb->tail = c;
+	sb->nchunks++;
+}
+
+
+/**
+ * Create a new, empty string builder.
+ *
+ * @param dest a new strbuf_t object
+*/
+int
+strbuf_new(strbuf_t **dest)
+{
+
+	mem_calloc(*dest);
+}
+
+
+/**
+ * Destroy a string builder.
+ *
+ * Borrowed buffers are not freed.
+ *
+ * @param sb the object to be destroyed; this will be set to NULL.
+*/
+int
+strbuf_destroy(strbuf_t **sb)
+{
+
+	if (*sb == NULL)
+		return 0;
+
+	(void) strbuf_truncate(*sb);
+	free(*sb);
+	*sb = NULL;
+}
+
+
+/**
+ * Remove all data from a string builder and free all of its chunks.
+ *
+ * @param sb the string builder
+*/
+int
+strbuf_truncate(strbuf_t *sb)
+{
+	strbuf_chunk_t *c, *next;
+
+	for (c = sb->head; c != NULL; c = next) {
+		next = c->next;
+		free(c);
+	}
+	sb->head = sb->tail = NULL;
+	sb->len = 0;
+	sb->nchunks = 0;
+}
+
+
+/**
+ * Append a copy of a buffer.
+ *
+ * The tail chunk is filled first, then new chunks are added as needed.
+ * Data that is already in the builder is never moved.
+ *
+ * @param sb the string builder
+ * @param src the data to be appended
+ * @param len the number of bytes to append
+*/
+int
+strbuf_append(strbuf_t *sb, const void *src, size_t len)
+{
+	const char *cp = src;
+	size_t      n;
+
+	if (len > STRING_MAX - sb->len)
+		throw("result too large");
+
+	while (len > 0) {
+
+		/* Start a new chunk if the tail is full or borrowed */
+		if (sb->tail == NULL || sb->tail->size == 0 || sb->tail->len == sb->tail->size)
+			strbuf_chunk_push(sb, STRBUF_CHUNK_SIZE);
+
+		n = sb->tail->size - sb->tail->len;
+		if (n > len)
+			n = len;
+		memcpy(sb->tail->buf + sb->tail->len, cp, n);
+		sb->tail->len += n;
+		sb->len += n;
+		cp += n;
+		len -= n;
+	}
+}
+
+
+/**
+ * Append a reference to a buffer, without copying it.
+ *
+ * The caller must not modify or free the buffer until the string
+ * builder has been truncated or destroyed.
+ *
+ * @param sb the string builder
+ * @param src the data to be referenced
+ * @param len the number of bytes to reference
+*/
+int
+strbuf_append_ref(strbuf_t *sb, const void *src, size_t len)
+{
+
+	if (len == 0)
+		return 0;
+	if (len > STRING_MAX - sb->len)
+		throw("result too large");
+
+	strbuf_chunk_push(sb, 0);
+	sb->tail->data = src;
+	sb->tail->len = len;
+	sb->len += len;
+}
+
+
+/**
+ * Append a copy of a string.
+ *
+ * @param sb the string builder
+ * @param src the string to be appended
+*/
+int
+strbuf_append_str(strbuf_t *sb, const string_t *src)
+{
+
+	strbuf_append(sb, src->value, src->len);
+}
+
+
+/**
+ * Append a copy of a NUL-terminated character array.
+ *
+ * @param sb the string builder
+ * @param src the characters to be appended
+*/
+int
+strbuf_cat(strbuf_t *sb, const char *src)
+{
+
+	strbuf_append(sb, src, strlen(src));
+}
+
+
+/**
+ * Append formatted output.
+ *
+ * @param sb the string builder
+ * @param format format string
+ * @see printf(3)
+*/
+int
+strbuf_printf(strbuf_t *sb, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	strbuf_vprintf(sb, format, ap);
+
+finally:
+	va_end(ap);
+}
+
+
+/**
+ * Append formatted output from a va_list argument.
+ *
+ * The output is written directly into the tail chunk if there is
+ * room for it; otherwise it is formatted into a temporary buffer.
+ *
+ * @param sb the string builder
+ * @param format format string
+ * @param ap variadic argument list
+ * @see printf(3)
+*/
+int
+strbuf_vprintf(strbuf_t *sb, const char *format, va_list ap)
+{
+	va_list  aq;
+	char    *buf = NULL;
+	size_t   avail = 0;
+	int      len;
+
+	/* Try to format the output directly into the tail chunk */
+	if (sb->tail != NULL && sb->tail->size > 0)
+		avail = sb->tail->size - sb->tail->len;
+	va_copy(aq, ap);
+	len = vsnprintf(avail ? sb->tail->buf + sb->tail->len : NULL, avail, format, aq);
+	va_end(aq);
+	if (len < 0)
+		throw_errno("vsnprintf(3)");
+
+	if ((size_t) len < avail) {
+		sb->tail->len += (size_t) len;
+		sb->len += (size_t) len;
+		return 0;
+	}
+
+	/* It did not fit, so use a temporary buffer */
+	if ((buf = malloc((size_t) len + 1)) == NULL)
+		throw_errno("malloc(3)");
+	(void) vsnprintf(buf, (size_t) len + 1, format, ap);
+	if (strbuf_append(sb, buf, (size_t) len) < 0)
+		throw_silent();
+
+finally:
+	free(buf);
+}
+
+
+/**
+ * Describe the contents of a string builder as an array of iovec structures.
+ *
+ * If the builder has more than @a max chunks, only the first @a max
+ * are stored; compare @a count with sb->nchunks to detect this.
+ *
+ * @param dest array of at least @a max iovec structures
+ * @param max the number of elements in @a dest
+ * @param count the number of elements that were stored in @a dest
+ * @param sb the string builder
+ * @see writev(2)
+*/
+int
+strbuf_to_iovec(struct iovec *dest, size_t max, size_t *count, const strbuf_t *sb)
+{
+	strbuf_chunk_t *c;
+	size_t          n = 0;
+
+	for (c = sb->head; c != NULL && n < max; c = c->next) {
+		dest[n].iov_base = (void *) c->data;
+		dest[n].iov_len = c->len;
+		n++;
+	}
+	*count = n;
+}
+
+
+/**
+ * Copy the contents of a string builder into a single string.
+ *
+ * @param dest string that will hold the result
+ * @param sb the string builder
+*/
+int
+strbuf_to_str(string_t *dest, const strbuf_t *sb)
+{
+	strbuf_chunk_t *c;
+
+	str_truncate(dest);
+	str_resize(dest, sb->len + 1);
+	for (c = sb->head; c != NULL; c = c->next)
+		str_append_bytes(dest, c->data, c->len);
+}
+
+
+/**
+ * Write the entire contents of a string builder to a file descriptor.
+ *
+ * Up to STRBUF_IOV_MAX chunks are written with each writev(2) call,
+ * and short writes are resumed where they left off.
+ *
+ * @param sb the string builder
+ * @param fd file or socket descriptor
+*/
+int
+strbuf_write(const strbuf_t *sb, int fd)
+{
+	struct iovec    iov[STRBUF_IOV_MAX];
+	strbuf_chunk_t *cur, *c;
+	size_t          off, o;
+	ssize_t         bytes;
+	int             n;
+
+	cur = sb->head;
+	off = 0;
+	while (cur != NULL) {
+
+		/* Gather the next batch of chunks, skipping what was already written */
+		for (n = 0, c = cur, o = off; c != NULL && n < STRBUF_IOV_MAX; c = c->next, o = 0) {
+			if (c->len == o)
+				continue;
+			iov[n].iov_base = (char *) c->data + o;
+			iov[n].iov_len = c->len - o;
+			n++;
+		}
+		if (n == 0)
+			break;
+
+		if ((bytes = writev(fd, iov, n)) < 0) {
+			if (errno == EINTR)
+				continue;
+			throw_errno("writev(2)");
+		}
+		if (bytes == 0)
+			throw("short writev(2) detected");
+
+		/* Advance past the data that was written */
+		while (cur != NULL && (size_t) bytes >= cur->len - off) {
+			bytes -= (ssize_t) (cur->len - off);
+			cur = cur->next;
+			off = 0;
+		}
+		off += (size_t) bytes;
+	}
+}
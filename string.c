@@ -31,17 +31,19 @@
 #define _GNU_SOURCE 1
 #endif
 
+#include "bytescan.h"
+#include "nc_date.h"
 #include "nc_exception.h"
 #include "nc_list.h"
 #include "nc_log.h"
 #include "nc_memory.h"
+#include "nc_regexp.h"
 #include "nc_string.h"
 
 #include <ctype.h>
 #include <errno.h>
 #include <grp.h>
 #include <pwd.h>
-#include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -106,14 +108,9 @@ str_truncate(string_t *dest)
 int
 str_putc(string_t *dest, int c)
 {
-	char buf[2];
+	char ch = (char) c;
 
-	/* Convert the char to a simple string */
-	buf[0] = (char) c;
-	buf[1] = '\0';
-
-	/* Append it to the buffer */
-	str_cat(dest, buf);
+	str_append_bytes(dest, &ch, 1);
 }
 
 
@@ -163,7 +160,7 @@ str_divide(string_t *left, string_t *right, const string_t *src, size_t position
 	/* The <position> is a positive offset from zero */
 	/* Copy the result to the caller */
 	str_ncpy(left, src->value, position);
-	str_cpy(right, src->value + position + 1);
+	str_ncpy(right, src->value + position + 1, src->len - position - 1);
 }
 
 
@@ -394,11 +391,8 @@ str_set_len(string_t *dest, size_t new_len)
 int
 str_to_upper(string_t *s)
 {
-	size_t i, len;
-	
-	for (i = 0, len = str_len(s); i < len; i++) {
-		memset((char *) s->value + i, toupper((int) s->value[i]), 1);
-	}
+
+	bytescan_fold((char *) s->value, s->value, s->len, 'a');
 }
 
 
@@ -411,18 +405,12 @@ str_to_upper(string_t *s)
 int
 cbuf_len(size_t *dest, char_t *s)
 {
-	size_t i;
 
-	/* Find the end of the string */
-	for (i = 0; i < STRING_MAX; i++) {
-		if ((char) *(s + i) == '\0') {
-			*dest = i;
-			return 0;
-		}
+	*dest = strlen(s);
+	if (*dest >= STRING_MAX) {
+		*dest = 0;
+		throw("character buffer too large");
 	}
-
-	*dest = 0;
-	throw("character buffer too large");
 }
 
 
@@ -432,7 +420,7 @@ str_new(string_t **dest)
 	size_t    initial_size = 16;
 	string_t *str = NULL;
 
-	mem_calloc(*dest);
+	mem_slab_calloc(*dest);
 	str = *dest;
 
 	if ((str->value = malloc(initial_size)) == NULL)
@@ -452,7 +440,7 @@ str_destroy(string_t **str)
 
 	if ((*str)->value)
 		free((char *) (*str)->value);
-	free(*str);
+	mem_slab_release(*str);
 	*str = NULL;
 }
 
@@ -495,15 +483,69 @@ str_resize(string_t *str, size_t new_size)
 int
 str_prepend(string_t *dest, const string_t *src)
 {
-	string_t *buf;
 
 	/* Don't prepend two strings that share the same memory address */
 	if (src == dest)
 		throw("src and dest cannot be equal");
 
-	str_copy(buf, dest);
-	str_copy(dest, src);
-	str_append(dest, buf);
+	if (src->len == 0)
+		return 0;
+	if (dest->len + src->len >= STRING_MAX)
+		throw("operation would exceed STRING_MAX");
+
+	/* Shift the existing contents to make room at the beginning */
+	str_resize(dest, dest->len + src->len + 1);
+	memmove((char *) dest->value + src->len, dest->value, dest->len + 1);
+	memcpy((char *) dest->value, src->value, src->len);
+	dest->len += src->len;
+}
+
+
+/**
+ * Append an array of bytes to the end of a string.
+ *
+ * The bytes may include NUL characters. The buffer grows geometrically,
+ * so that a series of appends takes linear time.
+ *
+ * @param dest destination string
+ * @param src pointer to the bytes to be appended; this may point into
+ *            the buffer of @a dest
+ * @param len number of bytes to append
+*/
+int
+str_append_bytes(string_t *dest, const void *src, size_t len)
+{
+	const char *cp = src;
+	size_t      new_size, offset = 0;
+	bool        inside = false;
+
+	if (len == 0)
+		return 0;
+	if (len >= STRING_MAX || dest->len + len >= STRING_MAX)
+		throw("input string is too long");
+
+	/* If the source is inside of the destination, it may be moved by realloc(3) */
+	if (dest->size > 0 && cp >= dest->value && cp < dest->value + dest->size) {
+		inside = true;
+		offset = (size_t) (cp - dest->value);
+	}
+
+	/* Resize the buffer as needed, at least doubling it each time */
+	new_size = dest->len + len + 1;
+	if (new_size > dest->size) {
+		if (new_size < dest->size * 2)
+			new_size = dest->size * 2;
+		if (new_size > STRING_MAX)
+			new_size = STRING_MAX;
+		str_resize(dest, new_size);
+		if (inside)
+			cp = dest->value + offset;
+	}
+
+	/* Append the new bytes to the existing string */
+	memmove((char *) dest->value + dest->len, cp, len);
+	dest->len += len;
+	memset((char *) dest->value + dest->len, 0, 1);
 }
 
 
@@ -512,7 +554,6 @@ str_prepend(string_t *dest, const string_t *src)
  *
  * @param dest destination string
  * @param src source string
- * @todo Optimize this, don't just call str_cat().. 
 */
 int
 str_append(string_t *dest, const string_t *src)
@@ -521,7 +562,7 @@ str_append(string_t *dest, const string_t *src)
 	if (src == dest)
 		throw("src and dest cannot be equal");
 
-	str_cat(dest, src->value);
+	str_append_bytes(dest, src->value, src->len);
 }
 
 
@@ -530,35 +571,33 @@ str_append(string_t *dest, const string_t *src)
  *
  * @param dest destination string
  * @param src pointer to a NUL terminated character array
- * @todo Optimize this, don't just call str_cat().. 
 */
 int
 str_cat(string_t *dest, const char *src)
 {
-	size_t	src_len,
-                new_size;
 
-	/* Compute the input length */
-	src_len = strlen(src);
-	if (src_len == 0)
-		return 0;
-	if (src_len >= STRING_MAX)
-		throw("input string is too long");
+	str_append_bytes(dest, src, strlen(src));
+}
 
-	/* Compute the required buffer size */
-	new_size = dest->len + src_len + 1;
-	if (new_size <= dest->len)
-		throw("operation would overflow");
 
-	/* Resize the buffer as needed */
-	if (new_size > dest->size) {
-		str_resize(dest, new_size);
-	}
+/**
+ * Append at most @a len characters of a character array to the end of a string.
+ *
+ * Like strncat(3), copying stops early if a NUL character is found.
+ *
+ * @param dest destination string
+ * @param src pointer to a character array
+ * @param len maximum number of characters to append
+*/
+int
+str_ncat(string_t *dest, const char *src, size_t len)
+{
+	const char *nul;
+
+	if ((nul = memchr(src, '\0', len)) != NULL)
+		len = (size_t) (nul - src);
 
-	/* Append the new string to the existing string */
-	memcpy((char *) dest->value + dest->len, src, src_len);
-	memset((char *) dest->value + dest->len + src_len, 0, 1);
-	str_set_len(dest, new_size - 1);
+	str_append_bytes(dest, src, len);
 }
 
 
@@ -593,6 +632,8 @@ finally:
 int
 str_vprintf(string_t *dest, const char *format, va_list argv)
 {
+	int len;
+
 	/* Deallocate any previous string contents */
 	if (dest->size > 0) {
 		free((char *) dest->value);
@@ -601,10 +642,10 @@ str_vprintf(string_t *dest, const char *format, va_list argv)
 		dest->len = 0;
 	}
 
-	if (vasprintf((char **) &dest->value, format, argv) < 0)
+	if ((len = vasprintf((char **) &dest->value, format, argv)) < 0)
 		throw_errno("vasprintf(3)");
 
-	dest->len = strlen(dest->value);
+	dest->len = (size_t) len;
 	if (dest->len > STRING_MAX) {
 		free((char *) dest->value);
 		dest->value = NULL;
@@ -627,8 +668,29 @@ str_vprintf(string_t *dest, const char *format, va_list argv)
 int
 str_contains(bool *result, const string_t *haystack, char_t *needle)
 {
+	const char *cp, *last;
+	size_t      len;
+
+	*result = false;
 
-	*result = strstr(haystack->value, needle) == NULL ? false : true;
+	len = strlen(needle);
+	if (len == 0) {
+		*result = true;
+		return 0;
+	}
+	if (len > haystack->len)
+		return 0;
+
+	/* Look for the first character, then compare the rest */
+	last = haystack->value + haystack->len - len;
+	for (cp = haystack->value; cp <= last; cp++) {
+		if ((cp = memchr(cp, needle[0], (size_t) (last - cp) + 1)) == NULL)
+			break;
+		if (memcmp(cp, needle, len) == 0) {
+			*result = true;
+			break;
+		}
+	}
 }
 
 
@@ -646,8 +708,15 @@ str_contains(bool *result, const string_t *haystack, char_t *needle)
 int
 str_cmp(const string_t *s1, const char *s2)
 {
+	size_t len;
+	int    rc;
+
+	len = strlen(s2);
+	rc = memcmp(s1->value, s2, (s1->len < len) ? s1->len : len);
+	if (rc == 0)
+		rc = (s1->len > len) - (s1->len < len);
 
-	return strcmp(s1->value, s2);
+	return rc;
 }
 
 
@@ -676,23 +745,12 @@ str_casecmp(const string_t *s1, const char *s2)
 int
 str_compare(const string_t *s1, const string_t *s2)
 {
-	char *c1, *c2;
 
 	/* Don't compare two strings that share the same memory address */
 	//FIXME: why not?
 	require (s1 != s2 && s1->value != s2->value);
 
-	/* Compare each character */
-	c1 = (char *) s1->value;
-	c2 = (char *) s2->value;
-	while (*c1 != '\0' && *c2 != '\0') {
-		if (*c1 != *c2)
-			return -1;
-		c1++;
-		c2++;
-	}
-	/* This tests if the strings are of different lengths */
-	if (*c1 != *c2)
+	if (s1->len != s2->len || memcmp(s1->value, s2->value, s1->len) != 0)
 		return -1;
 }
 
@@ -706,11 +764,12 @@ str_compare(const string_t *s1, const string_t *s2)
 int
 str_case_compare(const string_t *s1, const string_t *s2)
 {
+
 	/* Don't compare two strings that share the same memory address */
 	//FIXME: why not?
 	require (s1 != s2 && s1->value != s2->value);
 
-	if (strcasecmp(s1->value, s2->value) != 0)
+	if (s1->len != s2->len || !bytescan_case_equal(s1->value, s2->value, s1->len))
 		return -1;
 }
 
@@ -762,25 +821,147 @@ str_read(string_t *dest, int fd, size_t size)
 }
 
 
+/**
+ * Test if all eight bytes of a 64-bit word are ASCII digits.
+ *
+ * A byte is a digit if its high nibble is 3, and adding 6 to it
+ * does not change the high nibble.
+ */
+#define SWAR_ALL_DIGITS(v) \
+	((((v) & 0xF0F0F0F0F0F0F0F0ULL) | \
+	  ((((v) + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == \
+	 0x3333333333333333ULL)
+
+
+#ifndef WORDS_BIGENDIAN
+/**
+ * Convert eight ASCII digits into an integer.
+ *
+ * The digits are combined in pairs, then groups of four, then eight, so
+ * that a conversion takes three multiplications instead of eight.
+ * This only works on little-endian hosts.
+ *
+ * @param dest the value of the digits
+ * @param src pointer to eight bytes; it does not need to be aligned
+ * @return 0 if successful, or -1 if any byte is not a digit
+*/
+static inline int
+swar_parse8(uint64_t *dest, const char *src)
+{
+	uint64_t v;
+
+	memcpy(&v, src, sizeof(v));
+	if (!SWAR_ALL_DIGITS(v))
+		return -1;
+
+	v -= 0x3030303030303030ULL;
+	v = (v * 10) + (v >> 8);
+	v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+	     (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+
+	*dest = v;
+}
+#endif
+
+
+/**
+ * Convert a decimal number into an unsigned 64-bit integer.
+ *
+ * Unlike strtoul(3), the input does not need to be NUL terminated, so
+ * this can be used on a slice of a larger buffer. Every byte must be
+ * a digit; whitespace, signs and trailing characters are not allowed.
+ *
+ * @param dest pointer to a uint64_t to store the result
+ * @param src pointer to the first digit
+ * @param len number of bytes to be converted
+*/
+int
+str_parse_uint64(uint64_t *dest, const char *src, size_t len)
+{
+	uint64_t     result = 0;
+	uint64_t     chunk;
+	size_t       i = 0;
+	unsigned int d;
+
+	if (len == 0)
+		throw("conversion error: string is empty");
+
+#ifndef WORDS_BIGENDIAN
+	/* Convert eight digits at a time; sixteen digits cannot overflow */
+	for (; len - i >= 8 && i < 16; i += 8) {
+		if (swar_parse8(&chunk, src + i) < 0)
+			break;
+		result = result * 100000000ULL + chunk;
+	}
+#endif
+
+	/* Convert the remaining digits one at a time */
+	for (; i < len; i++) {
+		d = (unsigned char) src[i] - '0';
+		if (d > 9)
+			throwf("conversion error: string is not numeric: `%.*s'", (int) len, src);
+		if (result > (UINT64_MAX - d) / 10)
+			throw("conversion error: string exceeds numeric range");
+		result = result * 10 + d;
+	}
+
+	*dest = result;
+}
+
+
+/**
+ * Convert a decimal number into a signed 64-bit integer.
+ *
+ * The number may begin with a '+' or '-' sign.
+ *
+ * @param dest pointer to an int64_t to store the result
+ * @param src pointer to the first character
+ * @param len number of bytes to be converted
+ * @see str_parse_uint64()
+*/
+int
+str_parse_int64(int64_t *dest, const char *src, size_t len)
+{
+	uint64_t u;
+	bool     negative = false;
+
+	if (len > 0 && (src[0] == '-' || src[0] == '+')) {
+		negative = (src[0] == '-');
+		src++;
+		len--;
+	}
+
+	if (str_parse_uint64(&u, src, len) < 0)
+		throw_silent();
+
+	if (negative) {
+		if (u > (uint64_t) INT64_MAX + 1)
+			throw("conversion error: string exceeds numeric range");
+		*dest = (u == (uint64_t) INT64_MAX + 1) ? INT64_MIN : -(int64_t) u;
+	} else {
+		if (u > (uint64_t) INT64_MAX)
+			throw("conversion error: string exceeds numeric range");
+		*dest = (int64_t) u;
+	}
+}
+
+
 /**
  * Convert a string into a signed integer.
  *
  * @param dest pointer to an int to store the result
  * @param src string to be converted
+ * @see str_parse_int64()
 */ 
 int
 str_to_int(int *dest, string_t *src)
 {
-	long l;
-
-	errno = 0;
-
-	l = strtol(src->value, (char **)NULL, 10);
+	int64_t l;
 
-	if (errno != 0)
-		throwf("error converting string `%s' to an integer", src->value);
+	if (str_parse_int64(&l, src->value, src->len) < 0)
+		throw_silent();
 
-	if (l > INT_MAX)
+	if (l > INT_MAX || l < INT_MIN)
 		throw("conversion error: out of range");
 
 	*dest = (int) l;
@@ -792,21 +973,17 @@ str_to_int(int *dest, string_t *src)
  *
  * @param dest pointer to an int32_t to store the result
  * @param src string to be converted
- * @bug - this is a copy/paste of str_to_int() 
+ * @see str_parse_int64()
 */ 
 int
 str_to_int32(int32_t *dest, string_t *src)
 {
-	long l;
-
-	errno = 0;
-
-	l = strtol(src->value, (char **)NULL, 10);
+	int64_t l;
 
-	if (errno != 0)
-		throwf("error converting string `%s' to an integer", src->value);
+	if (str_parse_int64(&l, src->value, src->len) < 0)
+		throw_silent();
 
-	if (l > INT32_MAX)
+	if (l > INT32_MAX || l < INT32_MIN)
 		throw("conversion error: out of range");
 
 	*dest = (int32_t) l;
@@ -818,16 +995,17 @@ str_to_int32(int32_t *dest, string_t *src)
  *
  * @param dest pointer to an uint32_t to store the result
  * @param src string to be converted
+ * @see str_parse_uint64()
 */ 
 int
 str_to_uint32(uint32_t *dest, const string_t *src)
 {
-	unsigned long ul;
+	uint64_t ul;
 	
-	if (str_to_ulong(&ul, src) < 0)
-		throw("conversion error");
+	if (str_parse_uint64(&ul, src->value, src->len) < 0)
+		throw_silent();
 
-	if (ul > UINT_MAX)
+	if (ul > UINT32_MAX)
 		throw("conversion error: out of range");
 	
 	*dest = (uint32_t) ul;
@@ -839,18 +1017,20 @@ str_to_uint32(uint32_t *dest, const string_t *src)
  *
  * @param dest pointer to an unsigned long to store the result
  * @param src string to be converted
+ * @see str_parse_uint64()
 */ 
 int
 str_to_ulong(unsigned long *dest, const string_t *src)
 {
-	char *ep;
+	uint64_t ul;
 
-	errno = 0;
-	*dest = strtoul(src->value, &ep, 10);
-	if (src->value[0] == '\0' || *ep != '\0')
-		throwf("conversion error: string is not numeric: `%s'", src->value);
-	if (errno == ERANGE && *dest == ULONG_MAX)
+	if (str_parse_uint64(&ul, src->value, src->len) < 0)
+		throw_silent();
+
+	if (ul > ULONG_MAX)
 		throw("conversion error: string exceeds numeric range");
+
+	*dest = (unsigned long) ul;
 }
 
 
@@ -904,49 +1084,37 @@ str_ncpy(string_t *dest, const char *src, size_t len)
 int
 str_ncmp(const string_t *s, char_t *c, size_t len)
 {
+	const char *nul;
+	size_t      n, clen;
+	int         rc;
+
 	require (len > 0 && len < STRING_MAX);
-	
-	return strncmp(s->value, c, len);
+
+	/* Compare no more than @a len characters, and stop at the end of either string */
+	n = (s->len < len) ? s->len : len;
+	clen = ((nul = memchr(c, '\0', len)) != NULL) ? (size_t) (nul - c) : len;
+	rc = memcmp(s->value, c, (n < clen) ? n : clen);
+	if (rc == 0)
+		rc = (n > clen) - (n < clen);
+
+	return rc;
 }
 
 
 /**
  * Convert from human-readable time to UNIX time.
  *
- * The time string must be in this format: `12 Aug 2006 22:49:40 -0400'.
+ * The time string must be an RFC 2822 date, such as `12 Aug 2006 22:49:40 -0400'.
  *
  * @param dest destination buffer
  * @param src formatted time string
+ * @see date_parse_rfc2822()
 */
 int
 str_to_time(time_t *dest, string_t *src)
 {
-	string_t *buf, *offset_hours, *offset_mins;
-	int       offset;
-	struct tm result;
-
-	/* Make a copy of the string without the time zone */
-	if (str_str_regex(src, "^([0-9]{1,2} [A-Za-z]{3} [0-9]{4} "
-				"[0-9]{2}:[0-9]{2}:[0-9]{2}) ([+-][0-9][0-9])([0-9][0-9])$"
-				,
-				buf, offset_hours, offset_mins, NULL) < 0)
-		throwf("invalid time string: `%s'", src->value);
-
-	/* PORTABILITY: many strptime(3) functions can not handle the time zone */
-	/* WORKAROUND: ignore the time zone */
-	if (strptime(buf->value, "%d %b %Y %T", &result) == NULL)
-		throwf("unable to convert time string `%s'", buf->value);
-
-	/* Convert the broken-down time into UNIX time */
-	*dest = mktime(&result);
-
-	/* Adjust for the time zone by adding or subtracting hours from <dest> */
-	offset = atoi(offset_hours->value) * 60 * 60;
-	if (offset < 0) {
-		offset -= atoi(offset_mins->value) * 60;
-	} else {
-		offset += atoi(offset_mins->value) * 60;
-	}
+
+	date_parse_rfc2822(dest, NULL, src->value, src->len);
 }
 
 
@@ -957,29 +1125,13 @@ str_to_time(time_t *dest, string_t *src)
  * @param tloc time, in seconds, since the Epoch (1/1/1970)
  * @param format format string to pass to strftime(3)
  * @see strftime(3)
+ * @see date_strftime()
 */
 int
 str_time(string_t *dest, time_t *tloc, char_t *format)
 {
-	var_char_t  buf[230];
-	struct tm timeval;
-	time_t    now;
-	
-	/* If a time is not given, use the current time */
-	if (tloc == NULL) {
-		now = time(NULL);
-		tloc = &now;
-	}
-
-	/* Convert UNIX time into GMT time */
-	localtime_r(tloc, &timeval);
 
-	/* Generate a formatted date string.
-	 */
-	memset(buf, 0, sizeof(buf));
-	if (strftime((char *) &buf, sizeof(buf) - 1, format, &timeval) == 0)
-		throw("date format error");
-	str_cpy(dest, buf);
+	date_strftime(dest, (tloc == NULL) ? time(NULL) : *tloc, format);
 }
 
 
@@ -1014,92 +1166,8 @@ int
 str_from_time(string_t *dest, time_t *tloc)
 {
 
-	str_time(dest, tloc, "%d %b %Y %T %z");
-}
-
-
-/**
- * Print a regular expression error message to the system log.
- *
- * @param regex_errno errno as returned by a regex function call
- * @param preg the compiled regular expression that caused the error
- * @returns This function always returns -1.
-*/
-static inline int
-regex_error(int regex_errno, regex_t *preg)
-{
-	char errbuf[80];
-
-	(void) regerror(regex_errno, preg, (char *) &errbuf, sizeof(errbuf));
-	log_error("regex error: %s", errbuf);
-
-	throw_silent();
-}
-
-
-/**
- * Compile a regular expression.
- *
- * @param preg a regex object 
- * @param pattern regular expression pattern
- * @param cflags flags passed to regcomp(3)
-*/ 
-static inline int
-regex_compile(regex_t *preg, const char *pattern, int cflags)
-{
-	int i;
-
-	i = regcomp(preg, pattern, REG_EXTENDED | REG_ICASE | cflags );
-	if (i != 0) 
-		return regex_error(i, preg);
-
-}
-
-
-/**
- * Perform a regular expression search and replace.
- *
- * @param preg a compiled regular expression
- * @param buf the string to be modified
- * @param replacement the replacement text
-*/ 
-static int
-regex_replace_all(regex_t *preg,
-		string_t *buf, 
-		const char *replacement
-		)
-{
-	string_t   *result;
-	regmatch_t  pmatch[1];
-	int i;
-
-	i = regexec(preg, buf->value, 1, pmatch, 0);
-	if (i != 0) {
-		if (i == REG_NOMATCH) { 
-			goto finally;
-		} else {
-			return regex_error(i, preg);
-		}
-	}
-
-	/* NOTE: rm_so and rm_eo are 'long long' (a.k.a regoff_t) type 
-	   and must be downcast to 'size_t' type
-	 */
-	
-	/* Copy the beginning part of the string */
-	str_ncpy(result, buf->value, (size_t) pmatch[0].rm_so);
-
-	/* Insert the replacement text */
-	str_cat(result, replacement);
-
-	/* Copy the end part of the original string */
-	str_cat(result, buf->value + (size_t) pmatch[0].rm_eo);
-
-	/* Replace the input buffer with the result */
-	str_move(buf, result);
-
-finally:
-	regfree(preg);
+	date_format_local(dest, (tloc == NULL) ? time(NULL) : *tloc, 
+			DATE_RFC2822 | DATE_NO_WEEKDAY);
 }
 
 
@@ -1114,31 +1182,15 @@ finally:
 int
 str_match_regex(bool *result, const string_t *src, char_t *pattern)
 {
-	regex_t preg;
-	int i = 0;
+	regexp_t *re = NULL;
 
-	/* Compile the pattern */
-	if (regex_compile(&preg, pattern, REG_NOSUB) < 0)
+	if (regexp_cache_get(&re, pattern, REG_NOSUB) < 0)
 		throw("regex compilation error");
-	//log_debug2("pattern=`%s' val=`%s' i=%d", pattern, src->value, i);
-	
-	/* Execute the query */
-	i = regexec(&preg, src->value, 0, NULL, 0);
-	if (i != 0) {
-		if (i == REG_NOMATCH) { 
-			*result = false;
-			goto finally;
-		} else {
-			(void) regex_error(i, &preg);
-			throw("regex error");
-		}
-	}
-
-	*result = true;
+	if (regexp_match(result, re, src) < 0)
+		throw_silent();
 
 finally:
-	/* Free any auxiliary storage used by the regex */
-	regfree(&preg);
+	(void) regexp_destroy(&re);
 }
 
 
@@ -1154,72 +1206,44 @@ finally:
 int
 str_subst_regex(string_t *src, const char *pattern, const char *replacement)
 {
-	regex_t preg;
-	int i;
-	
-	if ((i = regex_compile(&preg, pattern, 0)) < 0) {
-		(void) regex_error(i, &preg);
-		throw("error compiling regular expression");
-	}
+	regexp_t *re = NULL;
 
-	regex_replace_all(&preg, src, replacement);
+	if (regexp_cache_get(&re, pattern, 0) < 0)
+		throw("error compiling regular expression");
+	if (regexp_subst(src, re, replacement) < 0)
+		throw_silent();
 
-	/* Recalculate the string length */
-	src->len = strlen(src->value);
+finally:
+	(void) regexp_destroy(&re);
 }
 
 
-/* Ignore warnings about accessing members of a regex_t */
 /**
  * Retrieve one or more substrings from a string.
  *
  * @todo better documentation
  * @param src string to be examined
  * @param pattern regular expression
+ * @see regexp_vextract()
 */
 int
 str_str_regex(const string_t *src, const char *pattern, ...)
 {
 	va_list ap;
-	regmatch_t  pmatch[16];
-	regex_t preg;
-	string_t *buf = NULL;
-	unsigned int i;
-
-	/* Compile the regex */
-	if ((i = regex_compile(&preg, pattern, 0)) != 0) {
-		log_warning("regex compilation failed for `%s'", pattern);
-		return regex_error(i, &preg);
-	}
+	regexp_t *re = NULL;
+	int rc;
 
-	/* Check if pmatch is large enough to hold all the results */
-	if (preg.re_nsub > 16)
-		throw("too many sub-expressions");
-
-	/* Execute the regex */
-	i = regexec(&preg, src->value, 16, pmatch, 0);
-	if (i != 0) {
-		if (i == REG_NOMATCH) { 
-			return -1;
-		} else {
-			log_warning("regexec failed for `%s'", pattern);
-			return regex_error(i, &preg);
-		}
-	}
+	if (regexp_cache_get(&re, pattern, 0) < 0)
+		throw_silent();
 
-	/* Retreive the results and copy them to the caller */
 	va_start(ap, pattern);
-	for (i = 1; i <= preg.re_nsub; i++) {
-		buf = va_arg(ap, string_t *);
-		str_ncpy(buf, 
-					src->value + pmatch[i].rm_so, 
-					(size_t) pmatch[i].rm_eo - (size_t) pmatch[i].rm_so
-			     );
-	}
+	rc = regexp_vextract(re, src, ap);
 	va_end(ap);
+	if (rc < 0)
+		throw_silent();
 
 finally:
-	regfree(&preg);
+	(void) regexp_destroy(&re);
 }
 
 
@@ -1268,29 +1292,82 @@ str_chomp(string_t *str)
 int
 str_translate(string_t *s, int old, int new)
 {
-	char  *cp;
 
-	cp = (char *) s->value;
-	while (*(cp++) != '\0') {
-		if (*cp == (char) old) 
-			*cp = (char) new;
-	}
+	bytescan_translate((char *) s->value, s->len, old, new);
 }
 
 
+/**
+ * The number of bytes needed to represent each character in a URI-encoded
+ * string: 1 if the character is passed through as-is, or 3 if it must be 
+ * written as a `%XX' escape sequence.
+ *
+ * The unreserved characters are [A-Za-z0-9] and "/_.-~".
+ */
+static const uint8_t URI_WIDTH[256] = {
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,	/* 0x00 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,	/* 0x10 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 1, 1, 1,	/* 0x20 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3,	/* 0x30 */
+	3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x40 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 1,	/* 0x50 */
+	3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x60 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 1, 3,	/* 0x70 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,	/* 0x80 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,	/* 0x90 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,	/* 0xa0 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,	/* 0xb0 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,	/* 0xc0 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,	/* 0xd0 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,	/* 0xe0 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,	/* 0xf0 */
+};
+
+/** The numeric value of each hexadecimal digit, or -1 for all other characters */
+static const int8_t HEX_VALUE[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0x00 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0x10 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0x20 */
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,	/* 0x30 */
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0x40 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0x50 */
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0x60 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0x70 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0x80 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0x90 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0xa0 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0xb0 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0xc0 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0xd0 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0xe0 */
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,	/* 0xf0 */
+};
+
+
 /**
  * Generate a URI-encoded string by escaping special characters.
  *
- * @todo document the RFC for this encoding
+ * Every character except [A-Za-z0-9] and "/_.-~" is replaced by a `%'
+ * followed by two lowercase hexadecimal digits (see RFC 3986, section 2.1).
+ *
+ * The length of the result is computed before anything is copied, so
+ * the destination buffer is resized at most once. Runs of unreserved
+ * characters are copied with a single memcpy(3).
+ *
  * @param dest buffer to store the result
  * @param src string to be URI-encoded
 */ 
 int
 str_escape(string_t *dest, const string_t *src)
 {
-	string_t      *buf;
-	var_char_t     code[4];
-	size_t 	       i, len;
+	static const char hex_digit[] = "0123456789abcdef";
+	const unsigned char *cp, *run, *end;
+	char          *out;
+	size_t         len;
+
+	/* The source is read while the destination is being written */
+	if (src == dest)
+		throw("src and dest cannot be equal");
 
 	str_truncate(dest);
 
@@ -1298,58 +1375,89 @@ str_escape(string_t *dest, const string_t *src)
 	if (str_len(src) == 0)
 		return 0;
 
-	len = str_len(src);
-	for (i = 0; i < len; i++) {
-		if ( isalnum((int)src->value[i]) || strchr( "/_.-~", src->value[i] ) != NULL )
-		{
-			str_putc(buf, (int) src->value[i]);
-		}
-		else
-		{
-			if (snprintf(code, 
-						sizeof(code), 
-						"%%%02x", 
-						(unsigned int) src->value[i] & 0xff) < 0)
-				throw_errno("snprintf(3)");
-			str_cat(buf, code);
+	/* Compute the length of the result */
+	cp = (const unsigned char *) src->value;
+	end = cp + src->len;
+	for (len = 0; cp < end; cp++) 
+		len += URI_WIDTH[*cp];
+	if (len >= STRING_MAX)
+		throw("result too large");
+
+	/* Allocate the destination buffer */
+	str_resize(dest, len + 1);
+
+	/* Copy each run of unreserved characters, then escape the character that ends it */
+	out = (char *) dest->value;
+	cp = (const unsigned char *) src->value;
+	while (cp < end) {
+		for (run = cp; cp < end && URI_WIDTH[*cp] == 1; cp++) {}
+		memcpy(out, run, cp - run);
+		out += cp - run;
+
+		if (cp < end) {
+			out[0] = '%';
+			out[1] = hex_digit[*cp >> 4];
+			out[2] = hex_digit[*cp & 0x0f];
+			out += 3;
+			cp++;
 		}
 	}
-
-	str_move(dest, buf);
+	*out = '\0';
+	dest->len = len;
 }
 
 
 /**
  * Compute the original string from a URI-encoded string.
  *
+ * A `%' that is not followed by two hexadecimal digits is copied as-is.
+ *
  * @param dest buffer to store the result
  * @param src URI-encoded string
 */
 int
 str_unescape(string_t *dest, const string_t *src)
 {
-	string_t *buf;
-	size_t i = 0;
-	int code = 0;
+	const unsigned char *cp, *pct, *end;
+	char   *out;
+
+	/* The source is read while the destination is being written */
+	if (src == dest)
+		throw("src and dest cannot be equal");
+
+	str_truncate(dest);
 
 	/* Ignore empty strings */
 	if (str_len(src) == 0)
 		return 0;
 
-	/* Process each character of the source string */
-	while (src->value[i] != '\0') {
-		if (src->value[i] == '%' &&
-			sscanf(&src->value[i], "%%%02x", (unsigned int *) &code) == 1)  {
-
-			i += 2;
-			str_putc(buf, code);
+	/* The result is never longer than the source */
+	str_resize(dest, src->len + 1);
+
+	out = (char *) dest->value;
+	cp = (const unsigned char *) src->value;
+	end = cp + src->len;
+	while (cp < end) {
+
+		/* Copy everything up to the next escape sequence */
+		if ((pct = memchr(cp, '%', end - cp)) == NULL)
+			pct = end;
+		memcpy(out, cp, pct - cp);
+		out += pct - cp;
+		cp = pct;
+		if (cp == end)
+			break;
+
+		/* Decode the escape sequence */
+		if (end - cp >= 3 && HEX_VALUE[cp[1]] >= 0 && HEX_VALUE[cp[2]] >= 0) {
+			*out++ = (char) ((HEX_VALUE[cp[1]] << 4) | HEX_VALUE[cp[2]]);
+			cp += 3;
 		} else {
-			str_putc(buf, (int) src->value[i]);
+			*out++ = (char) *cp++;
 		}
-		i++;
 	}
-
-	str_move(dest, buf);
+	*out = '\0';
+	dest->len = out - dest->value;
 }
 
 
@@ -1364,15 +1472,8 @@ str_unescape(string_t *dest, const string_t *src)
 int
 str_count(size_t *dest, const string_t *s, int c)
 {
-	var_char_t *cp = NULL;
-
-	*dest = 0;
 
-	cp = (char *) s->value;
-	while (*cp != '\0') {
-		if (*cp++ == (char) c)
-			(*dest)++;
-	}
+	*dest = bytescan_count(s->value, s->len, c);
 }
 
 
@@ -1442,43 +1543,41 @@ str_to_inet(struct in_addr *addr, const string_t *src)
 int
 str_split(list_t *dest, const string_t *src, int delimiter)
 {
-	string_t *buf, *src_copy, *delim;
-	var_char_t *tok   = NULL,
-		   *cp    = NULL;
+	string_t   *buf;
+	const char *cp, *end, *tok;
+	size_t      len;
 
 	/* Do nothing if the string is empty */
 	if (str_len(src) == 0)
 		return 0;
 
-	/* Make a copy of the input string */
-	str_copy(src_copy, (string_t *) src);
-
-	/* strspn(3) expects a NUL terminated string */
-	str_sprintf(delim, "%c", delimiter);
-
 	/* Delete any items that are currently in the destination list */
 	list_truncate(dest);
 
-	/* Special case: remove the trailing delimiter if it exists */
-	str_chomp(src_copy);
-
-	//log_debug("delim=`%c' src=`%s'", delimiter, src_copy->value);
+	/* Special case: ignore the trailing LF or CR+LF if it exists */
+	end = src->value + src->len;
+	if (end > src->value && end[-1] == '\n')
+		end--;
+	if (end > src->value && end[-1] == '\r')
+		end--;
 
 	/* Parse each token and add it to the list */
-	cp = (char *) src_copy->value;
-	while ((tok = strsep(&cp, delim->value)) != NULL) {
-		//log_debug("tok=`%s'", tok);
+	for (cp = src->value; ; cp = tok + 1) {
+		if ((tok = memchr(cp, delimiter, (size_t) (end - cp))) == NULL)
+			tok = end;
+
+		/* Remove the CRLF line terminator if the LF delimiter is chosen */
+		len = (size_t) (tok - cp);
+		if (delimiter == '\n' && len > 0 && cp[len - 1] == '\r')
+			len--;
 
 		/* Copy the string to the list */
-		list_cat(dest, tok);
+		str_ncpy(buf, cp, len);
+		list_push(dest, buf);
 
-		/* Remove the CRLF line terminator if the LF delimiter is chosen */
-		if (delimiter == '\n') {
-			str_chomp(dest->tail->value);
-		}
+		if (tok == end)
+			break;
 	}
-
-	//list_print(dest);
 }
 
 
@@ -0,0 +1,395 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2006, 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Packed string table.
+ *
+ * A list_t of N small strings costs three allocations per element: the
+ * list entry, the string_t, and its buffer. A strtab_t stores the same
+ * strings back to back in a single buffer with an array of offsets, so
+ * building a table of a directory listing or a queue index needs only
+ * a handful of reallocations, and walking it touches memory in order.
+*/
+
+#include "config.h"
+
+#include "nc_exception.h"
+#include "nc_list.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_string.h"
+#include "nc_strtab.h"
+#include "nc_strview.h"
+#include "sort.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Compare a key with one element of a table, in the order used by strtab_sort().
+ *
+ * @param rc less than, equal to, or greater than zero
+*/
+static int
+strtab_compare(int *rc, const strtab_t *tab, size_t index, const void *key, size_t len)
+{
+	const strtab_entry_t *ent = &tab->entry[index];
+
+	*rc = memcmp(tab->data + ent->offset, key, (ent->len < len) ? ent->len : len);
+	if (*rc == 0)
+		*rc = (ent->len > len) - (ent->len < len);
+}
+
+
+/**
+ * Create a new, empty string table.
+ *
+ * @param dest a new strtab_t object
+*/
+int
+strtab_new(strtab_t **dest)
+{
+
+	mem_calloc(*dest);
+	(*dest)->sorted = true;
+}
+
+
+/**
+ * Destroy a string table.
+ *
+ * @param tab the object to be destroyed; this will be set to NULL.
+*/
+int
+strtab_destroy(strtab_t **tab)
+{
+
+	if (*tab == NULL)
+		return 0;
+
+	free((*tab)->data);
+	free((*tab)->entry);
+	free(*tab);
+	*tab = NULL;
+}
+
+
+/**
+ * Remove all strings from a table.
+ *
+ * The memory is kept, so the table can be refilled without reallocating.
+ *
+ * @param tab the table
+*/
+int
+strtab_truncate(strtab_t *tab)
+{
+
+	tab->data_len = 0;
+	tab->count = 0;
+	tab->sorted = true;
+}
+
+
+/**
+ * Ensure that a table has room for more strings without reallocating.
+ *
+ * @param tab the table
+ * @param count the number of strings that will be added
+ * @param bytes the total length of the strings that will be added, not counting NUL terminators
+*/
+int
+strtab_reserve(strtab_t *tab, size_t count, size_t bytes)
+{
+	strtab_entry_t *entry;
+	char           *data;
+	size_t          size;
+
+	if (count > SIZE_MAX / sizeof(*entry) - tab->count || bytes > STRING_MAX - tab->data_len - count)
+		throw("result too large");
+
+	/* Grow the index */
+	if (tab->count + count > tab->size) {
+		size = (tab->size > 0) ? tab->size : 16;
+		while (size < tab->count + count)
+			size *= 2;
+		if ((entry = realloc(tab->entry, size * sizeof(*entry))) == NULL)
+			throw_errno("realloc(3)");
+		tab->entry = entry;
+		tab->size = size;
+	}
+
+	/* Grow the buffer, allowing for a NUL after each string */
+	if (tab->data_len + bytes + count > tab->data_size) {
+		size = (tab->data_size > 0) ? tab->data_size : 256;
+		while (size < tab->data_len + bytes + count)
+			size *= 2;
+		if ((data = realloc(tab->data, size)) == NULL)
+			throw_errno("realloc(3)");
+		tab->data = data;
+		tab->data_size = size;
+	}
+}
+
+
+/**
+ * Append a copy of a buffer to the end of a table.
+ *
+ * @param tab the table
+ * @param src the characters to be appended
+ * @param len the number of characters to append
+*/
+int
+strtab_append(strtab_t *tab, const void *src, size_t len)
+{
+	strtab_entry_t *ent;
+
+	strtab_reserve(tab, 1, len);
+
+	ent = &tab->entry[tab->count];
+	ent->offset = tab->data_len;
+	ent->len = len;
+	memcpy(tab->data + tab->data_len, src, len);
+	tab->data[tab->data_len + len] = '\0';
+	tab->data_len += len + 1;
+
+	/* Appending in ascending order keeps the table searchable */
+	if (tab->sorted && tab->count > 0) {
+		int rc;
+
+		(void) strtab_compare(&rc, tab, tab->count - 1, src, len);
+		if (rc > 0)
+			tab->sorted = false;
+	}
+	tab->count++;
+}
+
+
+/**
+ * Append a copy of a string to the end of a table.
+ *
+ * @param tab the table
+ * @param src the string to be appended
+*/
+int
+strtab_push(strtab_t *tab, const string_t *src)
+{
+
+	strtab_append(tab, src->value, src->len);
+}
+
+
+/**
+ * Append a copy of a NUL-terminated character array to the end of a table.
+ *
+ * @param tab the table
+ * @param src the characters to be appended
+*/
+int
+strtab_cat(strtab_t *tab, const char *src)
+{
+
+	strtab_append(tab, src, strlen(src));
+}
+
+
+/**
+ * Get a view of one element of a table.
+ *
+ * The view is invalidated by any call that adds strings to the table.
+ *
+ * @param dest the view
+ * @param tab the table
+ * @param index the index of the string
+*/
+int
+strtab_get(strview_t *dest, const strtab_t *tab, size_t index)
+{
+
+	if (index >= tab->count)
+		throw("index out of range");
+
+	dest->ptr = tab->data + tab->entry[index].offset;
+	dest->len = tab->entry[index].len;
+}
+
+
+/**
+ * Iterate over the elements of a table, in index order.
+ *
+ * Start with @a pos set to zero. Returns -1 without raising an
+ * exception when there are no more elements.
+ *
+ * @param dest the view of the next element
+ * @param pos the position of the iterator, which is advanced
+ * @param tab the table
+*/
+int
+strtab_next(strview_t *dest, size_t *pos, const strtab_t *tab)
+{
+
+	if (*pos >= tab->count)
+		return -1;
+
+	dest->ptr = tab->data + tab->entry[*pos].offset;
+	dest->len = tab->entry[*pos].len;
+	(*pos)++;
+}
+
+
+/**
+ * Sort the elements of a table.
+ *
+ * Only the index is rearranged; the strings stay where they are in the
+ * buffer, so the cost does not depend on their length.
+ *
+ * @param tab the table
+ * @param flags the same flags as list_sort()
+*/
+int
+strtab_sort(strtab_t *tab, int flags)
+{
+	struct sort_item *item = NULL;
+	string_t         *alias = NULL;
+	strtab_entry_t   *sorted = NULL;
+	size_t            i;
+
+	if (tab->count < 2) {
+		tab->sorted = !(flags & SORT_DESCENDING);
+		return 0;
+	}
+
+	/* Give each element a string_t header that points into the buffer */
+	if ((item = calloc(tab->count, sizeof(*item))) == NULL ||
+		(alias = calloc(tab->count, sizeof(*alias))) == NULL ||
+		(sorted = malloc(tab->size * sizeof(*sorted))) == NULL)
+		throw_errno("calloc(3)");
+	for (i = 0; i < tab->count; i++) {
+		alias[i].value = tab->data + tab->entry[i].offset;
+		alias[i].len = tab->entry[i].len;
+		alias[i].size = tab->entry[i].len + 1;
+		item[i].ptr = &tab->entry[i];
+		item[i].str = &alias[i];
+	}
+
+	if (sort_items(item, tab->count, flags) < 0)
+		throw_silent();
+
+	for (i = 0; i < tab->count; i++)
+		sorted[i] = *((strtab_entry_t *) item[i].ptr);
+	free(tab->entry);
+	tab->entry = sorted;
+	sorted = NULL;
+
+	/* Only the default ordering can be used by strtab_search() */
+	tab->sorted = !(flags & (SORT_DESCENDING | SORT_NUMERIC));
+
+finally:
+	free(item);
+	free(alias);
+	free(sorted);
+}
+
+
+/**
+ * Find a string in a sorted table using binary search.
+ *
+ * The table must be in ascending lexicographic order, either because
+ * strtab_sort() was called with SORT_DEFAULT or because the strings were
+ * appended in that order. If the key occurs more than once, the index
+ * of the first occurrence is returned. Returns -1 without raising an
+ * exception if the key is not found.
+ *
+ * @param index the index of the matching element
+ * @param tab the table
+ * @param key the string to search for
+ * @param len the length of @a key
+*/
+int
+strtab_search(size_t *index, const strtab_t *tab, const void *key, size_t len)
+{
+	size_t lo = 0, hi = tab->count, mid;
+	int    rc;
+
+	if (!tab->sorted)
+		throw("the table is not sorted");
+
+	/* Find the first element that is not less than the key */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		(void) strtab_compare(&rc, tab, mid, key, len);
+		if (rc < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == tab->count)
+		return -1;
+	(void) strtab_compare(&rc, tab, lo, key, len);
+	if (rc != 0)
+		return -1;
+	*index = lo;
+}
+
+
+/**
+ * Copy all elements of a list into a table.
+ *
+ * @param dest the table, whose previous contents will be removed
+ * @param src the list
+*/
+int
+strtab_from_list(strtab_t *dest, const list_t *src)
+{
+	list_entry_t *cur;
+	size_t        bytes = 0;
+
+	strtab_truncate(dest);
+	for (cur = src->head; cur != NULL; cur = cur->next)
+		bytes += cur->value->len;
+	strtab_reserve(dest, src->count, bytes);
+	for (cur = src->head; cur != NULL; cur = cur->next)
+		strtab_push(dest, cur->value);
+}
+
+
+/**
+ * Copy all elements of a table into a list.
+ *
+ * @param dest the list, whose previous contents will be removed
+ * @param src the table
+*/
+int
+strtab_to_list(list_t *dest, const strtab_t *src)
+{
+	string_t  alias = { .owner = false };
+	size_t    i;
+
+	/* The strings may contain NUL characters, so str_alias() is not used */
+	list_truncate(dest);
+	for (i = 0; i < src->count; i++) {
+		alias.value = src->data + src->entry[i].offset;
+		alias.len = src->entry[i].len;
+		alias.size = alias.len + 1;
+		list_push(dest, &alias);
+	}
+}
@@ -0,0 +1,167 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Non-owning string views.
+ *
+ * str_split() copies every token into a new string_t and a new list
+ * entry. When the tokens are only inspected, str_split_views() can
+ * be used instead to store pointers into the source string in a
+ * caller-provided array, without any memory allocation.
+*/
+
+#include "config.h"
+
+#include "nc_exception.h"
+#include "nc_string.h"
+#include "nc_strview.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Split a view into an array of views using a delimiter.
+ *
+ * The rules are the same as str_split(): a trailing LF or CR+LF is
+ * ignored, and if the delimiter is LF then the CR of each CR+LF line
+ * terminator is removed.
+ *
+ * If there are more than @a max tokens, the last element of @a dest
+ * holds the unsplit remainder of the input.
+ *
+ * @param dest array of at least @a max views to hold the result
+ * @param max the number of elements in @a dest
+ * @param count the number of views that were stored in @a dest
+ * @param src view to be split
+ * @param delimiter the delimiter to split on
+*/
+int
+strview_split(strview_t *dest, size_t max, size_t *count, strview_t src, int delimiter)
+{
+	const char *cp, *end, *tok;
+	size_t      len, i;
+
+	*count = 0;
+	if (src.len == 0 || max == 0)
+		return 0;
+
+	/* Special case: ignore the trailing LF or CR+LF if it exists */
+	end = src.ptr + src.len;
+	if (end > src.ptr && end[-1] == '\n')
+		end--;
+	if (end > src.ptr && end[-1] == '\r')
+		end--;
+
+	for (i = 0, cp = src.ptr; i < max; i++, cp = tok + 1) {
+
+		/* The last slot gets whatever is left over */
+		if (i == max - 1 || (tok = memchr(cp, delimiter, (size_t) (end - cp))) == NULL)
+			tok = end;
+
+		/* Remove the CRLF line terminator if the LF delimiter is chosen */
+		len = (size_t) (tok - cp);
+		if (delimiter == '\n' && len > 0 && cp[len - 1] == '\r')
+			len--;
+
+		dest[i].ptr = cp;
+		dest[i].len = len;
+
+		if (tok == end)
+			break;
+	}
+	*count = i + 1;
+}
+
+
+/**
+ * Split a string into an array of views using a delimiter.
+ *
+ * The views point into @a src, which must not be modified while
+ * they are in use.
+ *
+ * @see strview_split()
+*/
+int
+str_split_views(strview_t *dest, size_t max, size_t *count, const string_t *src, int delimiter)
+{
+
+	strview_split(dest, max, count, strview_from_str(src), delimiter);
+}
+
+
+/**
+ * Convert a view to an unsigned 64-bit integer.
+ *
+ * @param dest pointer to the result
+ * @param src view containing only decimal digits
+*/
+int
+strview_to_uint64(uint64_t *dest, strview_t src)
+{
+
+	str_parse_uint64(dest, src.ptr, src.len);
+}
+
+
+/**
+ * Convert a view to a signed 64-bit integer.
+ *
+ * @param dest pointer to the result
+ * @param src view containing an optional sign followed by decimal digits
+*/
+int
+strview_to_int64(int64_t *dest, strview_t src)
+{
+
+	str_parse_int64(dest, src.ptr, src.len);
+}
+
+
+/**
+ * Convert a view to an unsigned 32-bit integer.
+ *
+ * @param dest pointer to the result
+ * @param src view containing only decimal digits
+*/
+int
+strview_to_uint32(uint32_t *dest, strview_t src)
+{
+	uint64_t n;
+
+	str_parse_uint64(&n, src.ptr, src.len);
+	if (n > UINT32_MAX)
+		throw("integer overflow");
+	*dest = (uint32_t) n;
+}
+
+
+/**
+ * Copy the contents of a view into a string.
+ *
+ * @param dest string that will hold a copy of the view
+ * @param src the view to be copied
+*/
+int
+str_from_view(string_t *dest, strview_t src)
+{
+
+	str_ncpy(dest, src.ptr, src.len);
+}
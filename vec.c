@@ -0,0 +1,456 @@
+/*		$Id: $		*/
+
+/*
+ * Copyright (c) 2007 Mark Heily <devel@heily.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/** @file
+ *
+ * Vectors of strings.
+ *
+ * A list_t costs a separate allocation for every node, string_t and
+ * buffer, and list_get() has to walk the list to reach an element. A
+ * vec_t keeps the string_t structures themselves in one array, so
+ * random access is O(1) and each element needs only its own buffer.
+*/
+
+#include "config.h"
+
+#include "nc_exception.h"
+#include "nc_list.h"
+#include "nc_log.h"
+#include "nc_memory.h"
+#include "nc_string.h"
+#include "nc_strview.h"
+#include "nc_vec.h"
+#include "sort.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------------ FUNCTIONS ------------------------------- */
+
+/**
+ * Initialize a vector element with a private copy of a buffer.
+ *
+ * @param slot the element, which must not hold a value
+ * @param src the data to be copied
+ * @param len the number of bytes to copy
+*/
+static int
+vec_slot_init(string_t *slot, const char *src, size_t len)
+{
+	char *buf;
+
+	if (len >= STRING_MAX)
+		throwf("string too large (%zu > %zu)", len, STRING_MAX);
+	if ((buf = malloc(len + 1)) == NULL)
+		throw_errno("malloc(3)");
+	if (len > 0)
+		memcpy(buf, src, len);
+	buf[len] = '\0';
+
+	slot->value = buf;
+	slot->len = len;
+	slot->size = len + 1;
+	slot->owner = true;
+}
+
+
+/**
+ * Create a new, empty vector.
+ *
+ * @param dest a new vec_t object
+*/
+int
+vec_new(vec_t **dest)
+{
+
+	mem_calloc(*dest);
+}
+
+
+/**
+ * Destroy a vector and all of its elements.
+ *
+ * @param vec the object to be destroyed; this will be set to NULL.
+*/
+int
+vec_destroy(vec_t **vec)
+{
+
+	if (*vec == NULL)
+		return 0;
+
+	(void) vec_truncate(*vec);
+	free((*vec)->item);
+	free(*vec);
+	*vec = NULL;
+}
+
+
+/**
+ * Remove all elements from a vector.
+ *
+ * The array is kept so that it can be reused.
+ *
+ * @param vec the vector
+*/
+int
+vec_truncate(vec_t *vec)
+{
+	size_t i;
+
+	for (i = 0; i < vec->count; i++) {
+		if (vec->item[i].owner)
+			free((char *) vec->item[i].value);
+	}
+	vec->count = 0;
+}
+
+
+/**
+ * Make room for at least @a count elements.
+ *
+ * The capacity is at least doubled each time the array grows.
+ *
+ * @param vec the vector
+ * @param count the number of elements that the vector must be able to hold
+*/
+int
+vec_reserve(vec_t *vec, size_t count)
+{
+	string_t *p = NULL;
+	size_t    size;
+
+	if (count <= vec->size)
+		return 0;
+
+	size = (vec->size < 8) ? 8 : vec->size;
+	while (size < count) {
+		if (size > SIZE_MAX / sizeof(*p) / 2)
+			throw("vector too large");
+		size *= 2;
+	}
+	if ((p = realloc(vec->item, size * sizeof(*p))) == NULL)
+		throw_errno("realloc(3)");
+	vec->item = p;
+	vec->size = size;
+}
+
+
+/**
+ * Add a copy of a string to the end of a vector.
+ *
+ * @param vec the vector
+ * @param src the string to be copied
+*/
+int
+vec_push(vec_t *vec, const string_t *src)
+{
+
+	vec_insert(vec, vec->count, src);
+}
+
+
+/**
+ * Add a copy of a NUL-terminated character array to the end of a vector.
+ *
+ * @param vec the vector
+ * @param src the characters to be copied
+*/
+int
+vec_cat(vec_t *vec, const char *src)
+{
+
+	vec_reserve(vec, vec->count + 1);
+	vec_slot_init(&vec->item[vec->count], src, strlen(src));
+	vec->count++;
+}
+
+
+/**
+ * Remove the last element of a vector.
+ *
+ * The element's buffer is handed to @a dest, so nothing is copied.
+ *
+ * @param dest string that will hold the value of the element
+ * @param vec the vector
+*/
+int
+vec_pop(string_t *dest, vec_t *vec)
+{
+
+	if (vec->count == 0)
+		throw_silent();
+
+	if (dest->owner)
+		free((char *) dest->value);
+	*dest = vec->item[--vec->count];
+}
+
+
+/**
+ * Copy the value of an element.
+ *
+ * @param dest string that will hold a copy of the element
+ * @param vec the vector
+ * @param offset the index of the element
+*/
+int
+vec_get(string_t *dest, const vec_t *vec, size_t offset)
+{
+
+	if (offset >= vec->count)
+		throwf("index out of range (%zu >= %zu)", offset, vec->count);
+
+	str_copy(dest, &vec->item[offset]);
+}
+
+
+/**
+ * Replace the value of an element.
+ *
+ * @param vec the vector
+ * @param offset the index of the element
+ * @param src the new value
+*/
+int
+vec_set(vec_t *vec, size_t offset, const string_t *src)
+{
+	struct str tmp;
+
+	if (offset >= vec->count)
+		throwf("index out of range (%zu >= %zu)", offset, vec->count);
+
+	/* Copy first, in case @a src is the element being replaced */
+	vec_slot_init(&tmp, src->value, src->len);
+	if (vec->item[offset].owner)
+		free((char *) vec->item[offset].value);
+	vec->item[offset] = tmp;
+}
+
+
+/**
+ * Insert a copy of a string before an element.
+ *
+ * @param vec the vector
+ * @param offset the index that the new element will have; this may
+ *               be equal to the number of elements
+ * @param src the string to be copied
+*/
+int
+vec_insert(vec_t *vec, size_t offset, const string_t *src)
+{
+	struct str tmp;
+
+	if (offset > vec->count)
+		throwf("index out of range (%zu > %zu)", offset, vec->count);
+
+	/* Copy first, in case @a src is an element that is moved by realloc(3) */
+	vec_slot_init(&tmp, src->value, src->len);
+	if (vec_reserve(vec, vec->count + 1) < 0) {
+		free((char *) tmp.value);
+		throw_silent();
+	}
+	memmove(&vec->item[offset + 1], &vec->item[offset],
+			(vec->count - offset) * sizeof(*vec->item));
+	vec->item[offset] = tmp;
+	vec->count++;
+}
+
+
+/**
+ * Remove an element from a vector.
+ *
+ * @param vec the vector
+ * @param offset the index of the element
+*/
+int
+vec_remove(vec_t *vec, size_t offset)
+{
+
+	if (offset >= vec->count)
+		throwf("index out of range (%zu >= %zu)", offset, vec->count);
+
+	if (vec->item[offset].owner)
+		free((char *) vec->item[offset].value);
+	vec->count--;
+	memmove(&vec->item[offset], &vec->item[offset + 1],
+			(vec->count - offset) * sizeof(*vec->item));
+}
+
+
+/**
+ * Copy all elements of a list into a vector.
+ *
+ * @param dest the vector, whose previous contents will be removed
+ * @param src the list
+*/
+int
+vec_from_list(vec_t *dest, const list_t *src)
+{
+	list_entry_t *cur;
+
+	vec_truncate(dest);
+	vec_reserve(dest, src->count);
+	for (cur = src->head; cur != NULL; cur = cur->next)
+		vec_push(dest, cur->value);
+}
+
+
+/**
+ * Copy all elements of a vector into a list.
+ *
+ * @param dest the list, whose previous contents will be removed
+ * @param src the vector
+*/
+int
+vec_to_list(list_t *dest, const vec_t *src)
+{
+	size_t i;
+
+	list_truncate(dest);
+	for (i = 0; i < src->count; i++)
+		list_push(dest, &src->item[i]);
+}
+
+
+/**
+ * Join all elements of a vector together into a delimited string.
+ *
+ * This has the same semantics as str_join().
+ *
+ * @param dest string that will store the result
+ * @param src vector to be joined
+ * @param delimiter delimiter to use
+*/
+int
+vec_join(string_t *dest, const vec_t *src, int delimiter)
+{
+	size_t i, len = 0;
+
+	/* Compute the length of the result to avoid repeated reallocation */
+	for (i = 0; i < src->count; i++)
+		len += src->item[i].len + 1;
+
+	str_truncate(dest);
+	str_resize(dest, len + 2);
+	for (i = 0; i < src->count; i++) {
+		str_append(dest, &src->item[i]);
+
+		/* The last element doesn't get a delimiter */
+		if (i + 1 < src->count)
+			str_putc(dest, delimiter);
+	}
+
+	/* If the delimiter is a newline, add a trailing newline */
+	if (delimiter == '\n')
+		str_putc(dest, delimiter);
+}
+
+
+/**
+ * Sort a vector.
+ *
+ * Only the string_t structures are moved; the values are not copied.
+ *
+ * @param vec vector to be sorted
+ * @param flags the same flags that are accepted by list_sort()
+*/
+int
+vec_sort(vec_t *vec, int flags)
+{
+	struct sort_item *item = NULL;
+	string_t         *sorted = NULL;
+	size_t            i;
+
+	if (vec->count < 2)
+		return 0;
+
+	if ((item = calloc(vec->count, sizeof(*item))) == NULL ||
+		(sorted = calloc(vec->size, sizeof(*sorted))) == NULL)
+		throw_errno("calloc(3)");
+	for (i = 0; i < vec->count; i++) {
+		item[i].ptr = &vec->item[i];
+		item[i].str = &vec->item[i];
+	}
+
+	if (sort_items(item, vec->count, flags) < 0)
+		throw_silent();
+
+	/* Rearrange the elements into a new array */
+	for (i = 0; i < vec->count; i++)
+		sorted[i] = *((string_t *) item[i].ptr);
+	free(vec->item);
+	vec->item = sorted;
+	sorted = NULL;
+
+finally:
+	free(item);
+	free(sorted);
+}
+
+
+/**
+ * Convert a vector into a string suitable for serialization.
+ *
+ * The format is the same as list_serialize(), so the result can be read
+ * by either vec_deserialize() or list_deserialize().
+ *
+ * @param dest string that will store the result
+ * @param src the vector
+*/
+int
+vec_serialize(string_t *dest, const vec_t *src)
+{
+	string_t *buf;
+	size_t    i;
+
+	str_truncate(dest);
+	for (i = 0; i < src->count; i++) {
+		str_escape(buf, &src->item[i]);
+		if (i > 0)
+			str_putc(dest, ' ');
+		str_append(dest, buf);
+	}
+}
+
+
+/**
+ * Create a vector from a serialized string.
+ *
+ * @param dest the vector, whose previous contents will be removed
+ * @param src string containing a serialized list or vector
+*/
+int
+vec_deserialize(vec_t *dest, const string_t *src)
+{
+	strview_t rest, tok;
+	string_t *buf;
+	string_t *tmp;
+
+	vec_truncate(dest);
+	if (src->len == 0)
+		return 0;
+
+	rest = strview_from_str(src);
+	while (strview_tok(&tok, &rest, ' ')) {
+		str_from_view(buf, tok);
+		str_unescape(tmp, buf);
+		vec_push(dest, tmp);
+	}
+}